@@ -4,9 +4,9 @@
 sudo yum install\
 		cmake\
 		gcc-c++\
-		libX11-devel libXtst-devel\
-		pcre-devel\
+		libX11-devel libXtst-devel libXfixes-devel\
 		avahi-devel\
 		libconfig-devel\
+		libxkbcommon-devel\
 		gtk2-devel\
 		libXmu-devel libXt-devel
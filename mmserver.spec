@@ -14,9 +14,9 @@ BuildRoot:      %{_tmppath}/%{name}-%{version}-%{release}-root-%(%{__id_u} -n)
 
 BuildRequires:  rpmdevtools
 BuildRequires:  cmake, gcc-c++
-BuildRequires:  libX11-devel libXtst-devel
-BuildRequires:  pcre-devel, avahi-devel
-BuildRequires:  libconfig-devel, gtk2-devel
+BuildRequires:  libX11-devel libXtst-devel libXfixes-devel
+BuildRequires:  avahi-devel
+BuildRequires:  libconfig-devel, gtk2-devel, libxkbcommon-devel
 
 %description
 Modified Mobile Mouse Server for Linux. Intended for (but not limited to) use with Raspbian & Raspberry Pi.
@@ -52,6 +52,8 @@ rm -rf $RPM_BUILD_ROOT
 %{_sbindir}/mmserver
 %{_datadir}/applications/mmserver.desktop
 %{_datadir}/mmserver/*
+/usr/lib/systemd/user/mmserver.socket
+/usr/lib/systemd/user/mmserver.service
 
 %changelog
 * Mon Dec 2 2013 Stiliyan Sabchew <ssabchew at yahoo dot com> - 0.4.0-1
@@ -0,0 +1,227 @@
+/*
+   Mobile Mouse Linux Server 
+   Copyright (C) 2011 Erik Lax <erik@datahack.se>
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "acceleration.hpp"
+
+#include <algorithm>
+#include <string>
+
+/* below this interval two moves are treated as simultaneous */
+#define ACCEL_MIN_INTERVAL_MSEC 1.0
+
+AccelerationCurve::AccelerationCurve()
+{
+	Build(AP_FLAT, 0.0, 1.0, Points());
+}
+
+bool AccelerationCurve::ParseProfile(const std::string& name, Profile& profile)
+{
+	if (name == "flat") {
+		profile = AP_FLAT;
+	} else if (name == "step") {
+		profile = AP_STEP;
+	} else if (name == "linear") {
+		profile = AP_LINEAR;
+	} else if (name == "adaptive") {
+		profile = AP_ADAPTIVE;
+	} else if (name == "custom") {
+		profile = AP_CUSTOM;
+	} else {
+		return false;
+	}
+	return true;
+}
+
+/*
+ * Parameters:
+ *   profile, shape of the curve
+ *   threshold, speed (pixels per millisecond) at which acceleration sets in
+ *   factor, maximum gain
+ *   points, (speed, gain) pairs for AP_CUSTOM; ignored otherwise
+ */
+void AccelerationCurve::Build(Profile profile, double threshold, double factor, const Points& points)
+{
+	m_profile = profile;
+	m_threshold = threshold > 0.0 ? threshold : 0.0;
+	m_factor = factor > 0.0 ? factor : 1.0;
+	m_points = points;
+	std::sort(m_points.begin(), m_points.end());
+
+	if (m_profile == AP_CUSTOM && m_points.empty()) {
+		m_profile = AP_FLAT;
+	}
+
+	/* the table spans the speeds over which the curve changes */
+	switch (m_profile) {
+		case AP_STEP:
+		case AP_LINEAR:
+			m_maxSpeed = m_threshold;
+			break;
+		case AP_ADAPTIVE:
+			m_maxSpeed = 4.0 * m_threshold;
+			break;
+		case AP_CUSTOM:
+			m_maxSpeed = m_points.back().first;
+			break;
+		case AP_FLAT:
+		default:
+			m_maxSpeed = 0.0;
+			break;
+	}
+	if (m_maxSpeed <= 0.0) {
+		m_maxSpeed = 1.0;
+	}
+
+	m_step = m_maxSpeed / ACCEL_TABLE_SIZE;
+	for (unsigned int i = 0; i <= ACCEL_TABLE_SIZE; i++) {
+		m_table[i] = Evaluate(i * m_step);
+	}
+}
+
+double AccelerationCurve::Evaluate(double speed) const
+{
+	switch (m_profile) {
+		case AP_STEP:
+			/* the original behaviour: full gain once past the threshold */
+			return speed > m_threshold ? m_factor : 1.0;
+
+		case AP_LINEAR:
+			/* gain rises evenly from 1 at rest to factor at the threshold */
+			if (m_threshold <= 0.0 || speed >= m_threshold) {
+				return m_factor;
+			}
+			return 1.0 + (m_factor - 1.0) * speed / m_threshold;
+
+		case AP_ADAPTIVE:
+			/* libinput-style: slow motion is damped for precision, normal
+			 * motion is passed through, and beyond the threshold the gain
+			 * inclines to reach factor at four times the threshold */
+			if (m_threshold <= 0.0) {
+				return m_factor;
+			}
+			if (speed < m_threshold / 2.0) {
+				return 0.5 + speed / m_threshold;
+			}
+			if (speed <= m_threshold) {
+				return 1.0;
+			}
+			return std::min(m_factor, 1.0 + (m_factor - 1.0) * (speed - m_threshold) / (3.0 * m_threshold));
+
+		case AP_CUSTOM:
+			/* piecewise linear through the configured points, flat outside them */
+			if (speed <= m_points.front().first) {
+				return m_points.front().second;
+			}
+			for (size_t i = 1; i < m_points.size(); i++) {
+				if (speed <= m_points[i].first) {
+					double span = m_points[i].first - m_points[i - 1].first;
+					double t = span > 0.0 ? (speed - m_points[i - 1].first) / span : 1.0;
+					return m_points[i - 1].second + t * (m_points[i].second - m_points[i - 1].second);
+				}
+			}
+			return m_points.back().second;
+
+		case AP_FLAT:
+		default:
+			return 1.0;
+	}
+}
+
+double AccelerationCurve::Factor(double speed) const
+{
+	/* a jump cannot be interpolated */
+	if (m_profile == AP_STEP) {
+		return Evaluate(speed);
+	}
+
+	if (speed <= 0.0) {
+		return m_table[0];
+	}
+	if (speed >= m_maxSpeed) {
+		return m_table[ACCEL_TABLE_SIZE];
+	}
+
+	double pos = speed / m_step;
+	unsigned int i = (unsigned int)pos;
+	double t = pos - i;
+	return m_table[i] + t * (m_table[i + 1] - m_table[i]);
+}
+
+PointerAccelerator::PointerAccelerator(const AccelerationCurve& curve)
+: m_curve(curve)
+{
+	Reset();
+}
+
+void PointerAccelerator::Reset()
+{
+	m_count = 0;
+	m_next = 0;
+}
+
+/*
+ * Parameters:
+ *   distance, length of this move in pixels
+ *   when, receive time of this move (CLOCK_REALTIME)
+ *
+ * Return Value:
+ *   gain to apply to this move
+ */
+double PointerAccelerator::Factor(double distance, const struct timespec& when)
+{
+	double now = (double)when.tv_sec * 1000.0 + (double)when.tv_nsec / 1000000.0;
+
+	/* the wall clock was stepped back; the old samples are meaningless */
+	if (m_count > 0 && now < m_samples[(m_next + ACCEL_WINDOW_SAMPLES - 1) % ACCEL_WINDOW_SAMPLES].time) {
+		Reset();
+	}
+
+	/* average over the moves that fall inside the window; the oldest of
+	 * them only marks where the window starts */
+	double travelled = distance;
+	double start = now;
+	double pending = 0.0;
+	unsigned int inside = 0;
+	for (unsigned int n = 1; n <= m_count; n++) {
+		const Sample& s = m_samples[(m_next + ACCEL_WINDOW_SAMPLES - n) % ACCEL_WINDOW_SAMPLES];
+		if (now - s.time > ACCEL_WINDOW_MSEC) {
+			break;
+		}
+		travelled += pending;
+		pending = s.distance;
+		start = s.time;
+		inside++;
+	}
+
+	/* without a recent move to measure against, as after a pause, the
+	 * speed is unknown and the move passes through unchanged */
+	double factor = 1.0;
+	if (inside > 0) {
+		factor = m_curve.Factor(travelled / std::max(now - start, ACCEL_MIN_INTERVAL_MSEC));
+	}
+
+	m_samples[m_next].distance = distance;
+	m_samples[m_next].time = now;
+	m_next = (m_next + 1) % ACCEL_WINDOW_SAMPLES;
+	if (m_count < ACCEL_WINDOW_SAMPLES) {
+		m_count++;
+	}
+
+	return factor;
+}
@@ -0,0 +1,96 @@
+/*
+   Mobile Mouse Linux Server 
+   Copyright (C) 2011 Erik Lax <erik@datahack.se>
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef _ACCELERATION_HPP_
+#define _ACCELERATION_HPP_
+
+#include <time.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+#define ACCEL_TABLE_SIZE 256
+
+/* velocity is smoothed over at most this many recent moves within this window */
+#define ACCEL_WINDOW_SAMPLES 4
+#define ACCEL_WINDOW_MSEC 50.0
+
+/*
+ * Maps pointer speed (pixels per millisecond) to a gain factor. The curve
+ * is evaluated once, when the configuration is loaded, into a lookup table
+ * that Factor() interpolates.
+ */
+class AccelerationCurve
+{
+	public:
+		enum Profile {
+			AP_FLAT,
+			AP_STEP,
+			AP_LINEAR,
+			AP_ADAPTIVE,
+			AP_CUSTOM
+		};
+
+		typedef std::vector<std::pair<double, double> > Points;
+
+		AccelerationCurve();
+
+		void Build(Profile profile, double threshold, double factor, const Points& points);
+		double Factor(double speed) const;
+
+		static bool ParseProfile(const std::string& name, Profile& profile);
+
+	private:
+		double Evaluate(double speed) const;
+
+		Profile m_profile;
+		double m_threshold;
+		double m_factor;
+		Points m_points;
+
+		double m_maxSpeed;
+		double m_step;
+		double m_table[ACCEL_TABLE_SIZE + 1];
+};
+
+/*
+ * Per-session pointer acceleration: estimates velocity over a short window
+ * of recent moves and looks up the gain on the configured curve.
+ */
+class PointerAccelerator
+{
+	public:
+		PointerAccelerator(const AccelerationCurve& curve);
+
+		double Factor(double distance, const struct timespec& when);
+		void Reset();
+
+	private:
+		struct Sample {
+			double distance;
+			double time;
+		};
+
+		const AccelerationCurve& m_curve;
+		Sample m_samples[ACCEL_WINDOW_SAMPLES];
+		unsigned int m_count;
+		unsigned int m_next;
+};
+
+#endif
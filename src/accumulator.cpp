@@ -0,0 +1,88 @@
+/*
+   Mobile Mouse Linux Server 
+   Copyright (C) 2011 Erik Lax <erik@datahack.se>
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "accumulator.hpp"
+
+MotionAccumulator::MotionAccumulator()
+: m_x(0)
+, m_y(0)
+{
+}
+
+void MotionAccumulator::Add(MotionFixed dx, MotionFixed dy)
+{
+	m_x += dx;
+	m_y += dy;
+}
+
+/*
+ * Parameters:
+ *   x, y, receive the whole units accumulated so far (truncated toward zero)
+ *
+ * Return Value:
+ *   true if either x or y is non-zero
+ *
+ * Result:
+ *   the emitted units are subtracted; the fractional remainder stays
+ */
+bool MotionAccumulator::Take(int& x, int& y)
+{
+	MotionFixed wx = m_x / MOTION_FIXED_ONE;
+	MotionFixed wy = m_y / MOTION_FIXED_ONE;
+
+	m_x -= wx * MOTION_FIXED_ONE;
+	m_y -= wy * MOTION_FIXED_ONE;
+
+	x = (int)wx;
+	y = (int)wy;
+	return x != 0 || y != 0;
+}
+
+void MotionAccumulator::Reset()
+{
+	m_x = m_y = 0;
+}
+
+DetentAccumulator::DetentAccumulator()
+: m_remainder(0)
+{
+}
+
+/*
+ * Parameters:
+ *   delta, scroll in 120ths of a detent
+ *
+ * Return Value:
+ *   whole detents completed by delta
+ */
+int DetentAccumulator::Take(int delta)
+{
+	if ((delta > 0 && m_remainder < 0) || (delta < 0 && m_remainder > 0)) {
+		m_remainder = 0;
+	}
+	m_remainder += delta;
+	int detents = m_remainder / MOUSE_HIRES_DETENT;
+	m_remainder -= detents * MOUSE_HIRES_DETENT;
+	return detents;
+}
+
+void DetentAccumulator::Reset()
+{
+	m_remainder = 0;
+}
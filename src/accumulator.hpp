@@ -0,0 +1,72 @@
+/*
+   Mobile Mouse Linux Server 
+   Copyright (C) 2011 Erik Lax <erik@datahack.se>
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef _ACCUMULATOR_HPP_
+#define _ACCUMULATOR_HPP_
+
+#include <stdint.h>
+
+/*
+ * Motion deltas are carried as decimal fixed-point values so that the
+ * client's decimal strings parse without rounding: MOTION_FIXED_ONE is one
+ * pixel (or one scroll unit).
+ */
+typedef int64_t MotionFixed;
+#define MOTION_FIXED_ONE 1000000LL
+#define MOTION_FIXED_DIGITS 6
+
+/*
+ * Sums fractional deltas and releases them as whole units, carrying the
+ * remainder forward so slow, precise motion is not truncated away.
+ */
+class MotionAccumulator
+{
+	public:
+		MotionAccumulator();
+
+		void Add(MotionFixed dx, MotionFixed dy);
+		bool Take(int& x, int& y);
+		void Reset();
+
+	private:
+		MotionFixed m_x;
+		MotionFixed m_y;
+};
+
+/* high-resolution wheel units per detent */
+#define MOUSE_HIRES_DETENT 120
+
+/*
+ * Derives legacy wheel clicks from high-resolution scroll the way a hi-res
+ * wheel mouse does: one click per full MOUSE_HIRES_DETENT, restarting when
+ * the direction turns.
+ */
+class DetentAccumulator
+{
+	public:
+		DetentAccumulator();
+
+		int Take(int delta);
+		void Reset();
+
+	private:
+		int m_remainder;
+};
+
+#endif
@@ -18,109 +18,335 @@
 */
 
 #include "clipboardinterface.hpp"
+#include "clipboardwatcher.hpp"
 
 #include <X11/extensions/XTest.h>
 #include <X11/XKBlib.h>
-#include <stdexcept>
-#include <stdlib.h>
-#include <unistd.h>
-#include <stdio.h>
+#include <string.h>
+#include <syslog.h>
 #include <X11/Xatom.h>
 #include <X11/Xmu/Atoms.h>
 
-#include "xclib.h"
+ClipboardInterface::ClipboardInterface(XService& x)
+: m_x(x)
+, m_owned(false)
+, m_ownTime(CurrentTime)
+, m_restorePending(false)
+, m_hadPrevious(false)
+, m_restoreAt()
+{
+	m_display = m_x.GetDisplay();
+	m_x.Wait([this](Display*) { Setup(); });
+	m_x.AddClient(this);
+}
 
-ClipboardInterface::ClipboardInterface(const std::string display) {
-	if ((m_display = XOpenDisplay(display.empty()?NULL:display.c_str())) == NULL) {
-		throw std::runtime_error("cannot open xdisplay");
-	}
+ClipboardInterface::~ClipboardInterface() {
+	m_x.RemoveClient(this);
+	m_x.Wait([this](Display*) { XDestroyWindow(m_display, m_window); });
+}
 
-	/* we need a window in order to access the clipboard. not displayed. */
+void ClipboardInterface::Setup()
+{
+	/* we need a window in order to own the clipboard. not displayed.
+	 * property changes on it give us server time. */
 	m_window = XCreateSimpleWindow(m_display, DefaultRootWindow(m_display), 0, 0, 1, 1, 0, 0, 0);
-}
+	XSelectInput(m_display, m_window, PropertyChangeMask);
 
-ClipboardInterface::~ClipboardInterface() {
-	XDestroyWindow(m_display, m_window);
-	XCloseDisplay(m_display);
+	m_clipboard = XA_CLIPBOARD(m_display);
+	m_targets = XInternAtom(m_display, "TARGETS", False);
+	m_utf8 = XInternAtom(m_display, "UTF8_STRING", False);
+	m_text = XInternAtom(m_display, "TEXT", False);
+	m_incr = XInternAtom(m_display, "INCR", False);
+	m_timestamp = XInternAtom(m_display, "MMSERVER_TIMESTAMP", False);
+
+	/* property data larger than one request goes out incrementally */
+	long maxRequest = XExtendedMaxRequestSize(m_display);
+	if (maxRequest == 0) {
+		maxRequest = XMaxRequestSize(m_display);
+	}
+	m_chunk = (size_t)maxRequest * 4 - 256;
+	if (m_chunk > 256 * 1024) {
+		m_chunk = 256 * 1024;
+	}
 }
 
-bool ClipboardInterface::Update(void) {
-	/* buffer for selection data */
-	unsigned char *sel_buf;
+/*
+ * Parameters:
+ *   text, to be pasted by the caller's paste keystroke
+ *   watcher, whose copy of the clipboard is put back if it is current
+ *
+ * Return Value:
+ *   true if the clipboard now holds text; the previous contents come back
+ *   once it has been fetched, or after CLIPBOARD_RESTORE_MSEC
+ *
+ * This waits for the X thread: the paste keystroke must not overtake the
+ * ownership it relies on, and it may come through uinput.
+ */
+bool ClipboardInterface::Paste(const std::string& text, const ClipboardWatcher& watcher)
+{
+	return m_x.Call<bool>([this, &text, &watcher](Display*) { return Take(text, watcher); }).get();
+}
 
-	/* length of sel_buf */
-	unsigned long sel_len = 0;
+bool ClipboardInterface::Take(const std::string& text, const ClipboardWatcher& watcher)
+{
+	/* a paste still in flight has already saved the original contents */
+	if (!m_restorePending) {
+		Window owner = m_owned ? m_window : XGetSelectionOwner(m_display, m_clipboard);
+		if (m_owned) {
+			m_hadPrevious = true;
+			m_previous = m_content;
+		} else if (owner != None) {
+			/* a copy from an earlier owner, or none at all, is not put back */
+			std::shared_ptr<const ClipboardText> cached = watcher.Get();
+			m_hadPrevious = cached->owner == owner && watcher.Current(*cached);
+			m_previous = m_hadPrevious ? cached->Join() : std::string();
+		} else {
+			m_hadPrevious = false;
+			m_previous.clear();
+		}
+	}
 
-	/* X Event Structures */
-	XEvent evt;
+	if (!Own(text)) {
+		return false;
+	}
+	m_restorePending = true;
+	Arm(CLIPBOARD_RESTORE_MSEC);
+	return true;
+}
 
-	/* reading clipboard can be a multi-step process; context tracks current step */
-	unsigned int context = XCLIB_XCOUT_NONE;
+bool ClipboardInterface::Own(const std::string& text)
+{
+	Time now = ServerTime();
+	XSetSelectionOwner(m_display, m_clipboard, m_window, now);
+	if (XGetSelectionOwner(m_display, m_clipboard) != m_window) {
+		syslog(LOG_ERR, "cannot take clipboard ownership");
+		m_owned = false;
+		return false;
+	}
+	m_owned = true;
+	m_ownTime = now;
+	m_content = text;
+	return true;
+}
 
-	/* X selection to work with - use XA_PRIMARY for current selected text */
-	Atom sseln = XA_CLIPBOARD(m_display);
+/* puts back what the clipboard held before the paste */
+void ClipboardInterface::Restore()
+{
+	m_restorePending = false;
+	if (!m_owned) {
+		/* someone else has taken the clipboard since; leave it to them */
+		return;
+	}
 
-	/* desired format (xcout actually tries to get as UTF-8 first) */
-	Atom target = XA_STRING;
+	if (m_hadPrevious) {
+		/* the previous owner has lost the selection to us; serve its text */
+		m_content = m_previous;
+	} else {
+		XSetSelectionOwner(m_display, m_clipboard, None, ServerTime());
+		m_owned = false;
+	}
+	m_previous.clear();
+}
 
-	/* whether this update has actually changed the cached clipboard content */
-	bool updated = false;
+/*
+ * Puts the previous contents back once the restore deadline has passed and
+ * drops stalled transfers.
+ *
+ * Return Value:
+ *   milliseconds until the next deadline, -1 if there is none
+ */
+int ClipboardInterface::Idle()
+{
+	int wait = ExpireTransfers();
+	if (!m_restorePending) {
+		return wait;
+	}
 
-	while (1) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	long msec = (m_restoreAt.tv_sec - now.tv_sec) * 1000 + (m_restoreAt.tv_nsec - now.tv_nsec) / 1000000;
+	if (msec > 0) {
+		return wait >= 0 && wait < msec ? wait : (int)msec;
+	}
+	Restore();
+	return wait;
+}
 
-		/* initial context is NONE, so this is skipped... */
-		/* second time through, context is SENT, so we request next event... */
-		/* only get an event if xcout() is doing something */
-		if (context != XCLIB_XCOUT_NONE) {
-			XNextEvent(m_display, &evt);
-		}
+/*
+ * Drops the transfers whose requestor has not read a chunk in time, so
+ * a client dying mid-paste does not pin its copy of the text.
+ *
+ * Return Value:
+ *   milliseconds until the next transfer deadline, -1 if there is none
+ */
+int ClipboardInterface::ExpireTransfers()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
 
-		/* with initial context NONE, xcout sends selection request to owner,
-		 * changes context to SENT, and returns... */
-		/* xcout could do a few things the second time through;
-		 * first, it'll see if it can get selection as UTF8; if not, returns fallback, and reverts to string below to try again */
-		/* alternatively, getting the result may require repeated attempts (INCRemental mode) */
-		/* or, it might just get it, setting context back to NONE so we break out */
-		/* fetch the selection, or part of it */
-		xcout(m_display, m_window, evt, sseln, target, &sel_buf, &sel_len, &context);
-
-		/* initially, context is SENT now */
-		/* fallback is needed. set XA_STRING to target and restart the loop. */
-		if (context == XCLIB_XCOUT_FALLBACK) {
-			context = XCLIB_XCOUT_NONE;
-			target = XA_STRING;
+	int wait = -1;
+	std::list<Transfer>::iterator i = m_transfers.begin();
+	while (i != m_transfers.end()) {
+		long msec = (i->deadline.tv_sec - now.tv_sec) * 1000 + (i->deadline.tv_nsec - now.tv_nsec) / 1000000;
+		if (msec > 0) {
+			if (wait < 0 || msec < wait) {
+				wait = (int)msec;
+			}
+			i++;
 			continue;
 		}
+		syslog(LOG_INFO, "dropping stalled clipboard transfer to 0x%lx", i->requestor);
+		XSelectInput(m_display, i->requestor, NoEventMask);
+		i = m_transfers.erase(i);
+	}
+	return wait;
+}
 
-		/* only continue if xcout() is doing something */
-		if (context == XCLIB_XCOUT_NONE) {
-			break;
-		}
+Window ClipboardInterface::GetWindow() const
+{
+	return m_window;
+}
+
+/* sets the restore deadline msec from now */
+void ClipboardInterface::Arm(unsigned int msec)
+{
+	Deadline(m_restoreAt, msec);
+}
+
+/* sets at to msec from now */
+void ClipboardInterface::Deadline(struct timespec& at, unsigned int msec)
+{
+	clock_gettime(CLOCK_MONOTONIC, &at);
+	at.tv_sec += msec / 1000;
+	at.tv_nsec += (long)(msec % 1000) * 1000000L;
+	if (at.tv_nsec >= 1000000000L) {
+		at.tv_sec++;
+		at.tv_nsec -= 1000000000L;
+	}
+}
+
+/* selection ownership wants a real timestamp; a property change yields one */
+Time ClipboardInterface::ServerTime()
+{
+	XEvent evt;
+	XChangeProperty(m_display, m_window, m_timestamp, XA_STRING, 8, PropModeAppend, NULL, 0);
+	XWindowEvent(m_display, m_window, PropertyChangeMask, &evt);
+	while (evt.xproperty.atom != m_timestamp) {
+		XWindowEvent(m_display, m_window, PropertyChangeMask, &evt);
 	}
+	return evt.xproperty.time;
+}
+
+/* takes the events of the selection while it is ours, and of its transfers */
+bool ClipboardInterface::HandleEvent(const XEvent& evt)
+{
+	switch (evt.type) {
+		case SelectionRequest:
+			if (evt.xselectionrequest.owner != m_window) {
+				return false;
+			}
+			HandleRequest(evt.xselectionrequest);
+			return true;
+		case SelectionClear:
+			if (evt.xselectionclear.window != m_window) {
+				return false;
+			}
+			if (evt.xselectionclear.selection == m_clipboard) {
+				m_owned = false;
+				m_content.clear();
+				m_restorePending = false;
+			}
+			return true;
+		case PropertyNotify:
+			return evt.xproperty.state == PropertyDelete && ContinueTransfer(evt.xproperty);
+	}
+	return false;
+}
 
-	if (sel_len) {
-		/* sel_buf is current clipboard content; if different from cached
-		 * content, update the cache and set the updated flag to true. */
-		if (clipcache.compare(0, std::string::npos, (char *)sel_buf, sel_len) != 0) {
-			clipcache.assign((char *)sel_buf, (int)sel_len);
-			updated = true;
+void ClipboardInterface::HandleRequest(const XSelectionRequestEvent& req)
+{
+	XSelectionEvent reply;
+	memset(&reply, 0, sizeof(reply));
+	reply.type = SelectionNotify;
+	reply.display = req.display;
+	reply.requestor = req.requestor;
+	reply.selection = req.selection;
+	reply.target = req.target;
+	reply.time = req.time;
+	reply.property = None;
+
+	/* obsolete clients leave the property to us */
+	Atom property = req.property == None ? req.target : req.property;
+
+	bool current = req.time == CurrentTime || req.time >= m_ownTime;
+	if (m_owned && current && req.selection == m_clipboard) {
+		if (req.target == m_targets) {
+			Atom targets[] = { m_targets, m_utf8, XA_STRING, m_text };
+			XChangeProperty(m_display, req.requestor, property, XA_ATOM, 32, PropModeReplace,
+					(unsigned char *)targets, sizeof(targets) / sizeof(targets[0]));
+			reply.property = property;
 		}
+		else if (req.target == m_utf8 || req.target == XA_STRING || req.target == m_text) {
+			Atom type = req.target == XA_STRING ? XA_STRING : m_utf8;
+			if (m_content.size() > m_chunk) {
+				/* announce the size, then hand out a chunk per property deletion */
+				long size = (long)m_content.size();
+				XSelectInput(m_display, req.requestor, PropertyChangeMask);
+				XChangeProperty(m_display, req.requestor, property, m_incr, 32, PropModeReplace,
+						(unsigned char *)&size, 1);
 
-		if (sseln == XA_STRING)
-			XFree(sel_buf);
-		else
-			free(sel_buf);
-    }
+				Transfer transfer;
+				transfer.requestor = req.requestor;
+				transfer.property = property;
+				transfer.type = type;
+				transfer.data = m_content;
+				transfer.offset = 0;
+				Deadline(transfer.deadline, CLIPBOARD_TRANSFER_MSEC);
+				m_transfers.push_back(transfer);
+			} else {
+				XChangeProperty(m_display, req.requestor, property, type, 8, PropModeReplace,
+						(const unsigned char *)m_content.data(), (int)m_content.size());
+			}
+			reply.property = property;
 
-    return updated;
-}
+			/* the text has gone out (transfers keep their own copy) */
+			if (m_restorePending) {
+				Arm(CLIPBOARD_SETTLE_MSEC);
+			}
+		}
+	}
 
-/* return the cached clipboard content as a std::string */
-const std::string ClipboardInterface::GetString() {
-	return clipcache;
+	XSendEvent(m_display, req.requestor, False, 0, (XEvent *)&reply);
 }
 
-/* return the cached clipboard content as a null-terminated C string */
-const char *ClipboardInterface::GetCStr(void) {
-	return clipcache.c_str();
+/*
+ * The requestor has read the last chunk of an INCR transfer; send the next.
+ *
+ * Return Value:
+ *   false if the property belongs to no transfer of ours
+ */
+bool ClipboardInterface::ContinueTransfer(const XPropertyEvent& evt)
+{
+	for (std::list<Transfer>::iterator i = m_transfers.begin(); i != m_transfers.end(); i++) {
+		if (i->requestor != evt.window || i->property != evt.atom) {
+			continue;
+		}
+
+		size_t len = i->data.size() - i->offset;
+		if (len > m_chunk) {
+			len = m_chunk;
+		}
+		XChangeProperty(m_display, i->requestor, i->property, i->type, 8, PropModeReplace,
+				(const unsigned char *)i->data.data() + i->offset, (int)len);
+		i->offset += len;
+		Deadline(i->deadline, CLIPBOARD_TRANSFER_MSEC);
+
+		/* the zero-length chunk ends the transfer */
+		if (len == 0) {
+			XSelectInput(m_display, i->requestor, NoEventMask);
+			m_transfers.erase(i);
+		}
+		return true;
+	}
+	return false;
 }
@@ -21,22 +21,82 @@
 #define _CLIPBOARDINTERFACE_HPP_
 
 #include <X11/Xlib.h>
+#include <time.h>
 #include <string>
+#include <list>
 
-class ClipboardInterface
+#include "xservice.hpp"
+
+class ClipboardWatcher;
+
+/* fallback delay before the previous clipboard returns after a paste */
+#define CLIPBOARD_RESTORE_MSEC 2000
+
+/* delay after the pasted text was fetched before it is replaced */
+#define CLIPBOARD_SETTLE_MSEC 100
+
+/* an INCR transfer whose requestor stops reading is dropped after this */
+#define CLIPBOARD_TRANSFER_MSEC 5000
+
+/*
+ * Owns the CLIPBOARD selection for pasting; reading it is left to the
+ * ClipboardWatcher. Paste() puts text on the clipboard, answers the
+ * requests for it (INCR for payloads beyond the request size) and puts the
+ * previous contents back once the text has been fetched, if the watcher
+ * had them from the owner of the moment; otherwise the clipboard is let go
+ * rather than left holding stale text. Everything but
+ * Paste() and GetWindow() runs on the X thread.
+ */
+class ClipboardInterface : public XServiceClient
 {
 	public:
-		ClipboardInterface(const std::string display = "");
+		ClipboardInterface(XService& x);
 		~ClipboardInterface();
 
-		bool Update(void);
-		const std::string GetString(void);
-		const char *GetCStr(void);
+		bool Paste(const std::string& text, const ClipboardWatcher& watcher);
+		Window GetWindow() const;
+
+		bool HandleEvent(const XEvent& evt);
+		int Idle();
 
 	private:
+		struct Transfer {
+			Window requestor;
+			Atom property;
+			Atom type;
+			std::string data;
+			size_t offset;
+			struct timespec deadline;
+		};
+
+		void Setup();
+		bool Take(const std::string& text, const ClipboardWatcher& watcher);
+		bool Own(const std::string& text);
+		void Restore();
+		void Arm(unsigned int msec);
+		static void Deadline(struct timespec& at, unsigned int msec);
+		int ExpireTransfers();
+		Time ServerTime();
+
+		void HandleRequest(const XSelectionRequestEvent& req);
+		bool ContinueTransfer(const XPropertyEvent& evt);
+
+		XService& m_x;
 		Display *m_display;
 		Window m_window;
-		std::string clipcache;
+
+		Atom m_clipboard, m_targets, m_utf8, m_text, m_incr, m_timestamp;
+		size_t m_chunk;
+
+		/* selection served while owned; m_previous goes back after a paste */
+		bool m_owned;
+		Time m_ownTime;
+		std::string m_content;
+		bool m_restorePending;
+		bool m_hadPrevious;
+		std::string m_previous;
+		std::list<Transfer> m_transfers;
+		struct timespec m_restoreAt;
 };
 
 #endif
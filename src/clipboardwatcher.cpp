@@ -0,0 +1,409 @@
+/*
+   Mobile Mouse Linux Server 
+   Copyright (C) 2011 Erik Lax <erik@datahack.se>
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "clipboardwatcher.hpp"
+
+#include <X11/Xatom.h>
+#include <X11/Xmu/Atoms.h>
+#include <X11/extensions/Xfixes.h>
+#include <stdexcept>
+#include <string.h>
+#include <errno.h>
+#include <syslog.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+ClipboardText::ClipboardText()
+: size(0)
+, hash(CLIPBOARD_HASH_BASIS)
+, owner(None)
+, ownerTime(CurrentTime)
+{
+}
+
+/* the text in one piece, for the few that need it so */
+std::string ClipboardText::Join() const
+{
+	std::string text;
+	text.reserve(size);
+	for (std::vector<std::string>::const_iterator i = chunks.begin(); i != chunks.end(); i++) {
+		text.append(*i);
+	}
+	return text;
+}
+
+ClipboardWatcher::ClipboardWatcher(XService& x)
+: m_x(x)
+, m_display(x.GetDisplay())
+, m_text(std::make_shared<const ClipboardText>())
+, m_state(FS_IDLE)
+, m_target(None)
+, m_changed(true)
+, m_deadline()
+, m_owner(None)
+, m_ownerTime(CurrentTime)
+{
+	pthread_mutex_init(&m_mutex, NULL);
+	try {
+		m_x.Wait([this](Display*) { Setup(); });
+	}
+	catch (...) {
+		pthread_mutex_destroy(&m_mutex);
+		throw;
+	}
+	m_x.AddClient(this);
+}
+
+ClipboardWatcher::~ClipboardWatcher()
+{
+	m_x.RemoveClient(this);
+	m_x.Wait([this](Display*) { XDestroyWindow(m_display, m_window); });
+
+	for (std::set<int>::iterator i = m_subscribers.begin(); i != m_subscribers.end(); i++) {
+		close(*i);
+	}
+	pthread_mutex_destroy(&m_mutex);
+}
+
+void ClipboardWatcher::Setup()
+{
+	int error, major = 5, minor = 0;
+	if (!XFixesQueryExtension(m_display, &m_fixesEvent, &error)
+			|| !XFixesQueryVersion(m_display, &major, &minor)) {
+		throw std::runtime_error("XFixes extension not available");
+	}
+
+	/* the owner puts the selection into a property of this window; the
+	 * property changes pace INCR transfers */
+	m_window = XCreateSimpleWindow(m_display, DefaultRootWindow(m_display), 0, 0, 1, 1, 0, 0, 0);
+	XSelectInput(m_display, m_window, PropertyChangeMask);
+
+	m_clipboard = XA_CLIPBOARD(m_display);
+	m_utf8 = XInternAtom(m_display, "UTF8_STRING", False);
+	m_incr = XInternAtom(m_display, "INCR", False);
+	m_property = XInternAtom(m_display, "MMSERVER_CLIPBOARD", False);
+
+	XFixesSelectSelectionInput(m_display, DefaultRootWindow(m_display), m_clipboard,
+			XFixesSetSelectionOwnerNotifyMask);
+
+	/* its time is only known from the next announcement */
+	m_owner = XGetSelectionOwner(m_display, m_clipboard);
+}
+
+/*
+ * Return Value:
+ *   the clipboard as last fetched; shared, never modified once stored
+ */
+std::shared_ptr<const ClipboardText> ClipboardWatcher::Get() const
+{
+	pthread_mutex_lock(&m_mutex);
+	std::shared_ptr<const ClipboardText> text = m_text;
+	pthread_mutex_unlock(&m_mutex);
+	return text;
+}
+
+/*
+ * Only on the X thread, where announcements are handled.
+ *
+ * Return Value:
+ *   true if text was fetched from the selection as it is now owned, so far
+ *   as announced; false if the owner has changed since, or never answered
+ */
+bool ClipboardWatcher::Current(const ClipboardText& text) const
+{
+	return m_owner != None && text.owner == m_owner && text.ownerTime == m_ownerTime;
+}
+
+/*
+ * Return Value:
+ *   eventfd that becomes readable when the clipboard changes, or -1
+ */
+int ClipboardWatcher::Subscribe()
+{
+	int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (fd < 0) {
+		syslog(LOG_ERR, "eventfd: %s", strerror(errno));
+		return -1;
+	}
+	pthread_mutex_lock(&m_mutex);
+	m_subscribers.insert(fd);
+	pthread_mutex_unlock(&m_mutex);
+	return fd;
+}
+
+void ClipboardWatcher::Unsubscribe(int fd)
+{
+	pthread_mutex_lock(&m_mutex);
+	bool known = m_subscribers.erase(fd) > 0;
+	pthread_mutex_unlock(&m_mutex);
+	if (known) {
+		close(fd);
+	}
+}
+
+void ClipboardWatcher::Ignore(Window owner)
+{
+	pthread_mutex_lock(&m_mutex);
+	m_ignored.insert(owner);
+	pthread_mutex_unlock(&m_mutex);
+}
+
+void ClipboardWatcher::Unignore(Window owner)
+{
+	pthread_mutex_lock(&m_mutex);
+	m_ignored.erase(owner);
+	pthread_mutex_unlock(&m_mutex);
+}
+
+/*
+ * 64-bit FNV-1a; tells whether a client already has some text.
+ *
+ * Parameters:
+ *   text, the text or the next piece of it
+ *   hash, the hash of the pieces before
+ */
+uint64_t ClipboardWatcher::Hash(std::string_view text, uint64_t hash)
+{
+	for (std::string_view::iterator c = text.begin(); c != text.end(); c++) {
+		hash ^= (unsigned char)*c;
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+bool ClipboardWatcher::HandleEvent(const XEvent& evt)
+{
+	if (evt.type == m_fixesEvent + XFixesSelectionNotify) {
+		const XFixesSelectionNotifyEvent& notify = (const XFixesSelectionNotifyEvent&)evt;
+		if (notify.selection != m_clipboard) {
+			return false;
+		}
+		m_owner = notify.owner;
+		m_ownerTime = notify.selection_timestamp;
+		if (notify.owner != None && !Ignored(notify.owner)) {
+			m_changed = true;
+		}
+		return true;
+	}
+	if (evt.type == SelectionNotify && evt.xselection.requestor == m_window) {
+		if (m_state == FS_REQUESTED) {
+			Receive(evt.xselection);
+		}
+		return true;
+	}
+	if (evt.type == PropertyNotify && evt.xproperty.window == m_window) {
+		if (m_state == FS_INCR) {
+			Continue(evt.xproperty);
+		}
+		return true;
+	}
+	return false;
+}
+
+/*
+ * Starts fetching after a change of owner, and gives up on an owner that
+ * stops answering. A change seen during a fetch is fetched once that one
+ * is done.
+ */
+int ClipboardWatcher::Idle()
+{
+	if (m_changed && m_state == FS_IDLE) {
+		m_changed = false;
+		Request(m_utf8);
+		Arm();
+	}
+	if (m_state == FS_IDLE) {
+		return -1;
+	}
+
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	long msec = (m_deadline.tv_sec - now.tv_sec) * 1000 + (m_deadline.tv_nsec - now.tv_nsec) / 1000000;
+	if (msec > 0) {
+		return (int)msec;
+	}
+
+	/* keep the old text; a late answer is dropped as stale */
+	syslog(LOG_WARNING, "clipboard owner did not hand over its contents");
+	m_state = FS_IDLE;
+	m_fetched.reset();
+	XDeleteProperty(m_display, m_window, m_property);
+	return m_changed ? 0 : -1;
+}
+
+/* gives the owner CLIPBOARD_FETCH_MSEC from now for its next answer */
+void ClipboardWatcher::Arm()
+{
+	clock_gettime(CLOCK_MONOTONIC, &m_deadline);
+	m_deadline.tv_sec += CLIPBOARD_FETCH_MSEC / 1000;
+	m_deadline.tv_nsec += (long)(CLIPBOARD_FETCH_MSEC % 1000) * 1000000L;
+	if (m_deadline.tv_nsec >= 1000000000L) {
+		m_deadline.tv_sec++;
+		m_deadline.tv_nsec -= 1000000000L;
+	}
+}
+
+/* asks the owner to convert the selection into our property */
+void ClipboardWatcher::Request(Atom target)
+{
+	m_target = target;
+	m_fetched = std::make_shared<ClipboardText>();
+	m_fetched->owner = m_owner;
+	m_fetched->ownerTime = m_ownerTime;
+	XConvertSelection(m_display, m_clipboard, target, m_property, m_window, CurrentTime);
+	m_state = FS_REQUESTED;
+}
+
+void ClipboardWatcher::Receive(const XSelectionEvent& evt)
+{
+	if (evt.selection != m_clipboard) {
+		return;
+	}
+
+	if (evt.property == None) {
+		/* the owner has no UTF8_STRING; ask for STRING */
+		if (m_target == m_utf8) {
+			Request(XA_STRING);
+		} else {
+			m_state = FS_IDLE;
+			m_fetched.reset();
+		}
+		return;
+	}
+
+	Atom type;
+	int format;
+	unsigned long items, after;
+	unsigned char *data = NULL;
+	if (XGetWindowProperty(m_display, m_window, m_property, 0, 0, False, AnyPropertyType,
+			&type, &format, &items, &after, &data) != Success) {
+		m_state = FS_IDLE;
+		return;
+	}
+	if (data) {
+		XFree(data);
+	}
+
+	if (type == m_incr) {
+		/* deleting the announcement asks for the first chunk */
+		XDeleteProperty(m_display, m_window, m_property);
+		m_state = FS_INCR;
+		Arm();
+		return;
+	}
+
+	bool empty;
+	if (ReadChunk(empty)) {
+		Store();
+	}
+	m_state = FS_IDLE;
+}
+
+/* the owner has put the next INCR chunk in place */
+void ClipboardWatcher::Continue(const XPropertyEvent& evt)
+{
+	if (evt.atom != m_property || evt.state != PropertyNewValue) {
+		return;
+	}
+
+	/* a large selection may take long in all; only a stalled one is given up */
+	Arm();
+
+	bool empty;
+	if (!ReadChunk(empty)) {
+		/* not text; deleting it still asks for the next */
+		return;
+	}
+
+	/* the zero-length chunk ends the transfer */
+	if (empty) {
+		Store();
+		m_state = FS_IDLE;
+	}
+}
+
+/*
+ * Appends the property to the text being fetched and deletes it.
+ *
+ * Parameters:
+ *   empty, set if the property held no data
+ *
+ * Return Value:
+ *   false if the property did not hold text
+ */
+bool ClipboardWatcher::ReadChunk(bool& empty)
+{
+	Atom type;
+	int format;
+	unsigned long items, after;
+	unsigned char *data = NULL;
+	empty = true;
+
+	/* all of it at once; large selections arrive as INCR chunks anyway */
+	if (XGetWindowProperty(m_display, m_window, m_property, 0, 0x1fffffff, True, AnyPropertyType,
+			&type, &format, &items, &after, &data) != Success) {
+		return false;
+	}
+
+	bool text = format == 8;
+	if (text && items > 0 && m_fetched) {
+		std::string_view chunk((const char *)data, items);
+		m_fetched->chunks.push_back(std::string(chunk));
+		m_fetched->size += items;
+		m_fetched->hash = Hash(chunk, m_fetched->hash);
+		empty = false;
+	}
+	if (data) {
+		XFree(data);
+	}
+	return text;
+}
+
+/* publishes the fetched text; subscribers hear of it if it differs from
+ * what was cached */
+void ClipboardWatcher::Store()
+{
+	std::shared_ptr<const ClipboardText> fetched = m_fetched;
+	m_fetched.reset();
+	if (!fetched) {
+		return;
+	}
+
+	pthread_mutex_lock(&m_mutex);
+	bool changed = fetched->hash != m_text->hash;
+	m_text = fetched;
+	if (changed) {
+		uint64_t one = 1;
+		for (std::set<int>::iterator i = m_subscribers.begin(); i != m_subscribers.end(); i++) {
+			if (write(*i, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+				syslog(LOG_ERR, "clipboard notification: %s", strerror(errno));
+			}
+		}
+	}
+	pthread_mutex_unlock(&m_mutex);
+}
+
+bool ClipboardWatcher::Ignored(Window owner) const
+{
+	pthread_mutex_lock(&m_mutex);
+	bool ignored = m_ignored.count(owner) > 0;
+	pthread_mutex_unlock(&m_mutex);
+	return ignored;
+}
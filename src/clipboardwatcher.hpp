@@ -0,0 +1,124 @@
+/*
+   Mobile Mouse Linux Server 
+   Copyright (C) 2011 Erik Lax <erik@datahack.se>
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef _CLIPBOARDWATCHER_HPP_
+#define _CLIPBOARDWATCHER_HPP_
+
+#include <X11/Xlib.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <time.h>
+#include <memory>
+#include <set>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "xservice.hpp"
+
+/* time the selection owner gets to answer a request, or send its next INCR chunk */
+#define CLIPBOARD_FETCH_MSEC 2000
+
+/* FNV-1a offset basis, the hash of no text */
+#define CLIPBOARD_HASH_BASIS 14695981039346656037ULL
+
+/*
+ * Clipboard text as it arrived from the owner: one chunk, or one per INCR
+ * property for large selections, so that it is neither reallocated while
+ * it grows nor copied again to be sent.
+ */
+struct ClipboardText {
+	std::vector<std::string> chunks;
+	size_t size;
+	uint64_t hash;
+
+	/* the selection ownership it was fetched under */
+	Window owner;
+	Time ownerTime;
+
+	ClipboardText();
+	std::string Join() const;
+};
+
+/*
+ * Keeps a copy of the CLIPBOARD selection for all sessions. On the X
+ * thread, it is told of every change of owner through XFixes and fetches
+ * the new contents, so no session waits on a slow owner. Subscribers are
+ * handed an eventfd that becomes readable whenever the cached text
+ * changes. Owner windows passed to Ignore() (our own paste window) are not
+ * fetched from; their text came from a client in the first place.
+ */
+class ClipboardWatcher : public XServiceClient
+{
+	public:
+		ClipboardWatcher(XService& x);
+		~ClipboardWatcher();
+
+		std::shared_ptr<const ClipboardText> Get() const;
+		bool Current(const ClipboardText& text) const;
+
+		int Subscribe();
+		void Unsubscribe(int fd);
+
+		void Ignore(Window owner);
+		void Unignore(Window owner);
+
+		bool HandleEvent(const XEvent& evt);
+		int Idle();
+
+		static uint64_t Hash(std::string_view text, uint64_t hash = CLIPBOARD_HASH_BASIS);
+
+	private:
+		void Setup();
+		void Arm();
+		void Request(Atom target);
+		void Receive(const XSelectionEvent& evt);
+		void Continue(const XPropertyEvent& evt);
+		bool ReadChunk(bool& empty);
+		void Store();
+		bool Ignored(Window owner) const;
+
+		XService& m_x;
+		Display *m_display;
+		Window m_window;
+		Atom m_clipboard, m_utf8, m_incr, m_property;
+		int m_fixesEvent;
+
+		/* guarded by m_mutex */
+		mutable pthread_mutex_t m_mutex;
+		std::shared_ptr<const ClipboardText> m_text;
+		std::set<int> m_subscribers;
+		std::set<Window> m_ignored;
+
+		/* only touched by the X thread */
+		enum FetchState {
+			FS_IDLE,
+			FS_REQUESTED,
+			FS_INCR
+		};
+		FetchState m_state;
+		Atom m_target;
+		std::shared_ptr<ClipboardText> m_fetched;
+		bool m_changed;
+		struct timespec m_deadline;
+		Window m_owner;	/* as last announced, ignored windows too */
+		Time m_ownerTime;
+};
+
+#endif
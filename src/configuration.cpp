@@ -28,23 +28,58 @@ Configuration::Configuration()
 , m_debug(true)
 , m_port(9099)
 , m_zeroconf(true)
+, m_commandConcurrency(4)
+, m_commandTimeout(0)
+, m_latencyMode(false)
+, m_busyPoll(0)
+, m_dscp(-1)
+, m_socketPriority(-1)
+, m_peerTimeout(10)
+, m_handshakeTimeout(10)
+, m_resumeTimeout(60)
+, m_idleTimeout(0)
+, m_statsInterval(600)
 , m_mouseAccelerate(true)
+, m_mouseAccelerationProfile(AccelerationCurve::AP_STEP)
 , m_mouseAccelerationSpeed(0.0004)
-, m_mouseAccelerationFactor(4)
+, m_mouseAccelerationFactor(4.0)
 , m_mouseHorizontalScrolling(false)
 , m_mouseScrollMax(1)
+, m_mouseSmoothScrolling(true)
+, m_mouseCoalesce(true)
+, m_mouseBacklogLimit(0)
 , m_keyboardEnabled(true)
-, m_keyboardLayout("iso-8859-1")
+, m_keyboardBackend(KeyboardInterface::KB_XTEST)
+, m_keyboardTypingRate(0)
+, m_keyboardPasteThreshold(0)
 {
 	char hostname[256];
 	gethostname(hostname, 256);
 	m_hostname = hostname;
+
+	m_keyboardPasteKeys.push_back(XK_Control_L);
+	m_keyboardPasteKeys.push_back(XK_v);
+
+	BuildAccelerationCurve();
 }
 
 Configuration::~Configuration()
 {
 }
 
+// numeric settings may be written with or without a decimal point
+static double LookupNumber(const libconfig::Setting& setting)
+{
+	switch (setting.getType()) {
+		case libconfig::Setting::TypeInt:
+			return (double)(int)setting;
+		case libconfig::Setting::TypeInt64:
+			return (double)(long long)setting;
+		default:
+			return (double)setting;
+	}
+}
+
 void Configuration::Read(const std::string& file)
 {
 	libconfig::Config config;
@@ -60,6 +95,37 @@ void Configuration::Read(const std::string& file)
 		m_port = (short)(unsigned int)config.lookup("server.port");
 	}
 
+	if (config.exists("server.listen"))
+	{
+		libconfig::Setting& listen = config.lookup("server.listen");
+		std::vector<std::string> specs;
+		if (listen.isScalar())
+		{
+			specs.push_back((const char*)listen);
+		}
+		else if (listen.isArray())
+		{
+			for (int i = 0; i < listen.getLength(); i++)
+			{
+				specs.push_back((const char*)listen[i]);
+			}
+		}
+		else
+		{
+			syslog(LOG_ERR, "server.listen must be an array of strings or a single string");
+		}
+
+		for (std::vector<std::string>::iterator i = specs.begin(); i != specs.end(); i++)
+		{
+			ListenEndpoint endpoint;
+			if (ListenEndpoint::Parse(*i, endpoint)) {
+				m_listen.push_back(endpoint);
+			} else {
+				syslog(LOG_ERR, "server.listen: %s is not tcp, unix:PATH or abstract:NAME", i->c_str());
+			}
+		}
+	}
+
 	if (config.exists("server.zeroconf"))
 	{
 		m_zeroconf = (bool)config.lookup("server.zeroconf");
@@ -76,6 +142,109 @@ void Configuration::Read(const std::string& file)
 			syslog(LOG_ERR, "server.platform must be MAC or WIN");
 		}
 	}
+
+	if (config.exists("server.commandConcurrency"))
+	{
+		int concurrency = (int)config.lookup("server.commandConcurrency");
+		if (concurrency < 1) {
+			syslog(LOG_ERR, "server.commandConcurrency must be at least 1");
+			concurrency = 1;
+		}
+		m_commandConcurrency = (unsigned int)concurrency;
+	}
+
+	if (config.exists("server.commandTimeout"))
+	{
+		int timeout = (int)config.lookup("server.commandTimeout");
+		if (timeout < 0) {
+			syslog(LOG_ERR, "server.commandTimeout must not be negative");
+			timeout = 0;
+		}
+		m_commandTimeout = (unsigned int)timeout;
+	}
+
+	if (config.exists("server.latencyMode"))
+	{
+		m_latencyMode = (bool)config.lookup("server.latencyMode");
+	}
+
+	if (config.exists("server.busyPoll"))
+	{
+		int busyPoll = (int)config.lookup("server.busyPoll");
+		if (busyPoll < 0) {
+			syslog(LOG_ERR, "server.busyPoll must not be negative");
+			busyPoll = 0;
+		}
+		m_busyPoll = (unsigned int)busyPoll;
+	}
+
+	if (config.exists("server.dscp"))
+	{
+		m_dscp = (int)config.lookup("server.dscp");
+		if (m_dscp > 63) {
+			syslog(LOG_ERR, "server.dscp must be between 0 and 63");
+			m_dscp = -1;
+		}
+	}
+
+	if (config.exists("server.priority"))
+	{
+		m_socketPriority = (int)config.lookup("server.priority");
+		if (m_socketPriority > 7) {
+			syslog(LOG_ERR, "server.priority must be between 0 and 7");
+			m_socketPriority = -1;
+		}
+	}
+
+	if (config.exists("server.peerTimeout"))
+	{
+		int timeout = (int)config.lookup("server.peerTimeout");
+		if (timeout < 0) {
+			syslog(LOG_ERR, "server.peerTimeout must not be negative");
+			timeout = 0;
+		}
+		m_peerTimeout = (unsigned int)timeout;
+	}
+
+	if (config.exists("server.handshakeTimeout"))
+	{
+		int timeout = (int)config.lookup("server.handshakeTimeout");
+		if (timeout < 0) {
+			syslog(LOG_ERR, "server.handshakeTimeout must not be negative");
+			timeout = 0;
+		}
+		m_handshakeTimeout = (unsigned int)timeout;
+	}
+
+	if (config.exists("server.resumeTimeout"))
+	{
+		int timeout = (int)config.lookup("server.resumeTimeout");
+		if (timeout < 0) {
+			syslog(LOG_ERR, "server.resumeTimeout must not be negative");
+			timeout = 0;
+		}
+		m_resumeTimeout = (unsigned int)timeout;
+	}
+
+	if (config.exists("server.idleTimeout"))
+	{
+		int timeout = (int)config.lookup("server.idleTimeout");
+		if (timeout < 0) {
+			syslog(LOG_ERR, "server.idleTimeout must not be negative");
+			timeout = 0;
+		}
+		m_idleTimeout = (unsigned int)timeout;
+	}
+
+	if (config.exists("server.statsInterval"))
+	{
+		int interval = (int)config.lookup("server.statsInterval");
+		if (interval < 0) {
+			syslog(LOG_ERR, "server.statsInterval must not be negative");
+			interval = 0;
+		}
+		m_statsInterval = (unsigned int)interval;
+	}
 	
 	if (config.exists("device.id"))
 	{
@@ -107,14 +276,40 @@ void Configuration::Read(const std::string& file)
 		m_mouseAccelerate = (bool)config.lookup("mouse.accelerate");
 	}
 
+	if (config.exists("mouse.accelerationProfile"))
+	{
+		std::string profile = (const char*)config.lookup("mouse.accelerationProfile");
+		if (!AccelerationCurve::ParseProfile(profile, m_mouseAccelerationProfile)) {
+			syslog(LOG_ERR, "mouse.accelerationProfile must be flat, step, linear, adaptive or custom");
+		}
+	}
+
 	if (config.exists("mouse.accelerationSpeed"))
 	{
-		m_mouseAccelerationSpeed = (double)config.lookup("mouse.accelerationSpeed");
+		m_mouseAccelerationSpeed = LookupNumber(config.lookup("mouse.accelerationSpeed"));
 	}
 
 	if (config.exists("mouse.accelerationFactor"))
 	{
-		m_mouseAccelerationFactor = (int)config.lookup("mouse.accelerationFactor");
+		m_mouseAccelerationFactor = LookupNumber(config.lookup("mouse.accelerationFactor"));
+	}
+
+	if (config.exists("mouse.accelerationCurve"))
+	{
+		libconfig::Setting& curve = config.lookup("mouse.accelerationCurve");
+		m_mouseAccelerationPoints.clear();
+		for (int i = 0; curve.isList() && i < curve.getLength(); i++)
+		{
+			if (!curve[i].isArray() || curve[i].getLength() != 2) {
+				syslog(LOG_ERR, "mouse.accelerationCurve entries must be [speed, factor] pairs");
+				continue;
+			}
+			m_mouseAccelerationPoints.push_back(std::make_pair(
+					LookupNumber(curve[i][0]), LookupNumber(curve[i][1])));
+		}
+		if (m_mouseAccelerationPoints.empty()) {
+			syslog(LOG_ERR, "mouse.accelerationCurve must be a list of [speed, factor] pairs");
+		}
 	}
 
 	if (config.exists("mouse.horizontalScrolling"))
@@ -131,14 +326,89 @@ void Configuration::Read(const std::string& file)
 		}
 	}
 
+	if (config.exists("mouse.scrollPrecision"))
+	{
+		std::string precision = (const char*)config.lookup("mouse.scrollPrecision");
+		if (precision == "smooth") {
+			m_mouseSmoothScrolling = true;
+		} else if (precision == "detent") {
+			m_mouseSmoothScrolling = false;
+		} else {
+			syslog(LOG_ERR, "mouse.scrollPrecision must be smooth or detent");
+		}
+	}
+
+	if (config.exists("mouse.coalesce"))
+	{
+		m_mouseCoalesce = (bool)config.lookup("mouse.coalesce");
+	}
+
+	if (config.exists("mouse.backlogLimit"))
+	{
+		m_mouseBacklogLimit = (int)config.lookup("mouse.backlogLimit");
+		if (m_mouseBacklogLimit < 0) {
+			syslog(LOG_ERR, "mouse.backlogLimit must not be negative");
+			m_mouseBacklogLimit = 0;
+		}
+	}
+
 	if (config.exists("keyboard.enabled")) 
 	{
 		m_keyboardEnabled = (bool)config.lookup("keyboard.enabled");
 	}
-	
-	if (config.exists("keyboard.layout"))
+
+	if (config.exists("keyboard.backend"))
 	{
-		m_keyboardLayout = (const char*)config.lookup("keyboard.layout");
+		std::string backend = (const char*)config.lookup("keyboard.backend");
+		if (!KeyboardInterface::ParseBackend(backend, m_keyboardBackend)) {
+			syslog(LOG_ERR, "keyboard.backend must be xtest or uinput");
+		}
+	}
+
+	if (config.exists("keyboard.xkbLayout"))
+	{
+		m_keyboardXkbLayout = (const char*)config.lookup("keyboard.xkbLayout");
+	}
+
+	if (config.exists("keyboard.xkbVariant"))
+	{
+		m_keyboardXkbVariant = (const char*)config.lookup("keyboard.xkbVariant");
+	}
+
+	if (config.exists("keyboard.typingRate"))
+	{
+		int rate = (int)config.lookup("keyboard.typingRate");
+		if (rate < 0) {
+			syslog(LOG_ERR, "keyboard.typingRate must not be negative");
+			rate = 0;
+		}
+		m_keyboardTypingRate = (unsigned int)rate;
+	}
+
+	if (config.exists("keyboard.pasteThreshold"))
+	{
+		int threshold = (int)config.lookup("keyboard.pasteThreshold");
+		if (threshold < 0) {
+			syslog(LOG_ERR, "keyboard.pasteThreshold must not be negative");
+			threshold = 0;
+		}
+		m_keyboardPasteThreshold = (unsigned int)threshold;
+	}
+
+	if (config.exists("keyboard.pasteKeys"))
+	{
+		std::string keys = (const char*)config.lookup("keyboard.pasteKeys");
+		if (keys == "ctrl+v") {
+			m_keyboardPasteKeys.clear();
+			m_keyboardPasteKeys.push_back(XK_Control_L);
+			m_keyboardPasteKeys.push_back(XK_v);
+		} else if (keys == "shift+insert") {
+			m_keyboardPasteKeys.clear();
+			m_keyboardPasteKeys.push_back(XK_Shift_L);
+			m_keyboardPasteKeys.push_back(XK_Insert);
+		} else {
+			syslog(LOG_ERR, "keyboard.pasteKeys must be ctrl+v or shift+insert");
+		}
 	}
 
 	if (config.exists("keyboard.hotkeys.key1.name") && config.exists("keyboard.hotkeys.key1.command"))
@@ -201,6 +471,25 @@ void Configuration::Read(const std::string& file)
 	GESTURE_HOTKEY_CONFIG("gestures.fourfingerswipedown", 15);
 #undef GESTURE_HOTKEY_CONFIG
 
+	/* split commands into argv now rather than on every invocation */
+	m_commands.clear();
+	for (std::map<unsigned int, std::pair<std::string, std::string> >::const_iterator i = m_hotkeys.begin();
+			i != m_hotkeys.end(); i++) {
+		m_commands[i->first].Parse(i->second.second);
+	}
+
+	BuildAccelerationCurve();
+}
+
+/* precompute the acceleration table once per configuration load */
+void Configuration::BuildAccelerationCurve()
+{
+	// accelerationSpeed is given in pixels per microsecond; the curve works in milliseconds
+	m_mouseAccelerationCurve.Build(
+			m_mouseAccelerate ? m_mouseAccelerationProfile : AccelerationCurve::AP_FLAT,
+			m_mouseAccelerationSpeed * 1000.0,
+			m_mouseAccelerationFactor,
+			m_mouseAccelerationPoints);
 }
 
 const std::string& Configuration::getHostname() const
@@ -223,34 +512,96 @@ unsigned short Configuration::getPort() const
 	return m_port;
 }
 
+/* where to accept clients; TCP on server.port unless configured otherwise */
+std::vector<ListenEndpoint> Configuration::getListen() const
+{
+	if (m_listen.empty()) {
+		return std::vector<ListenEndpoint>(1, ListenEndpoint());
+	}
+	return m_listen;
+}
+
 bool Configuration::getZeroconf() const
 {
 	return m_zeroconf;
 }
 
-const std::set<std::string>& Configuration::getDevices() const
+unsigned int Configuration::getCommandConcurrency() const
 {
-	return m_devices;
+	return m_commandConcurrency;
 }
 
-const std::string& Configuration::getPassword() const
+unsigned int Configuration::getCommandTimeout() const
 {
-	return m_password;
+	return m_commandTimeout;
+}
+
+bool Configuration::getLatencyMode() const
+{
+	return m_latencyMode;
+}
+
+/* microseconds to busy-poll the device queue on a blocking read; 0 for off */
+unsigned int Configuration::getBusyPoll() const
+{
+	return m_busyPoll;
+}
+
+/* -1 leaves the DSCP field alone */
+int Configuration::getDscp() const
+{
+	return m_dscp;
+}
+
+/* -1 leaves the socket priority alone */
+int Configuration::getSocketPriority() const
+{
+	return m_socketPriority;
+}
+
+/* seconds a silent or unreachable client is kept; 0 for the kernel's defaults */
+unsigned int Configuration::getPeerTimeout() const
+{
+	return m_peerTimeout;
+}
+
+/* seconds a client has to send CONNECT; 0 for no limit */
+unsigned int Configuration::getHandshakeTimeout() const
+{
+	return m_handshakeTimeout;
+}
+
+/* seconds a device's session state is kept for it to reconnect; 0 for none */
+unsigned int Configuration::getResumeTimeout() const
+{
+	return m_resumeTimeout;
 }
 
-bool Configuration::getMouseAcceleration() const
+/* seconds without clients after which the server exits; 0 to keep running */
+unsigned int Configuration::getIdleTimeout() const
 {
-	return m_mouseAccelerate;
+	return m_idleTimeout;
 }
 
-double Configuration::getMouseAccelerationSpeed() const
+/* seconds between logs of the pipeline stage statistics; 0 to not log them */
+unsigned int Configuration::getStatsInterval() const
 {
-	return m_mouseAccelerationSpeed;
+	return m_statsInterval;
 }
 
-int Configuration::getMouseAccelerationFactor() const
+const std::set<std::string>& Configuration::getDevices() const
 {
-	return m_mouseAccelerationFactor;
+	return m_devices;
+}
+
+const std::string& Configuration::getPassword() const
+{
+	return m_password;
+}
+
+const AccelerationCurve& Configuration::getMouseAccelerationCurve() const
+{
+	return m_mouseAccelerationCurve;
 }
 
 bool Configuration::getMouseHorizontalScrolling() const
@@ -263,14 +614,54 @@ int Configuration::getMouseScrollMax() const
 	return m_mouseScrollMax;
 }
 
+bool Configuration::getMouseSmoothScrolling() const
+{
+	return m_mouseSmoothScrolling;
+}
+
+bool Configuration::getMouseCoalesce() const
+{
+	return m_mouseCoalesce;
+}
+
+int Configuration::getMouseBacklogLimit() const
+{
+	return m_mouseBacklogLimit;
+}
+
 bool Configuration::getKeyboardEnabled() const
 {
 	return m_keyboardEnabled;
 }
 
-const std::string& Configuration::getKeyboardLayout() const
+KeyboardInterface::Backend Configuration::getKeyboardBackend() const
+{
+	return m_keyboardBackend;
+}
+
+const std::string& Configuration::getKeyboardXkbLayout() const
+{
+	return m_keyboardXkbLayout;
+}
+
+const std::string& Configuration::getKeyboardXkbVariant() const
+{
+	return m_keyboardXkbVariant;
+}
+
+unsigned int Configuration::getKeyboardTypingRate() const
+{
+	return m_keyboardTypingRate;
+}
+
+unsigned int Configuration::getKeyboardPasteThreshold() const
 {
-	return m_keyboardLayout;
+	return m_keyboardPasteThreshold;
+}
+
+const std::list<int>& Configuration::getKeyboardPasteKeys() const
+{
+	return m_keyboardPasteKeys;
 }
 
 const std::string Configuration::getHotKeyName(unsigned int id) const
@@ -290,3 +681,13 @@ const std::string Configuration::getHotKeyCommand(unsigned int id) const
 		return "";
 	return i->second.second;
 }
+
+const CommandLine& Configuration::getHotKeyCommandLine(unsigned int id) const
+{
+	static const CommandLine none;
+	std::map<unsigned int, CommandLine>::const_iterator i;
+	i = m_commands.find(id);
+	if (i == m_commands.end())
+		return none;
+	return i->second;
+}
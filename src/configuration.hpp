@@ -23,8 +23,15 @@
 #include <set>
 #include <map>
 #include <string>
+#include <list>
+#include <vector>
 #include <unistd.h>
 
+#include "acceleration.hpp"
+#include "keyboardinterface.hpp"
+#include "executor.hpp"
+#include "listener.hpp"
+
 class Configuration
 {
 	public:
@@ -37,38 +44,83 @@ class Configuration
 		const std::string& getPlatform() const;
 		bool getDebug() const;
 		unsigned short getPort() const;
+		std::vector<ListenEndpoint> getListen() const;
 		bool getZeroconf() const;
+		unsigned int getCommandConcurrency() const;
+		unsigned int getCommandTimeout() const;
+		bool getLatencyMode() const;
+		unsigned int getBusyPoll() const;
+		int getDscp() const;
+		int getSocketPriority() const;
+		unsigned int getPeerTimeout() const;
+		unsigned int getHandshakeTimeout() const;
+		unsigned int getResumeTimeout() const;
+		unsigned int getIdleTimeout() const;
+		unsigned int getStatsInterval() const;
 		const std::set<std::string>& getDevices() const;
 		const std::string& getPassword() const;
-		bool getMouseAcceleration() const;
-		double getMouseAccelerationSpeed() const;
-		int getMouseAccelerationFactor() const;
+		const AccelerationCurve& getMouseAccelerationCurve() const;
 		bool getMouseHorizontalScrolling() const;
 		int getMouseScrollMax() const;
+		bool getMouseSmoothScrolling() const;
+		bool getMouseCoalesce() const;
+		int getMouseBacklogLimit() const;
 		bool getKeyboardEnabled() const;
-		const std::string& getKeyboardLayout() const;
+		KeyboardInterface::Backend getKeyboardBackend() const;
+		const std::string& getKeyboardXkbLayout() const;
+		const std::string& getKeyboardXkbVariant() const;
+		unsigned int getKeyboardTypingRate() const;
+		unsigned int getKeyboardPasteThreshold() const;
+		const std::list<int>& getKeyboardPasteKeys() const;
 
 		const std::string getHotKeyName(unsigned int id) const;
 		const std::string getHotKeyCommand(unsigned int id) const;
+		const CommandLine& getHotKeyCommandLine(unsigned int id) const;
 	private:
+		void BuildAccelerationCurve();
+
 		std::string m_hostname;
 		std::string m_platform;
 		bool m_debug;
 		unsigned short m_port;
+		std::vector<ListenEndpoint> m_listen;	/* empty for TCP only */
 		bool m_zeroconf;
+		unsigned int m_commandConcurrency;
+		unsigned int m_commandTimeout;
+		bool m_latencyMode;
+		unsigned int m_busyPoll;
+		int m_dscp;
+		int m_socketPriority;
+		unsigned int m_peerTimeout;
+		unsigned int m_handshakeTimeout;
+		unsigned int m_resumeTimeout;
+		unsigned int m_idleTimeout;
+		unsigned int m_statsInterval;
 		
 		std::set<std::string> m_devices;
 		std::string m_password;
 
 		bool m_mouseAccelerate;
+		AccelerationCurve::Profile m_mouseAccelerationProfile;
 		double m_mouseAccelerationSpeed;
-		int m_mouseAccelerationFactor;
+		double m_mouseAccelerationFactor;
+		AccelerationCurve::Points m_mouseAccelerationPoints;
+		AccelerationCurve m_mouseAccelerationCurve;
 		bool m_mouseHorizontalScrolling;
 		int m_mouseScrollMax;
+		bool m_mouseSmoothScrolling;
+		bool m_mouseCoalesce;
+		int m_mouseBacklogLimit;
 		bool m_keyboardEnabled;
-		std::string m_keyboardLayout;
+		KeyboardInterface::Backend m_keyboardBackend;
+		std::string m_keyboardXkbLayout;
+		std::string m_keyboardXkbVariant;
+		unsigned int m_keyboardTypingRate;
+		unsigned int m_keyboardPasteThreshold;
+		std::list<int> m_keyboardPasteKeys;
 
 		std::map<unsigned int, std::pair<std::string, std::string> > m_hotkeys;
+		std::map<unsigned int, CommandLine> m_commands;
 };
 
 #endif
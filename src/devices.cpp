@@ -0,0 +1,186 @@
+/*
+   Mobile Mouse Linux Server 
+   Copyright (C) 2011 Erik Lax <erik@datahack.se>
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "devices.hpp"
+
+#include <sys/eventfd.h>
+#include <assert.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <stdexcept>
+#include <syslog.h>
+
+/* opens the devices in the background; see Wait() */
+DeviceManager::DeviceManager(const Configuration& appConfig)
+: m_appConfig(appConfig)
+, m_ready(false)
+, m_leases(0)
+{
+	if ((m_readyEvent = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0) {
+		throw std::runtime_error("cannot create device startup event");
+	}
+	m_started = std::async(std::launch::async, [this]() {
+		try {
+			Start();
+		}
+		catch (const std::runtime_error&) {
+			Started();
+			throw;
+		}
+		Started();
+	}).share();
+}
+
+DeviceManager::~DeviceManager()
+{
+	try {
+		Wait();
+		Reset();
+	}
+	catch (const std::runtime_error&) {
+		/* nothing was opened */
+	}
+	close(m_readyEvent);
+}
+
+/* service times and queue depths of the input and X stages since the last call */
+void DeviceManager::LogStats()
+{
+	/* nothing to tell while the devices are still being opened */
+	if (!Ready()) {
+		return;
+	}
+	try {
+		Wait();
+	}
+	catch (const std::runtime_error&) {
+		return;
+	}
+
+	m_injector->GetStats().Log("inject");
+	m_x->GetStats().Log("X");
+}
+
+/* runs on the startup thread, beside whatever the server does meanwhile */
+void DeviceManager::Start()
+{
+	try {
+		m_x.reset(new XService());
+		m_injector.reset(new InputInjector());
+		m_mouse.reset(new MouseInterface(*m_injector));
+		m_keyboard.reset(KeyboardInterface::Create(m_appConfig, *m_x, *m_injector));
+		m_clipboard.reset(new ClipboardInterface(*m_x));
+		m_watcher.reset(new ClipboardWatcher(*m_x));
+	}
+	catch (const std::runtime_error &err) {
+		syslog(LOG_ERR, "devices: %s", err.what());
+		throw;
+	}
+
+	/* pastes come from clients; they are not news to them */
+	m_watcher->Ignore(m_clipboard->GetWindow());
+}
+
+/* tells the reactor that Wait() no longer blocks */
+void DeviceManager::Started()
+{
+	uint64_t one = 1;
+	m_ready = true;
+	if (write(m_readyEvent, &one, sizeof(one)) < 0) {
+		syslog(LOG_ERR, "devices: cannot signal startup");
+	}
+}
+
+/* whether startup has finished, opened or not; never blocks */
+bool DeviceManager::Ready() const
+{
+	return m_ready;
+}
+
+/* readable once Ready() */
+int DeviceManager::GetReadyEvent() const
+{
+	return m_readyEvent;
+}
+
+/* returns once the devices are open; throws std::runtime_error if they cannot be */
+void DeviceManager::Wait()
+{
+	m_started.get();
+}
+
+void DeviceManager::Acquire()
+{
+	assert(Ready() && m_mouse);
+	m_leases++;
+}
+
+/* other sessions keep what they hold (and the keycodes they type with);
+ * only the last one out lets go */
+void DeviceManager::Release()
+{
+	m_leases--;
+	if (m_leases == 0) {
+		Reset();
+		m_keyboard->ReturnKeys();
+	}
+}
+
+/* lets go of held buttons and keys */
+void DeviceManager::Reset()
+{
+	m_mouse->ReleaseAll();
+	m_keyboard->ReleaseAll();
+}
+
+/* the getters and leases are for after Wait() has returned; they do not wait */
+MouseInterface& DeviceManager::GetMouse()
+{
+	assert(Ready() && m_mouse);
+	return *m_mouse;
+}
+
+KeyboardInterface& DeviceManager::GetKeyboard()
+{
+	assert(Ready() && m_keyboard);
+	return *m_keyboard;
+}
+
+ClipboardInterface& DeviceManager::GetClipboard()
+{
+	assert(Ready() && m_clipboard);
+	return *m_clipboard;
+}
+
+ClipboardWatcher& DeviceManager::GetWatcher()
+{
+	assert(Ready() && m_watcher);
+	return *m_watcher;
+}
+
+DeviceLease::DeviceLease(DeviceManager& manager)
+: m_manager(manager)
+{
+	m_manager.Acquire();
+}
+
+DeviceLease::~DeviceLease()
+{
+	m_manager.Release();
+}
@@ -0,0 +1,104 @@
+/*
+   Mobile Mouse Linux Server 
+   Copyright (C) 2011 Erik Lax <erik@datahack.se>
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef _DEVICES_HPP_
+#define _DEVICES_HPP_
+
+#include <atomic>
+#include <future>
+#include <memory>
+
+#include "configuration.hpp"
+#include "xservice.hpp"
+#include "injector.hpp"
+#include "mouseinterface.hpp"
+#include "keyboardinterface.hpp"
+#include "clipboardinterface.hpp"
+#include "clipboardwatcher.hpp"
+
+/*
+ * The uinput devices and X connections, created once at startup and kept
+ * for the life of the server. A new uinput device has to be discovered
+ * and configured by udev, libinput and the compositor before its events
+ * count, so sessions share these instead of creating their own. A
+ * session that has logged in holds a DeviceLease; held buttons and keys
+ * are let go when the last lease ends, or when Reset() is called as a
+ * device takes over from its own earlier session. All X traffic goes through the one connection
+ * of the XService, and all uinput writes through the InputInjector.
+ * They are opened on a thread of their own, so that the server can take
+ * its first connection meanwhile; GetReadyEvent() becomes readable once
+ * that has finished. Only Wait() blocks for them: the getters and
+ * leases are for after it has returned, and assert as much.
+ */
+class DeviceManager
+{
+	public:
+		DeviceManager(const Configuration& appConfig);
+		~DeviceManager();
+
+		bool Ready() const;
+		int GetReadyEvent() const;
+		void Wait();
+		void Reset();
+		void LogStats();
+
+		MouseInterface& GetMouse();
+		KeyboardInterface& GetKeyboard();
+		ClipboardInterface& GetClipboard();
+		ClipboardWatcher& GetWatcher();
+
+	private:
+		friend class DeviceLease;
+
+		void Start();
+		void Started();
+		void Acquire();
+		void Release();
+
+		const Configuration& m_appConfig;
+
+		/* set by Start(); only used once m_started is ready */
+		std::unique_ptr<XService> m_x;
+		std::unique_ptr<InputInjector> m_injector;
+		std::unique_ptr<MouseInterface> m_mouse;
+		std::unique_ptr<KeyboardInterface> m_keyboard;
+		std::unique_ptr<ClipboardInterface> m_clipboard;
+		std::unique_ptr<ClipboardWatcher> m_watcher;
+
+		std::shared_future<void> m_started;
+		std::atomic<bool> m_ready;	/* Start() has returned or thrown */
+		int m_readyEvent;	/* eventfd, written when m_ready is set */
+		unsigned int m_leases;
+};
+
+/* a logged-in session's use of the shared devices */
+class DeviceLease
+{
+	public:
+		DeviceLease(DeviceManager& manager);
+		~DeviceLease();
+
+	private:
+		DeviceLease(const DeviceLease&);
+		DeviceLease& operator=(const DeviceLease&);
+
+		DeviceManager& m_manager;
+};
+
+#endif
@@ -0,0 +1,112 @@
+/*
+   Mobile Mouse Linux Server 
+   Copyright (C) 2011 Erik Lax <erik@datahack.se>
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "eventbatch.hpp"
+#include "injector.hpp"
+
+#include <string.h>
+#include <unistd.h>
+
+InputEventBatch::InputEventBatch()
+: m_fd(-1)
+, m_injector(NULL)
+, m_count(0)
+, m_frame(0)
+{
+	memset(m_events, 0, sizeof m_events);
+}
+
+/*
+ * Parameters:
+ *   fd, uinput device
+ *   injector, stage that writes for us (NULL to write directly)
+ */
+void InputEventBatch::SetDevice(int fd, InputInjector* injector)
+{
+	m_fd = fd;
+	m_injector = injector;
+}
+
+void InputEventBatch::Add(unsigned short type, unsigned short code, int value)
+{
+	/* fold repeated relative motion into the open frame */
+	if (type == EV_REL) {
+		for (size_t i = m_frame; i < m_count; i++) {
+			if (m_events[i].type == EV_REL && m_events[i].code == code) {
+				m_events[i].value += value;
+				return;
+			}
+		}
+	}
+
+	/* keep room for the SYN_REPORT that closes this frame */
+	if (m_count + 2 > EVENTBATCH_MAX_EVENTS) {
+		Flush();
+	}
+
+	struct input_event& ev = m_events[m_count++];
+	ev.type = type;
+	ev.code = code;
+	ev.value = value;
+}
+
+/* close the open frame, if it has any events */
+void InputEventBatch::Sync()
+{
+	if (m_count == m_frame) {
+		return;
+	}
+
+	struct input_event& ev = m_events[m_count++];
+	ev.type = EV_SYN;
+	ev.code = SYN_REPORT;
+	ev.value = 0;
+	m_frame = m_count;
+}
+
+/*
+ * Return Value:
+ *   true if all pending events were written or queued (or there were none)
+ *   false if the write failed; pending events are discarded either way
+ */
+bool InputEventBatch::Flush()
+{
+	Sync();
+	if (m_count == 0) {
+		return true;
+	}
+
+	if (m_injector != NULL) {
+		m_injector->Submit(m_fd, m_events, m_count);
+		m_count = m_frame = 0;
+		return true;
+	}
+
+	/* uinput takes any number of whole events per write; the kernel stamps them */
+	size_t len = m_count * sizeof(struct input_event);
+	ssize_t n = write(m_fd, m_events, len);
+
+	m_count = m_frame = 0;
+	return n == (ssize_t)len;
+}
+
+bool InputEventBatch::Empty() const
+{
+	return m_count == 0;
+}
@@ -0,0 +1,58 @@
+/*
+   Mobile Mouse Linux Server 
+   Copyright (C) 2011 Erik Lax <erik@datahack.se>
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef _EVENTBATCH_HPP_
+#define _EVENTBATCH_HPP_
+
+#include <stddef.h>
+#include <linux/input.h>
+
+#define EVENTBATCH_MAX_EVENTS 64
+
+class InputInjector;
+
+/*
+ * Collects input_events for a uinput device and commits them with a single
+ * write(). Events between two Sync() calls form one frame, which is closed
+ * by exactly one SYN_REPORT; relative axes are summed within a frame rather
+ * than repeated. Given an InputInjector, Flush() hands the batch to its
+ * thread instead of writing it here.
+ */
+class InputEventBatch
+{
+	public:
+		InputEventBatch();
+
+		void SetDevice(int fd, InputInjector* injector = NULL);
+
+		void Add(unsigned short type, unsigned short code, int value);
+		void Sync();
+		bool Flush();
+
+		bool Empty() const;
+
+	private:
+		int m_fd;
+		InputInjector* m_injector;
+		struct input_event m_events[EVENTBATCH_MAX_EVENTS];
+		size_t m_count;
+		size_t m_frame;
+};
+
+#endif
@@ -0,0 +1,315 @@
+/*
+   Mobile Mouse Linux Server 
+   Copyright (C) 2011 Erik Lax <erik@datahack.se>
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "executor.hpp"
+
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdint.h>
+#include <string.h>
+#include <syslog.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <stdexcept>
+
+extern char **environ;
+
+/* characters that only the shell can make sense of */
+static const char SHELL_SYNTAX[] = "|&;<>()$`\\\"'*?[]#~{}!\n";
+
+CommandLine::CommandLine()
+: detached(false)
+{
+}
+
+/*
+ * Parameters:
+ *   text, command as configured
+ */
+void CommandLine::Parse(const std::string& text)
+{
+	line = text;
+	argv.clear();
+	detached = false;
+
+	/* commands are asynchronous now; a trailing '&' only says not to wait */
+	size_t end = line.find_last_not_of(" \t");
+	if (end != std::string::npos && line[end] == '&' && (end == 0 || line[end - 1] != '&')) {
+		detached = true;
+		line.erase(end);
+	}
+
+	if (line.find_first_of(SHELL_SYNTAX) != std::string::npos) {
+		return;
+	}
+
+	size_t pos = 0;
+	while ((pos = line.find_first_not_of(" \t", pos)) != std::string::npos) {
+		size_t stop = line.find_first_of(" \t", pos);
+		argv.push_back(line.substr(pos, stop - pos));
+		pos = stop;
+	}
+
+	/* leading variable assignments are shell syntax as well */
+	if (!argv.empty() && argv[0].find('=') != std::string::npos) {
+		argv.clear();
+	}
+}
+
+CommandExecutor::CommandExecutor(unsigned int concurrency, unsigned int timeout)
+: m_concurrency(concurrency > 0 ? concurrency : 1)
+, m_timeout(timeout)
+, m_stop(false)
+, m_running(0)
+{
+	if ((m_wake = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0) {
+		throw std::runtime_error("cannot create command executor event");
+	}
+	pthread_mutex_init(&m_mutex, NULL);
+	if (pthread_create(&m_thread, NULL, Thread, this) != 0) {
+		pthread_mutex_destroy(&m_mutex);
+		close(m_wake);
+		throw std::runtime_error("cannot start command executor");
+	}
+}
+
+/* running commands are left alone; only the queue is dropped */
+CommandExecutor::~CommandExecutor()
+{
+	pthread_mutex_lock(&m_mutex);
+	m_stop = true;
+	pthread_mutex_unlock(&m_mutex);
+
+	uint64_t one = 1;
+	if (write(m_wake, &one, sizeof(one)) < 0) {
+		syslog(LOG_ERR, "command executor: %s", strerror(errno));
+	}
+	pthread_join(m_thread, NULL);
+	pthread_mutex_destroy(&m_mutex);
+
+	for (std::map<pid_t, Child>::iterator i = m_children.begin(); i != m_children.end(); i++) {
+		if (i->second.pidfd >= 0) {
+			close(i->second.pidfd);
+		}
+	}
+	close(m_wake);
+}
+
+/*
+ * Return Value:
+ *   false if too many commands are already waiting
+ */
+bool CommandExecutor::Run(const CommandLine& command)
+{
+	if (command.line.empty()) {
+		return true;
+	}
+
+	pthread_mutex_lock(&m_mutex);
+	bool queued = m_queue.size() < EXECUTOR_MAX_QUEUED;
+	if (queued) {
+		m_queue.push_back(command);
+	}
+	pthread_mutex_unlock(&m_mutex);
+
+	if (queued) {
+		uint64_t one = 1;
+		if (write(m_wake, &one, sizeof(one)) < 0) {
+			syslog(LOG_ERR, "command executor: %s", strerror(errno));
+		}
+	} else {
+		syslog(LOG_ERR, "command not run, too many waiting: %s", command.line.c_str());
+	}
+	return queued;
+}
+
+StageStats& CommandExecutor::GetStats()
+{
+	return m_stats;
+}
+
+void* CommandExecutor::Thread(void* arg)
+{
+	((CommandExecutor*)arg)->Loop();
+	return NULL;
+}
+
+void CommandExecutor::Loop()
+{
+	pthread_mutex_lock(&m_mutex);
+	while (!m_stop)
+	{
+		/* start what the free slots allow; detached commands need none */
+		while (!m_queue.empty() && (m_queue.front().detached || m_running < m_concurrency)) {
+			CommandLine command = m_queue.front();
+			m_queue.pop_front();
+			size_t depth = m_queue.size() + 1;
+
+			pthread_mutex_unlock(&m_mutex);
+			struct timespec start = StageClock();
+			Spawn(command);
+			m_stats.Record(start, depth);
+			pthread_mutex_lock(&m_mutex);
+		}
+
+		pthread_mutex_unlock(&m_mutex);
+		Wait();
+		if (!m_children.empty()) {
+			struct timespec now;
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			Reap(now);
+		}
+		pthread_mutex_lock(&m_mutex);
+	}
+	pthread_mutex_unlock(&m_mutex);
+}
+
+/*
+ * Sleeps until a command is queued, a child exits or a deadline passes.
+ * SIGCHLD belongs to the whole process, so children are watched through
+ * their pidfds; without those they are polled.
+ */
+void CommandExecutor::Wait()
+{
+	std::vector<struct pollfd> fds;
+	struct pollfd wake;
+	wake.fd = m_wake;
+	wake.events = POLLIN;
+	fds.push_back(wake);
+
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	long timeout = -1;
+	for (std::map<pid_t, Child>::iterator i = m_children.begin(); i != m_children.end(); i++) {
+		const Child& child = i->second;
+		if (child.pidfd >= 0) {
+			struct pollfd exit;
+			exit.fd = child.pidfd;
+			exit.events = POLLIN;
+			fds.push_back(exit);
+		} else if (timeout < 0 || timeout > EXECUTOR_POLL_MSEC) {
+			timeout = EXECUTOR_POLL_MSEC;
+		}
+		if (!child.detached && m_timeout > 0) {
+			long left = (child.deadline.tv_sec - now.tv_sec) * 1000L
+				+ (child.deadline.tv_nsec - now.tv_nsec) / 1000000L + 1;
+			if (left < 0) {
+				left = 0;
+			}
+			if (timeout < 0 || left < timeout) {
+				timeout = left;
+			}
+		}
+	}
+
+	if (poll(&fds[0], fds.size(), (int)timeout) < 0 && errno != EINTR) {
+		syslog(LOG_ERR, "command executor: poll: %s", strerror(errno));
+	}
+
+	uint64_t wakes;
+	if (read(m_wake, &wakes, sizeof(wakes)) < 0 && errno != EAGAIN) {
+		syslog(LOG_ERR, "command executor: %s", strerror(errno));
+	}
+}
+
+void CommandExecutor::Spawn(const CommandLine& command)
+{
+	std::vector<char*> argv;
+	static char sh[] = "/bin/sh", c[] = "-c";
+	std::string line = command.line;
+	if (command.argv.empty()) {
+		argv.push_back(sh);
+		argv.push_back(c);
+		argv.push_back(&line[0]);
+	} else {
+		for (std::vector<std::string>::const_iterator i = command.argv.begin(); i != command.argv.end(); i++) {
+			argv.push_back(const_cast<char*>(i->c_str()));
+		}
+	}
+	argv.push_back(NULL);
+
+	/* a process group of its own, so that a timeout reaches its children too */
+	posix_spawnattr_t attr;
+	posix_spawnattr_init(&attr);
+	posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP);
+	posix_spawnattr_setpgroup(&attr, 0);
+
+	pid_t pid;
+	int err = posix_spawnp(&pid, argv[0], NULL, &attr, &argv[0], environ);
+	posix_spawnattr_destroy(&attr);
+	if (err != 0) {
+		syslog(LOG_ERR, "cannot run %s: %s", command.line.c_str(), strerror(err));
+		return;
+	}
+
+	Child child;
+	clock_gettime(CLOCK_MONOTONIC, &child.deadline);
+	child.deadline.tv_sec += m_timeout;
+	child.detached = command.detached;
+	child.terminated = false;
+#ifdef SYS_pidfd_open
+	child.pidfd = (int)syscall(SYS_pidfd_open, pid, 0);
+#else
+	child.pidfd = -1;
+#endif
+	m_children[pid] = child;
+	if (!child.detached) {
+		m_running++;
+	}
+}
+
+/* collects exited children and stops the ones past their deadline */
+void CommandExecutor::Reap(const struct timespec& now)
+{
+	std::map<pid_t, Child>::iterator i = m_children.begin();
+	while (i != m_children.end())
+	{
+		int status;
+		pid_t pid = waitpid(i->first, &status, WNOHANG);
+		if (pid == i->first || (pid < 0 && errno == ECHILD)) {
+			if (!i->second.detached) {
+				m_running--;
+			}
+			if (i->second.pidfd >= 0) {
+				close(i->second.pidfd);
+			}
+			m_children.erase(i++);
+			continue;
+		}
+
+		Child& child = i->second;
+		if (!child.detached && m_timeout > 0 && (now.tv_sec > child.deadline.tv_sec
+				|| (now.tv_sec == child.deadline.tv_sec && now.tv_nsec >= child.deadline.tv_nsec))) {
+			if (!child.terminated) {
+				syslog(LOG_INFO, "command %d timed out", (int)i->first);
+				kill(-i->first, SIGTERM);
+				child.terminated = true;
+				child.deadline.tv_sec += EXECUTOR_KILL_GRACE_SEC;
+			} else {
+				kill(-i->first, SIGKILL);
+				child.deadline.tv_sec += EXECUTOR_KILL_GRACE_SEC;
+			}
+		}
+		i++;
+	}
+}
@@ -0,0 +1,102 @@
+/*
+   Mobile Mouse Linux Server 
+   Copyright (C) 2011 Erik Lax <erik@datahack.se>
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef _EXECUTOR_HPP_
+#define _EXECUTOR_HPP_
+
+#include <pthread.h>
+#include <sys/types.h>
+#include <time.h>
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "stagestats.hpp"
+
+/* commands waiting for a free slot; more are refused */
+#define EXECUTOR_MAX_QUEUED 64
+
+/* how often running commands are checked for exit where the kernel has
+ * no pidfd_open(); otherwise the executor sleeps until one exits, a
+ * deadline passes or a command is queued */
+#define EXECUTOR_POLL_MSEC 250
+
+/* time a timed-out command gets between SIGTERM and SIGKILL */
+#define EXECUTOR_KILL_GRACE_SEC 2
+
+/*
+ * A configured command. Commands free of shell syntax are split into argv
+ * once, when the configuration is read, and spawned without /bin/sh; the
+ * rest run through the shell. A trailing '&' marks a command that is not
+ * waited for: it takes no slot and has no timeout.
+ */
+struct CommandLine {
+	std::string line;
+	std::vector<std::string> argv;	/* empty if the shell is needed */
+	bool detached;
+
+	CommandLine();
+	void Parse(const std::string& text);
+};
+
+/*
+ * Runs commands with posix_spawn on a thread of its own, so that a session
+ * only queues them. At most `concurrency` waited-for commands run at once;
+ * each is given `timeout` seconds (0 for no limit) before it is killed.
+ */
+class CommandExecutor
+{
+	public:
+		CommandExecutor(unsigned int concurrency, unsigned int timeout);
+		~CommandExecutor();
+
+		bool Run(const CommandLine& command);
+		StageStats& GetStats();
+
+	private:
+		struct Child {
+			struct timespec deadline;
+			bool detached;
+			bool terminated;
+			int pidfd;	/* -1 without pidfd_open() */
+		};
+
+		static void* Thread(void* arg);
+		void Loop();
+		void Spawn(const CommandLine& command);
+		void Wait();
+		void Reap(const struct timespec& now);
+
+		unsigned int m_concurrency;
+		unsigned int m_timeout;
+
+		pthread_t m_thread;
+		pthread_mutex_t m_mutex;
+		int m_wake;	/* eventfd, written by Run() and the destructor */
+		bool m_stop;
+		std::deque<CommandLine> m_queue;
+
+		/* only touched by the executor thread */
+		std::map<pid_t, Child> m_children;
+		unsigned int m_running;
+		StageStats m_stats;	/* one job per spawn */
+};
+
+#endif
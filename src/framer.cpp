@@ -0,0 +1,210 @@
+/*
+   Mobile Mouse Linux Server 
+   Copyright (C) 2011 Erik Lax <erik@datahack.se>
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "framer.hpp"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include "protocol.hpp"
+
+#define FRAMER_MASK (FRAMER_CAPACITY - 1)
+
+PacketFramer::PacketFramer()
+: m_head(0)
+, m_scanned(0)
+, m_tail(0)
+, m_segFirst(0)
+, m_segCount(0)
+, m_segStart(0)
+, m_segStamp(0)
+{
+}
+
+/*
+ * Return Value:
+ *   bytes read, 0 on end of stream, -1 on error (errno set by recvmsg);
+ *   -1 with errno ENOBUFS if the ring is full
+ */
+ssize_t PacketFramer::Fill(int fd)
+{
+	size_t space = FRAMER_CAPACITY - Buffered();
+	if (space == 0) {
+		errno = ENOBUFS;
+		return -1;
+	}
+
+	/* free space runs from tail to the end of the ring, then wraps to head */
+	size_t start = m_tail & FRAMER_MASK;
+	size_t first = FRAMER_CAPACITY - start;
+	if (first > space) {
+		first = space;
+	}
+
+	struct iovec iov[2];
+	iov[0].iov_base = m_ring + start;
+	iov[0].iov_len = first;
+	iov[1].iov_base = m_ring;
+	iov[1].iov_len = space - first;
+
+	union {
+		char buf[CMSG_SPACE(sizeof(struct timespec))];
+		struct cmsghdr align;
+	} control;
+
+	struct msghdr msg;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = iov;
+	msg.msg_iovlen = iov[1].iov_len ? 2 : 1;
+	msg.msg_control = control.buf;
+	msg.msg_controllen = sizeof(control.buf);
+
+	ssize_t n = recvmsg(fd, &msg, 0);
+	if (n <= 0) {
+		return n;
+	}
+
+	/* SO_TIMESTAMPNS stamps are CLOCK_REALTIME; use the same clock without it */
+	struct timespec when;
+	bool stamped = false;
+	for (struct cmsghdr* c = CMSG_FIRSTHDR(&msg); c != NULL; c = CMSG_NXTHDR(&msg, c)) {
+		if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_TIMESTAMPNS) {
+			memcpy(&when, CMSG_DATA(c), sizeof(when));
+			stamped = true;
+		}
+	}
+	if (!stamped) {
+		clock_gettime(CLOCK_REALTIME, &when);
+	}
+
+	m_tail += (size_t)n;
+
+	Segment segment;
+	segment.end = m_tail;
+	segment.stamp = (int64_t)when.tv_sec * 1000000000LL + when.tv_nsec;
+	if (m_segCount == FRAMER_SEGMENTS) {
+		/* many reads without a complete packet; widen the newest */
+		m_segments[(m_segFirst + m_segCount - 1) % FRAMER_SEGMENTS] = segment;
+	} else {
+		m_segments[(m_segFirst + m_segCount) % FRAMER_SEGMENTS] = segment;
+		m_segCount++;
+	}
+	return n;
+}
+
+/*
+ * Parameters:
+ *   offset, stream offset just past the last byte of a packet
+ *
+ * Return Value:
+ *   receive time in nanoseconds, interpolated within the read that
+ *   delivered the byte before offset
+ */
+int64_t PacketFramer::Stamp(size_t offset) const
+{
+	size_t start = m_segStart;
+	int64_t from = m_segStamp;
+	for (size_t i = 0; i < m_segCount; i++) {
+		const Segment& s = m_segments[(m_segFirst + i) % FRAMER_SEGMENTS];
+		if (s.end >= offset) {
+			/* after an idle gap the read says nothing about how the
+			 * packets in it were paced; spread them over a bounded span */
+			if (from < s.stamp - FRAMER_SPREAD_NSEC) {
+				from = s.stamp - FRAMER_SPREAD_NSEC;
+			}
+			if (from >= s.stamp || s.end == start) {
+				return s.stamp;
+			}
+			return from + (s.stamp - from) * (int64_t)(offset - start) / (int64_t)(s.end - start);
+		}
+		start = s.end;
+		from = s.stamp;
+	}
+	return from;
+}
+
+/*
+ * Parameters:
+ *   packet, set to the next complete packet, terminator included
+ *   received, set to the time the packet arrived (CLOCK_REALTIME)
+ *
+ * Return Value:
+ *   true if a packet was returned
+ */
+bool PacketFramer::Next(std::string_view& packet, struct timespec& received)
+{
+	/* resume the terminator scan where the last one stopped */
+	while (m_scanned < m_tail) {
+		size_t start = m_scanned & FRAMER_MASK;
+		size_t len = m_tail - m_scanned;
+		if (start + len > FRAMER_CAPACITY) {
+			len = FRAMER_CAPACITY - start;
+		}
+
+		const char* end = (const char*)memchr(m_ring + start, PROTOCOL_PACKET_TERMINATOR, len);
+		if (end == NULL) {
+			m_scanned += len;
+			continue;
+		}
+
+		size_t stop = m_scanned + (size_t)(end - (m_ring + start)) + 1;
+		size_t size = stop - m_head;
+		size_t begin = m_head & FRAMER_MASK;
+
+		if (begin + size <= FRAMER_CAPACITY) {
+			packet = std::string_view(m_ring + begin, size);
+		} else {
+			/* packet straddles the wrap point; stitch it together */
+			size_t tailpart = FRAMER_CAPACITY - begin;
+			memcpy(m_scratch, m_ring + begin, tailpart);
+			memcpy(m_scratch + tailpart, m_ring, size - tailpart);
+			packet = std::string_view(m_scratch, size);
+		}
+
+		int64_t stamp = Stamp(stop);
+		received.tv_sec = (time_t)(stamp / 1000000000LL);
+		received.tv_nsec = (long)(stamp % 1000000000LL);
+
+		m_head = m_scanned = stop;
+
+		/* forget reads that have been consumed entirely */
+		while (m_segCount > 0 && m_segments[m_segFirst].end <= m_head) {
+			m_segStart = m_segments[m_segFirst].end;
+			m_segStamp = m_segments[m_segFirst].stamp;
+			m_segFirst = (m_segFirst + 1) % FRAMER_SEGMENTS;
+			m_segCount--;
+		}
+		return true;
+	}
+	return false;
+}
+
+/* bytes received but not yet handed out as packets */
+size_t PacketFramer::Buffered() const
+{
+	return m_tail - m_head;
+}
+
+/* true if the ring holds an incomplete packet that can grow no further */
+bool PacketFramer::Full() const
+{
+	return Buffered() == FRAMER_CAPACITY;
+}
@@ -0,0 +1,89 @@
+/*
+   Mobile Mouse Linux Server 
+   Copyright (C) 2011 Erik Lax <erik@datahack.se>
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef _FRAMER_HPP_
+#define _FRAMER_HPP_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/types.h>
+#include <string_view>
+
+/* receive ring capacity; must be a power of two */
+#define FRAMER_CAPACITY 65536
+
+/* reads remembered for timestamping; further reads merge into the newest */
+#define FRAMER_SEGMENTS 64
+
+/* longest span packets of a single read are spread over (nanoseconds) */
+#define FRAMER_SPREAD_NSEC 50000000LL
+
+/*
+ * Fixed-capacity receive ring that splits the byte stream into packets.
+ * Fill() reads as much as fits with one recvmsg(); Next() hands out each
+ * complete packet as a view into the ring, scanning every byte once for
+ * the terminator. Only a packet that straddles the wrap point is copied
+ * (into a scratch buffer) so that it can be returned contiguously.
+ *
+ * Each read is stamped with the kernel receive time when the socket has
+ * SO_TIMESTAMPNS enabled (else the time of the read). A packet is given a
+ * time interpolated by its end offset between the previous read and the
+ * one that completed it, so packets that arrive together in one read are
+ * not all seen at the same instant.
+ *
+ * Views returned by Next() stay valid until the next call to Fill().
+ */
+class PacketFramer
+{
+	public:
+		PacketFramer();
+
+		ssize_t Fill(int fd);
+		bool Next(std::string_view& packet, struct timespec& received);
+
+		size_t Buffered() const;
+		bool Full() const;
+
+	private:
+		char m_ring[FRAMER_CAPACITY];
+		char m_scratch[FRAMER_CAPACITY];
+
+		/* free-running stream offsets; the ring index is offset & (capacity - 1) */
+		size_t m_head;
+		size_t m_scanned;
+		size_t m_tail;
+
+		struct Segment {
+			size_t end;
+			int64_t stamp;
+		};
+
+		int64_t Stamp(size_t offset) const;
+
+		/* reads not yet consumed, oldest first; m_segStart/m_segStamp
+		 * describe where and when the read before the oldest ended */
+		Segment m_segments[FRAMER_SEGMENTS];
+		size_t m_segFirst;
+		size_t m_segCount;
+		size_t m_segStart;
+		int64_t m_segStamp;
+};
+
+#endif
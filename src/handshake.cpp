@@ -0,0 +1,64 @@
+/*
+   Mobile Mouse Linux Server 
+   Copyright (C) 2011 Erik Lax <erik@datahack.se>
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "handshake.hpp"
+
+/* CONNECTED reply with the given verdict and message */
+static std::string Connected(const Configuration& appConfig, const char* verdict, const char* message)
+{
+	return std::string("CONNECTED\x1e")
+		+ verdict + "\x1e"
+		+ appConfig.getPlatform() + "\x1e"
+		+ appConfig.getHostname() + "\x1e"
+		+ message + "\x1e"
+		"00:00:00:00:00:00\x1e"
+		"4\x04";
+}
+
+HandshakeReplies::HandshakeReplies(const Configuration& appConfig)
+: m_welcome(Connected(appConfig, "YES", "Welcome"))
+, m_notAllowed(Connected(appConfig, "NO", "Device is not allowed"))
+, m_badPassword(Connected(appConfig, "NO", "Incorrect password"))
+{
+	m_hotkeys = std::string("HOTKEYS\x1e")
+		+ appConfig.getHotKeyName(1) + "\x1e"
+		+ appConfig.getHotKeyName(2) + "\x1e"
+		+ appConfig.getHotKeyName(3) + "\x1e"
+		+ appConfig.getHotKeyName(4) + "\x04";
+}
+
+std::string_view HandshakeReplies::Welcome() const
+{
+	return m_welcome;
+}
+
+std::string_view HandshakeReplies::HotKeys() const
+{
+	return m_hotkeys;
+}
+
+std::string_view HandshakeReplies::NotAllowed() const
+{
+	return m_notAllowed;
+}
+
+std::string_view HandshakeReplies::BadPassword() const
+{
+	return m_badPassword;
+}
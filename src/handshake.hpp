@@ -0,0 +1,50 @@
+/*
+   Mobile Mouse Linux Server 
+   Copyright (C) 2011 Erik Lax <erik@datahack.se>
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef _HANDSHAKE_HPP_
+#define _HANDSHAKE_HPP_
+
+#include <string>
+#include <string_view>
+
+#include "configuration.hpp"
+
+/*
+ * The server's answers to a CONNECT, rendered once from the configuration
+ * rather than for every login. The strings live as long as this object,
+ * so sessions queue them without taking a copy.
+ */
+class HandshakeReplies
+{
+	public:
+		HandshakeReplies(const Configuration& appConfig);
+
+		std::string_view Welcome() const;
+		std::string_view HotKeys() const;
+		std::string_view NotAllowed() const;
+		std::string_view BadPassword() const;
+
+	private:
+		std::string m_welcome;
+		std::string m_hotkeys;
+		std::string m_notAllowed;
+		std::string m_badPassword;
+};
+
+#endif
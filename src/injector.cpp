@@ -0,0 +1,207 @@
+/*
+   Mobile Mouse Linux Server 
+   Copyright (C) 2011 Erik Lax <erik@datahack.se>
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "injector.hpp"
+
+#include <stdexcept>
+#include <string>
+#include <errno.h>
+#include <poll.h>
+#include <stdint.h>
+#include <string.h>
+#include <syslog.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+InputInjector::InputInjector()
+: m_signalled(false)
+, m_waiting(false)
+, m_stop(false)
+, m_submitted(0)
+, m_written(0)
+{
+	/* blocking, so that the thread sleeps in read() until there is work */
+	if ((m_wake = eventfd(0, EFD_CLOEXEC)) < 0) {
+		throw std::runtime_error("cannot create injector eventfd");
+	}
+	if ((m_progress = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0) {
+		close(m_wake);
+		throw std::runtime_error("cannot create injector eventfd");
+	}
+
+	int err = pthread_create(&m_thread, NULL, Thread, this);
+	if (err != 0) {
+		close(m_progress);
+		close(m_wake);
+		throw std::runtime_error(std::string("cannot start injector thread: ") + strerror(err));
+	}
+}
+
+/* whatever was submitted is written before the thread goes */
+InputInjector::~InputInjector()
+{
+	m_stop.store(true);
+	uint64_t one = 1;
+	if (write(m_wake, &one, sizeof(one)) < 0) {
+		syslog(LOG_ERR, "injector eventfd: %s", strerror(errno));
+	}
+	pthread_join(m_thread, NULL);
+	close(m_progress);
+	close(m_wake);
+}
+
+/*
+ * Queues one batch for the device fd. If the injection thread has fallen
+ * a whole ring behind, waits for a slot rather than drop or reorder input.
+ *
+ * Parameters:
+ *   fd, uinput device
+ *   events, count, whole frames closed by SYN_REPORT
+ */
+void InputInjector::Submit(int fd, const struct input_event* events, size_t count)
+{
+	if (count == 0) {
+		return;
+	}
+	if (count > EVENTBATCH_MAX_EVENTS) {
+		count = EVENTBATCH_MAX_EVENTS;
+	}
+
+	Batch* batch;
+	while (1) {
+		unsigned long written = m_written.load(std::memory_order_acquire);
+		if ((batch = m_queue.Reserve()) != NULL) {
+			break;
+		}
+		WaitProgress(written);
+	}
+	batch->fd = fd;
+	batch->count = count;
+	memcpy(batch->events, events, count * sizeof(struct input_event));
+	m_queue.Commit();
+	m_submitted++;
+
+	/* one wakeup per sleep, however many batches arrive meanwhile */
+	if (!m_signalled.exchange(true)) {
+		uint64_t one = 1;
+		if (write(m_wake, &one, sizeof(one)) < 0) {
+			syslog(LOG_ERR, "injector eventfd: %s", strerror(errno));
+		}
+	}
+}
+
+/*
+ * Returns once every batch submitted so far has been written, for input
+ * that has to stay in order with events sent another way (XTest keys).
+ */
+void InputInjector::Sync()
+{
+	unsigned long written;
+	while ((written = m_written.load(std::memory_order_acquire)) < m_submitted) {
+		WaitProgress(written);
+	}
+}
+
+/*
+ * Sleeps until the injection thread has written more than written
+ * batches, or for INJECTOR_WAIT_MSEC at most; the caller checks its
+ * condition again either way. The thread only signals while m_waiting is
+ * set, so a producer that keeps up costs it nothing.
+ */
+void InputInjector::WaitProgress(unsigned long written)
+{
+	m_waiting.store(true);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+
+	/* a batch may have gone out before the thread could see the flag */
+	if (m_written.load(std::memory_order_acquire) != written) {
+		m_waiting.store(false);
+		return;
+	}
+
+	struct pollfd pfd;
+	pfd.fd = m_progress;
+	pfd.events = POLLIN;
+	if (poll(&pfd, 1, INJECTOR_WAIT_MSEC) > 0) {
+		uint64_t posts;
+		if (read(m_progress, &posts, sizeof(posts)) < 0 && errno != EAGAIN) {
+			syslog(LOG_ERR, "injector eventfd: %s", strerror(errno));
+		}
+	}
+	m_waiting.store(false);
+}
+
+StageStats& InputInjector::GetStats()
+{
+	return m_stats;
+}
+
+void* InputInjector::Thread(void* arg)
+{
+	((InputInjector*)arg)->Loop();
+	return NULL;
+}
+
+void InputInjector::Loop()
+{
+	while (1) {
+		uint64_t posts;
+		if (read(m_wake, &posts, sizeof(posts)) < 0 && errno != EINTR) {
+			syslog(LOG_ERR, "injector eventfd: %s", strerror(errno));
+			return;
+		}
+		/* cleared before draining, so a batch committed meanwhile wakes us again */
+		m_signalled.store(false);
+
+		Drain();
+
+		if (m_stop.load()) {
+			Drain();
+			return;
+		}
+	}
+}
+
+void InputInjector::Drain()
+{
+	Batch* batch;
+	while ((batch = m_queue.Front()) != NULL) {
+		size_t depth = m_queue.Size();
+		struct timespec start = StageClock();
+
+		/* uinput takes any number of whole events per write; the kernel stamps them */
+		size_t len = batch->count * sizeof(struct input_event);
+		ssize_t n = write(batch->fd, batch->events, len);
+		if (n != (ssize_t)len) {
+			syslog(LOG_ERR, "uinput write: %s", n < 0 ? strerror(errno) : "short write");
+		}
+
+		m_stats.Record(start, depth);
+		m_queue.Release();
+		m_written.fetch_add(1, std::memory_order_release);
+
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (m_waiting.exchange(false)) {
+			uint64_t one = 1;
+			if (write(m_progress, &one, sizeof(one)) < 0) {
+				syslog(LOG_ERR, "injector eventfd: %s", strerror(errno));
+			}
+		}
+	}
+}
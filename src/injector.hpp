@@ -0,0 +1,84 @@
+/*
+   Mobile Mouse Linux Server 
+   Copyright (C) 2011 Erik Lax <erik@datahack.se>
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef _INJECTOR_HPP_
+#define _INJECTOR_HPP_
+
+#include <pthread.h>
+#include <stddef.h>
+#include <atomic>
+#include <linux/input.h>
+
+#include "eventbatch.hpp"
+#include "spscring.hpp"
+#include "stagestats.hpp"
+
+/* batches that may wait for the injection thread before Submit() blocks */
+#define INJECTOR_QUEUE_BATCHES 128
+
+/* longest single sleep while waiting on the injection thread; the
+ * condition is checked again after each */
+#define INJECTOR_WAIT_MSEC 10
+
+/*
+ * The input-injection stage: a thread of its own that writes event
+ * batches to the uinput devices, so the reactor thread never waits on the
+ * kernel's input path. Batches are handed over through a lock-free SPSC
+ * ring, and only the reactor thread may Submit() or Sync(); with a single
+ * producer and a single ring, motion, clicks and uinput key events reach
+ * the devices in the order they were submitted.
+ */
+class InputInjector
+{
+	public:
+		InputInjector();
+		~InputInjector();
+
+		void Submit(int fd, const struct input_event* events, size_t count);
+		void Sync();
+
+		StageStats& GetStats();
+
+	private:
+		struct Batch {
+			int fd;
+			size_t count;
+			struct input_event events[EVENTBATCH_MAX_EVENTS];
+		};
+
+		static void* Thread(void* arg);
+		void Loop();
+		void Drain();
+		void WaitProgress(unsigned long written);
+
+		SpscRing<Batch, INJECTOR_QUEUE_BATCHES> m_queue;
+		pthread_t m_thread;
+		int m_wake;	/* eventfd */
+		std::atomic<bool> m_signalled;
+		int m_progress;	/* eventfd, written for a waiting producer */
+		std::atomic<bool> m_waiting;
+		std::atomic<bool> m_stop;
+
+		unsigned long m_submitted;	/* only touched by the producer */
+		std::atomic<unsigned long> m_written;
+
+		StageStats m_stats;
+};
+
+#endif
@@ -1,5 +1,5 @@
 /*
-   Mobile Mouse Linux Server
+   Mobile Mouse Linux Server 
    Copyright (C) 2011 Erik Lax <erik@datahack.se>
 
    This program is free software; you can redistribute it and/or
@@ -19,30 +19,55 @@
 
 #include "keyboardinterface.hpp"
 
-#include <X11/extensions/XTest.h>
-#include <X11/XKBlib.h>
 #include <stdexcept>
-#include <stdlib.h>
-#include <unistd.h>
-#include <stdio.h>
+#include <syslog.h>
 
-KeyboardInterface::KeyboardInterface(bool enabled, const std::string display)
+#include "configuration.hpp"
+#include "xtestkeyboard.hpp"
+#include "uinputkeyboard.hpp"
+
+/*
+ * Parameters:
+ *   config, supplies keyboard.enabled, keyboard.backend and the xkb layout
+ *   x, X thread for the xtest backend
+ *   injector, injection stage for the uinput backend
+ *
+ * Return Value:
+ *   new keyboard for the caller to delete; throws std::runtime_error if
+ *   no backend can be opened
+ */
+KeyboardInterface* KeyboardInterface::Create(const Configuration& config, XService& x, InputInjector& injector)
 {
-	keyboardEnabled = enabled;
+	if (config.getKeyboardBackend() == KB_UINPUT) {
+		try {
+			return new UinputKeyboard(injector, config.getKeyboardEnabled(),
+					config.getKeyboardXkbLayout(), config.getKeyboardXkbVariant());
+		} catch (std::runtime_error& e) {
+			syslog(LOG_ERR, "uinput keyboard unavailable (%s); using xtest", e.what());
+		}
+	}
+	return new XTestKeyboard(x, config.getKeyboardEnabled());
+}
 
-	if ((m_display = XOpenDisplay(display.empty()?NULL:display.c_str())) == NULL)
-	{
-		// sorry for throwing in constructor...
-		throw std::runtime_error("cannot open xdisplay");
+bool KeyboardInterface::ParseBackend(const std::string& name, Backend& backend)
+{
+	if (name == "xtest") {
+		backend = KB_XTEST;
+	} else if (name == "uinput") {
+		backend = KB_UINPUT;
+	} else {
+		return false;
 	}
+	return true;
+}
+
+KeyboardInterface::KeyboardInterface(bool enabled)
+: keyboardEnabled(enabled)
+{
 }
 
 KeyboardInterface::~KeyboardInterface()
 {
-	if (m_display)
-	{
-		XCloseDisplay(m_display);
-	}
 }
 
 // this version of sendkey takes a single keycode.
@@ -54,19 +79,6 @@ void KeyboardInterface::SendKey(int keycode)
 	SendKey(keys);
 }
 
-bool KeyboardInterface::keysymIsShiftVariant(KeySym key)
-{
-	// get the physical keycode associated with this key
-	KeyCode basekey = XKeysymToKeycode(m_display, key);
-
-	// check if shift-modified variant keysym of base key matches input keysym
-	if (XkbKeycodeToKeysym(m_display, basekey, 0, 1) == key) {
-		return true;
-	}
-
-	return false;
-}
-
 // this version of sendkey takes a list of keycodes
 void KeyboardInterface::SendKey(const std::list<int>& keycode)
 {
@@ -78,24 +90,65 @@ void KeyboardInterface::SendKey(const std::list<int>& keycode)
 	ReleaseKeys(keycode);
 }
 
-void KeyboardInterface::PressKeys(const std::list<int>& keys) {
+void KeyboardInterface::PressKeys(const std::list<int>& keys)
+{
 	for (std::list<int>::const_iterator i = keys.begin(); i != keys.end(); i++) {
-		KeyCode key = XKeysymToKeycode(m_display, *i);
-		if (key == NoSymbol) {
-			continue;
-		}
-		XTestFakeKeyEvent(m_display, key, True, CurrentTime);
+		Transition(*i, true);
 	}
-	XFlush(m_display);
+	Flush();
 }
 
-void KeyboardInterface::ReleaseKeys(const std::list<int>& keys) {
+void KeyboardInterface::ReleaseKeys(const std::list<int>& keys)
+{
 	for (std::list<int>::const_reverse_iterator i = keys.rbegin(); i != keys.rend(); i++) {
-		KeyCode key = XKeysymToKeycode(m_display, *i);
-		if (key == NoSymbol) {
-			continue;
-		}
-		XTestFakeKeyEvent(m_display, key, False, CurrentTime);
+		Transition(*i, false);
+	}
+	Flush();
+}
+
+// delivers a prepared sequence of transitions with a single flush
+void KeyboardInterface::SendStrokes(const KeyStroke* strokes, size_t count)
+{
+	if (!keyboardEnabled) {
+		return;
+	}
+
+	for (size_t i = 0; i < count; i++) {
+		Transition(strokes[i].keysym, strokes[i].press);
+	}
+	Flush();
+}
+
+// releases whatever is still held down, such as the modifiers of a click
+// whose release never came; the next user starts with no keys pressed
+void KeyboardInterface::ReleaseAll()
+{
+	if (m_held.empty()) {
+		return;
+	}
+	for (std::set<int>::const_iterator i = m_held.begin(); i != m_held.end(); i++) {
+		KeyEvent(*i, false);
+	}
+	m_held.clear();
+	Flush();
+}
+
+// backends writing to a uinput device share its injector and are in order already
+void KeyboardInterface::Sync()
+{
+}
+
+// only backends that remap the keymap have anything to give back
+void KeyboardInterface::ReturnKeys()
+{
+}
+
+void KeyboardInterface::Transition(int keysym, bool press)
+{
+	if (press) {
+		m_held.insert(keysym);
+	} else {
+		m_held.erase(keysym);
 	}
-	XFlush(m_display);
+	KeyEvent(keysym, press);
 }
@@ -22,14 +22,37 @@
 
 #include <X11/Xlib.h>
 #include <X11/keysym.h>
+#include <stddef.h>
 #include <string>
 #include <list>
+#include <set>
 
+class Configuration;
+class XService;
+class InputInjector;
+
+/* one key transition of a prepared key sequence */
+struct KeyStroke {
+	int keysym;
+	bool press;
+};
+
+/*
+ * Types keysyms. The backend that delivers the key events is chosen by
+ * keyboard.backend; Create() falls back to XTest if uinput is unavailable.
+ */
 class KeyboardInterface
 {
 	public:
-		KeyboardInterface(bool enabled = true, const std::string display = "");
-		~KeyboardInterface();
+		enum Backend {
+			KB_XTEST,
+			KB_UINPUT,
+		};
+
+		static KeyboardInterface* Create(const Configuration& config, XService& x, InputInjector& injector);
+		static bool ParseBackend(const std::string& name, Backend& backend);
+
+		virtual ~KeyboardInterface();
 
 		void SendKey(const std::list<int>& keycode);
 		void SendKey(int keycode);
@@ -37,10 +60,29 @@ class KeyboardInterface
 		void PressKeys(const std::list<int>& keys);
 		void ReleaseKeys(const std::list<int>& keys);
 
-		bool keysymIsShiftVariant(KeySym key);
+		void SendStrokes(const KeyStroke* strokes, size_t count);
+		void ReleaseAll();
+
+		/* returns once the keys sent so far cannot be overtaken by
+		 * uinput events submitted afterwards */
+		virtual void Sync();
+
+		/* gives back keycodes borrowed for characters the keymap lacks */
+		virtual void ReturnKeys();
+
+		virtual bool keysymIsShiftVariant(KeySym key) = 0;
+
+	protected:
+		KeyboardInterface(bool enabled);
+
+		/* backends queue single transitions and deliver them on Flush() */
+		virtual void KeyEvent(int keysym, bool press) = 0;
+		virtual void Flush() = 0;
 
 	private:
-		Display *m_display;
+		void Transition(int keysym, bool press);
+
 		bool keyboardEnabled;
+		std::set<int> m_held;	/* keysyms pressed and not yet released */
 };
 #endif
@@ -0,0 +1,197 @@
+/*
+   Mobile Mouse Linux Server 
+   Copyright (C) 2011 Erik Lax <erik@datahack.se>
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "keymap.hpp"
+
+#include <string.h>
+#include <syslog.h>
+#include <X11/keysym.h>
+#include <xkbcommon/xkbcommon.h>
+
+#include "utf8.hpp"
+
+KeymapCache::KeymapCache()
+{
+	Clear();
+}
+
+/*
+ * Parameters:
+ *   display, connection to read the keyboard mapping from
+ *
+ * Return Value:
+ *   false if the mapping could not be read; the previous snapshot is kept
+ */
+bool KeymapCache::Build(Display* display)
+{
+	int minKeycode, maxKeycode, perKeycode;
+	XDisplayKeycodes(display, &minKeycode, &maxKeycode);
+
+	int count = maxKeycode - minKeycode + 1;
+	KeySym* syms = XGetKeyboardMapping(display, (KeyCode)minKeycode, count, &perKeycode);
+	if (syms == NULL) {
+		syslog(LOG_ERR, "cannot read keyboard mapping");
+		return false;
+	}
+
+	Clear();
+	m_unused.clear();
+
+	/* same precedence as XKeysymToKeycode: every keycode's first column
+	 * before any keycode's second, and the lowest keycode within a column */
+	for (int level = 0; level < perKeycode; level++) {
+		for (int i = 0; i < count; i++) {
+			KeySym keysym = syms[i * perKeycode + level];
+			if (keysym != NoSymbol) {
+				Bind(keysym, (KeyCode)(minKeycode + i), (unsigned int)level);
+			}
+		}
+	}
+
+	for (int i = 0; i < count; i++) {
+		int level = 0;
+		while (level < perKeycode && syms[i * perKeycode + level] == NoSymbol) {
+			level++;
+		}
+		if (level == perKeycode) {
+			m_unused.push_back((KeyCode)(minKeycode + i));
+		}
+	}
+
+	XFree(syms);
+	return true;
+}
+
+/*
+ * Fills the cache from the first layout of an xkbcommon keymap. Levels 2
+ * and 3 (AltGr, AltGr+Shift) are only bound if some key has
+ * ISO_Level3_Shift on its base level to reach them with; higher levels
+ * are never bound.
+ *
+ * Parameters:
+ *   keymap, compiled keymap
+ *   minKeycode, maxKeycode, range of xkb keycodes to bind
+ */
+void KeymapCache::Build(struct xkb_keymap* keymap, unsigned int minKeycode, unsigned int maxKeycode)
+{
+	Clear();
+	m_unused.clear();
+
+	for (xkb_level_index_t level = 0; level < 4; level++) {
+		if (level == 2) {
+			KeyCode keycode;
+			unsigned int base;
+			if (!Find(XK_ISO_Level3_Shift, keycode, base) || base != 0) {
+				break;
+			}
+		}
+		for (xkb_keycode_t keycode = minKeycode; keycode <= maxKeycode; keycode++) {
+			if (level >= xkb_keymap_num_levels_for_key(keymap, keycode, 0)) {
+				continue;
+			}
+			const xkb_keysym_t* syms;
+			int count = xkb_keymap_key_get_syms_by_level(keymap, keycode, 0, level, &syms);
+			if (count == 1) {
+				Bind(syms[0], (KeyCode)keycode, level);
+			}
+		}
+	}
+}
+
+void KeymapCache::Clear()
+{
+	memset(m_dense, 0, sizeof(m_dense));
+	m_sparse.clear();
+}
+
+/* records a binding unless the keysym already has one */
+void KeymapCache::Bind(KeySym keysym, KeyCode keycode, unsigned int level)
+{
+	Binding binding;
+	binding.keycode = keycode;
+	binding.level = (unsigned char)(level > 255 ? 255 : level);
+
+	if (keysym < KEYMAP_DENSE_KEYSYMS) {
+		if (m_dense[keysym].keycode == 0) {
+			m_dense[keysym] = binding;
+		}
+	} else {
+		m_sparse.insert(std::make_pair(keysym, binding));
+	}
+}
+
+void KeymapCache::Unbind(KeySym keysym)
+{
+	if (keysym < KEYMAP_DENSE_KEYSYMS) {
+		m_dense[keysym].keycode = 0;
+	} else {
+		m_sparse.erase(keysym);
+	}
+}
+
+const std::vector<KeyCode>& KeymapCache::GetUnused() const
+{
+	return m_unused;
+}
+
+/*
+ * Parameters:
+ *   keysym, symbol to type
+ *   keycode, set to the key that produces it
+ *   level, set to its shift level on that key (1 means Shift is needed)
+ *
+ * Return Value:
+ *   false if no key produces the keysym
+ */
+bool KeymapCache::Lookup(KeySym keysym, KeyCode& keycode, unsigned int& level) const
+{
+	if (Find(keysym, keycode, level)) {
+		return true;
+	}
+
+	/* a character may be bound by its legacy keysym or by its Unicode one */
+	KeySym other;
+	if ((keysym & 0xff000000) == UNICODE_KEYSYM_OFFSET) {
+		other = xkb_utf32_to_keysym((uint32_t)(keysym & 0x00ffffff));
+	} else {
+		uint32_t codepoint = xkb_keysym_to_utf32((xkb_keysym_t)keysym);
+		other = codepoint >= 0x100 ? (UNICODE_KEYSYM_OFFSET | codepoint) : NoSymbol;
+	}
+	return other != NoSymbol && other != keysym && Find(other, keycode, level);
+}
+
+bool KeymapCache::Find(KeySym keysym, KeyCode& keycode, unsigned int& level) const
+{
+	const Binding* binding = NULL;
+	if (keysym < KEYMAP_DENSE_KEYSYMS) {
+		binding = &m_dense[keysym];
+	} else {
+		std::unordered_map<KeySym, Binding>::const_iterator i = m_sparse.find(keysym);
+		if (i != m_sparse.end()) {
+			binding = &i->second;
+		}
+	}
+
+	if (binding == NULL || binding->keycode == 0) {
+		return false;
+	}
+	keycode = binding->keycode;
+	level = binding->level;
+	return true;
+}
@@ -0,0 +1,69 @@
+/*
+   Mobile Mouse Linux Server 
+   Copyright (C) 2011 Erik Lax <erik@datahack.se>
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef _KEYMAP_HPP_
+#define _KEYMAP_HPP_
+
+#include <X11/Xlib.h>
+#include <unordered_map>
+#include <vector>
+
+/* keysyms below this are looked up in a flat table, the rest in a map */
+#define KEYMAP_DENSE_KEYSYMS 0x10000
+
+struct xkb_keymap;
+
+/*
+ * Snapshot of the core keyboard mapping, indexed by keysym. Answers which
+ * keycode produces a keysym and whether Shift is needed for it without
+ * searching the keymap on every key. The owner rebuilds it when the
+ * server announces a new mapping, or fills it with Bind() from a keymap
+ * of its own.
+ */
+class KeymapCache
+{
+	public:
+		KeymapCache();
+
+		bool Build(Display* display);
+		void Build(struct xkb_keymap* keymap, unsigned int minKeycode, unsigned int maxKeycode);
+		void Clear();
+		void Bind(KeySym keysym, KeyCode keycode, unsigned int level);
+		void Unbind(KeySym keysym);
+
+		const std::vector<KeyCode>& GetUnused() const;
+
+		bool Lookup(KeySym keysym, KeyCode& keycode, unsigned int& level) const;
+
+	private:
+		bool Find(KeySym keysym, KeyCode& keycode, unsigned int& level) const;
+
+		struct Binding {
+			KeyCode keycode;	/* 0 if the keysym is not mapped */
+			unsigned char level;
+		};
+
+		Binding m_dense[KEYMAP_DENSE_KEYSYMS];
+		std::unordered_map<KeySym, Binding> m_sparse;
+
+		/* keycodes without any keysym in the last Build() */
+		std::vector<KeyCode> m_unused;
+};
+
+#endif
@@ -0,0 +1,186 @@
+/*
+   Mobile Mouse Linux Server 
+   Copyright (C) 2011 Erik Lax <erik@datahack.se>
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "listener.hpp"
+
+#include <errno.h>
+#include <stddef.h>
+#include <string.h>
+#include <syslog.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+/* pending Fast Open connections the listener accepts data from */
+#define LISTENER_FASTOPEN_QUEUE 16
+
+ListenEndpoint::ListenEndpoint()
+: m_type(LE_TCP)
+{
+}
+
+/*
+ * Return Value:
+ *   true if spec names a valid endpoint, which is stored in endpoint
+ */
+bool ListenEndpoint::Parse(const std::string& spec, ListenEndpoint& endpoint)
+{
+	ListenEndpoint parsed;
+	if (spec == "tcp") {
+		parsed.m_type = LE_TCP;
+	} else if (spec.compare(0, 5, "unix:") == 0) {
+		parsed.m_type = LE_UNIX;
+		parsed.m_path = spec.substr(5);
+	} else if (spec.compare(0, 9, "abstract:") == 0) {
+		parsed.m_type = LE_ABSTRACT;
+		parsed.m_path = spec.substr(9);
+	} else {
+		return false;
+	}
+
+	/* sun_path holds the path and its terminator, or a leading NUL and the name */
+	if (parsed.m_type != LE_TCP &&
+			(parsed.m_path.empty() || parsed.m_path.size() >= sizeof(((struct sockaddr_un*)0)->sun_path))) {
+		return false;
+	}
+
+	endpoint = parsed;
+	return true;
+}
+
+ListenEndpoint::Type ListenEndpoint::GetType() const
+{
+	return m_type;
+}
+
+std::string ListenEndpoint::Describe(unsigned short port) const
+{
+	switch (m_type) {
+		case LE_UNIX:
+			return "unix socket " + m_path;
+		case LE_ABSTRACT:
+			return "abstract socket @" + m_path;
+		case LE_TCP:
+		default:
+			return "port " + std::to_string(port);
+	}
+}
+
+/*
+ * Parameters:
+ *   port, server.port, for TCP
+ *
+ * Return Value:
+ *   listening socket, or -1 (the reason is logged)
+ */
+int ListenEndpoint::Open(unsigned short port) const
+{
+	struct sockaddr_storage addr;
+	socklen_t addrlen;
+	memset(&addr, 0, sizeof addr);
+
+	if (m_type == LE_TCP) {
+		struct sockaddr_in* in = (struct sockaddr_in*)&addr;
+		in->sin_family = AF_INET;
+		in->sin_addr.s_addr = INADDR_ANY;
+		in->sin_port = htons(port);
+		addrlen = sizeof(struct sockaddr_in);
+	} else {
+		struct sockaddr_un* un = (struct sockaddr_un*)&addr;
+		un->sun_family = AF_UNIX;
+		if (m_type == LE_ABSTRACT) {
+			/* leading NUL; the name is not terminated */
+			memcpy(un->sun_path + 1, m_path.data(), m_path.size());
+			addrlen = (socklen_t)(offsetof(struct sockaddr_un, sun_path) + 1 + m_path.size());
+		} else {
+			memcpy(un->sun_path, m_path.data(), m_path.size());
+			addrlen = sizeof(struct sockaddr_un);
+		}
+	}
+
+	int sockfd = socket(addr.ss_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (sockfd < 0)
+	{
+		syslog(LOG_ERR, "socket: %s", strerror(errno));
+		return -1;
+	}
+
+	if (m_type == LE_TCP)
+	{
+		int optval = 1;
+		if (setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, &optval, sizeof optval) < 0)
+		{
+			syslog(LOG_ERR, "setsockopt: %s", strerror(errno));
+			close(sockfd);
+			return -1;
+		}
+
+		/* a returning phone may send its CONNECT along with the SYN; this needs
+		 * the server bit (2) of the net.ipv4.tcp_fastopen sysctl */
+		int fastOpen = LISTENER_FASTOPEN_QUEUE;
+		if (setsockopt(sockfd, IPPROTO_TCP, TCP_FASTOPEN, &fastOpen, sizeof fastOpen) < 0)
+		{
+			syslog(LOG_WARNING, "setsockopt(TCP_FASTOPEN): %s", strerror(errno));
+		}
+	}
+	else if (m_type == LE_UNIX)
+	{
+		/* a socket file left by an earlier run would make bind() fail; anything
+		 * else at the path is not ours to remove */
+		struct stat st;
+		if (lstat(m_path.c_str(), &st) == 0)
+		{
+			if (!S_ISSOCK(st.st_mode))
+			{
+				syslog(LOG_ERR, "bind %s: path exists and is not a socket", m_path.c_str());
+				close(sockfd);
+				return -1;
+			}
+			if (unlink(m_path.c_str()) < 0 && errno != ENOENT)
+			{
+				syslog(LOG_WARNING, "unlink %s: %s", m_path.c_str(), strerror(errno));
+			}
+		}
+		else if (errno != ENOENT)
+		{
+			syslog(LOG_ERR, "lstat %s: %s", m_path.c_str(), strerror(errno));
+			close(sockfd);
+			return -1;
+		}
+	}
+
+	if (bind(sockfd, (struct sockaddr *)&addr, addrlen) < 0)
+	{
+		syslog(LOG_ERR, "bind %s: %s", Describe(port).c_str(), strerror(errno));
+		close(sockfd);
+		return -1;
+	}
+
+	if (listen(sockfd, SOMAXCONN) < 0)
+	{
+		syslog(LOG_ERR, "listen: %s", strerror(errno));
+		close(sockfd);
+		return -1;
+	}
+	return sockfd;
+}
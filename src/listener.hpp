@@ -0,0 +1,55 @@
+/*
+   Mobile Mouse Linux Server 
+   Copyright (C) 2011 Erik Lax <erik@datahack.se>
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef _LISTENER_HPP_
+#define _LISTENER_HPP_
+
+#include <string>
+
+/*
+ * A place clients connect to, as given in server.listen:
+ *   "tcp"             all IPv4 addresses, on server.port
+ *   "unix:PATH"       a Unix stream socket at PATH
+ *   "abstract:NAME"   a Linux abstract socket, with no file behind it
+ * Local forwarders (adb reverse, USB tethering) reach the Unix kinds
+ * without going through the TCP stack.
+ */
+class ListenEndpoint
+{
+	public:
+		enum Type {
+			LE_TCP,
+			LE_UNIX,
+			LE_ABSTRACT,
+		};
+
+		ListenEndpoint();
+
+		static bool Parse(const std::string& spec, ListenEndpoint& endpoint);
+
+		Type GetType() const;
+		std::string Describe(unsigned short port) const;
+		int Open(unsigned short port) const;
+
+	private:
+		Type m_type;
+		std::string m_path;	/* socket path or abstract name */
+};
+
+#endif
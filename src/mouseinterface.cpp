@@ -19,7 +19,8 @@
 
 #include "mouseinterface.hpp"
 
-MouseInterface::MouseInterface()
+MouseInterface::MouseInterface(InputInjector& injector)
+: m_injector(injector)
 {
 	m_dev = libevdev_new();
 
@@ -29,12 +30,15 @@ MouseInterface::MouseInterface()
 	libevdev_enable_event_code(m_dev, EV_REL, REL_Y, nullptr);
 	libevdev_enable_event_code(m_dev, EV_REL, REL_HWHEEL, nullptr);
 	libevdev_enable_event_code(m_dev, EV_REL, REL_WHEEL, nullptr);
+	libevdev_enable_event_code(m_dev, EV_REL, REL_HWHEEL_HI_RES, nullptr);
+	libevdev_enable_event_code(m_dev, EV_REL, REL_WHEEL_HI_RES, nullptr);
 	libevdev_enable_event_type(m_dev, EV_KEY);
 	libevdev_enable_event_code(m_dev, EV_KEY, BTN_LEFT, nullptr);
 	libevdev_enable_event_code(m_dev, EV_KEY, BTN_MIDDLE, nullptr);
 	libevdev_enable_event_code(m_dev, EV_KEY, BTN_RIGHT, nullptr);
 
 	libevdev_uinput_create_from_device(m_dev, LIBEVDEV_UINPUT_OPEN_MANAGED, &m_uidev);
+	m_batch.SetDevice(libevdev_uinput_get_fd(m_uidev), &m_injector);
 
 	SetButtonState(LEFT, UP);
 	SetButtonState(MIDDLE, UP);
@@ -43,6 +47,8 @@ MouseInterface::MouseInterface()
 
 MouseInterface::~MouseInterface()
 {
+	Flush();
+	m_injector.Sync();
 	libevdev_uinput_destroy(m_uidev);
 	libevdev_free(m_dev);
 }
@@ -69,27 +75,76 @@ MouseInterface::MouseState MouseInterface::GetButtonState(MouseButton button) {
 	return state;
 }
 
+// Events are only queued here; they reach the device on Flush().
+
 void MouseInterface::MouseClick(MouseButton button, MouseState state) {
 	// do not relay unnecessary duplicate events
 	if (GetButtonState(button) == state) {
 		return;
 	}
 
+	// a button transition gets a frame of its own, so that a press and
+	// release queued together are not collapsed into one report
 	SetButtonState(button, state);
-	libevdev_uinput_write_event(m_uidev, EV_KEY, button, state); // != 0 - error
-	libevdev_uinput_write_event(m_uidev, EV_SYN, SYN_REPORT, 0); // != 0 - error
+	m_batch.Sync();
+	m_batch.Add(EV_KEY, button, state);
+	m_batch.Sync();
 }
 
+// Scrolls whole detents. Readers of a device with high-resolution axes
+// ignore the legacy ones, so detents are reported on both.
 void MouseInterface::MouseScroll(int dx, int dy)
 {
-	libevdev_uinput_write_event(m_uidev, EV_REL, REL_HWHEEL, dx); // != 0 - error
-	libevdev_uinput_write_event(m_uidev, EV_REL, REL_WHEEL, dy); // != 0 - error
-	libevdev_uinput_write_event(m_uidev, EV_SYN, SYN_REPORT, 0); // != 0 - error
+	MouseScrollHiRes(dx * MOUSE_HIRES_DETENT, dy * MOUSE_HIRES_DETENT);
+}
+
+// Scrolls in 120ths of a detent.
+void MouseInterface::MouseScrollHiRes(int dx, int dy)
+{
+	if (dx != 0) {
+		m_batch.Add(EV_REL, REL_HWHEEL_HI_RES, dx);
+		int detents = m_hwheel.Take(dx);
+		if (detents != 0) {
+			m_batch.Add(EV_REL, REL_HWHEEL, detents);
+		}
+	}
+	if (dy != 0) {
+		m_batch.Add(EV_REL, REL_WHEEL_HI_RES, dy);
+		int detents = m_wheel.Take(dy);
+		if (detents != 0) {
+			m_batch.Add(EV_REL, REL_WHEEL, detents);
+		}
+	}
 }
 
 void MouseInterface::MouseMove(int x, int y)
 {
-	libevdev_uinput_write_event(m_uidev, EV_REL, REL_X, x); // != 0 - error
-	libevdev_uinput_write_event(m_uidev, EV_REL, REL_Y, y); // != 0 - error
-	libevdev_uinput_write_event(m_uidev, EV_SYN, SYN_REPORT, 0); // != 0 - error
+	if (x != 0) {
+		m_batch.Add(EV_REL, REL_X, x);
+	}
+	if (y != 0) {
+		m_batch.Add(EV_REL, REL_Y, y);
+	}
+}
+
+// Lets go of any button still down and forgets partial detents, so that the
+// next session does not inherit a drag.
+void MouseInterface::ReleaseAll()
+{
+	MouseClick(LEFT, UP);
+	MouseClick(MIDDLE, UP);
+	MouseClick(RIGHT, UP);
+	m_wheel.Reset();
+	m_hwheel.Reset();
+	Flush();
+}
+
+bool MouseInterface::Flush()
+{
+	return m_batch.Flush();
+}
+
+void MouseInterface::Sync()
+{
+	m_injector.Sync();
 }
@@ -22,6 +22,18 @@
 
 #include <libevdev/libevdev-uinput.h>
 
+#include "accumulator.hpp"
+#include "eventbatch.hpp"
+#include "injector.hpp"
+
+/* high-resolution wheel axes (linux 5.0); older headers lack them */
+#ifndef REL_WHEEL_HI_RES
+#define REL_WHEEL_HI_RES 0x0b
+#endif
+#ifndef REL_HWHEEL_HI_RES
+#define REL_HWHEEL_HI_RES 0x0c
+#endif
+
 class MouseInterface
 {
 	public:
@@ -36,19 +48,32 @@ class MouseInterface
 			RIGHT = BTN_RIGHT,
 		};
 
-		MouseInterface();
+		MouseInterface(InputInjector& injector);
 		~MouseInterface();
 
 		void MouseClick(MouseButton button, MouseState state);
 		void MouseScroll(int x, int y);
+		void MouseScrollHiRes(int x, int y);
 		void MouseMove(int x, int y);
+		void ReleaseAll();
+
+		// hands queued events to the injector as a single write
+		bool Flush();
+		// waits until everything flushed so far has reached the device
+		void Sync();
 
 	private:
 		void SetButtonState(MouseButton button, MouseState state);
 		MouseInterface::MouseState GetButtonState(MouseButton button);
 
+		InputInjector& m_injector;
 		struct libevdev *m_dev;
 		struct libevdev_uinput *m_uidev;
+		InputEventBatch m_batch;
 		MouseState left, middle, right;
+
+		/* high-resolution scroll not yet reported as a legacy detent */
+		DetentAccumulator m_wheel;
+		DetentAccumulator m_hwheel;
 };
 #endif
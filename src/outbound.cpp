@@ -0,0 +1,125 @@
+/*
+   Mobile Mouse Linux Server 
+   Copyright (C) 2011 Erik Lax <erik@datahack.se>
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "outbound.hpp"
+
+#include <errno.h>
+#include <limits.h>
+#include <string>
+#include <sys/uio.h>
+
+OutboundQueue::OutboundQueue()
+: m_offset(0)
+, m_size(0)
+{
+}
+
+/* queues a copy of data */
+void OutboundQueue::Append(std::string_view data)
+{
+	if (data.empty()) {
+		return;
+	}
+	std::shared_ptr<const std::string> copy = std::make_shared<const std::string>(data);
+	Append(copy, *copy);
+}
+
+/*
+ * Parameters:
+ *   owner, keeps data alive until it is written; NULL for static data
+ *   data, queued without a copy
+ */
+void OutboundQueue::Append(const std::shared_ptr<const void>& owner, std::string_view data)
+{
+	if (data.empty()) {
+		return;
+	}
+	Segment segment;
+	segment.owner = owner;
+	segment.data = data;
+	m_segments.push_back(segment);
+	m_size += data.size();
+}
+
+/*
+ * Parameters:
+ *   fd, non-blocking socket
+ *
+ * Return Value:
+ *   bytes written, 0 if the socket takes no more for now, or -1 on error
+ */
+ssize_t OutboundQueue::Flush(int fd)
+{
+	ssize_t total = 0;
+
+	while (!m_segments.empty()) {
+		struct iovec iov[IOV_MAX];
+		int count = 0;
+		size_t requested = 0;
+		for (std::deque<Segment>::iterator i = m_segments.begin(); i != m_segments.end() && count < IOV_MAX; i++) {
+			size_t skip = count == 0 ? m_offset : 0;
+			iov[count].iov_base = (void *)(i->data.data() + skip);
+			iov[count].iov_len = i->data.size() - skip;
+			requested += iov[count].iov_len;
+			count++;
+		}
+
+		ssize_t n = writev(fd, iov, count);
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			if (errno == EAGAIN || errno == EWOULDBLOCK) {
+				break;
+			}
+			return -1;
+		}
+		total += n;
+		m_size -= (size_t)n;
+
+		/* drop what went out; a segment written in part is resumed */
+		size_t written = (size_t)n;
+		while (written > 0) {
+			size_t left = m_segments.front().data.size() - m_offset;
+			if (written < left) {
+				m_offset += written;
+				break;
+			}
+			written -= left;
+			m_segments.pop_front();
+			m_offset = 0;
+		}
+
+		/* a short write means the socket buffer is full */
+		if ((size_t)n < requested) {
+			break;
+		}
+	}
+	return total;
+}
+
+bool OutboundQueue::Empty() const
+{
+	return m_segments.empty();
+}
+
+size_t OutboundQueue::Size() const
+{
+	return m_size;
+}
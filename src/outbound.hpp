@@ -0,0 +1,61 @@
+/*
+   Mobile Mouse Linux Server 
+   Copyright (C) 2011 Erik Lax <erik@datahack.se>
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef _OUTBOUND_HPP_
+#define _OUTBOUND_HPP_
+
+#include <sys/types.h>
+#include <deque>
+#include <memory>
+#include <string_view>
+
+/* bytes a client may leave unread before the session gives up on it */
+#define OUTBOUND_MAX_BYTES (64 * 1024 * 1024)
+
+/*
+ * Data waiting to go out on a non-blocking socket. Segments either refer
+ * to memory kept alive by a shared owner (the cached clipboard, say), so
+ * that large payloads are written with writev() straight from where they
+ * are, or to a copy taken by Append(). Flush() writes as much as the
+ * socket takes and resumes partial writes on the next call.
+ */
+class OutboundQueue
+{
+	public:
+		OutboundQueue();
+
+		void Append(std::string_view data);
+		void Append(const std::shared_ptr<const void>& owner, std::string_view data);
+		ssize_t Flush(int fd);
+
+		bool Empty() const;
+		size_t Size() const;
+
+	private:
+		struct Segment {
+			std::shared_ptr<const void> owner;
+			std::string_view data;
+		};
+
+		std::deque<Segment> m_segments;
+		size_t m_offset;	/* already written from the first segment */
+		size_t m_size;
+};
+
+#endif
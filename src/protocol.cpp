@@ -0,0 +1,198 @@
+/*
+   Mobile Mouse Linux Server 
+   Copyright (C) 2011 Erik Lax <erik@datahack.se>
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "protocol.hpp"
+
+#include <array>
+#include <charconv>
+
+namespace {
+
+struct CommandName
+{
+	std::string_view name;
+	PacketCommand command;
+};
+
+constexpr CommandName commandNames[] = {
+	{ "CONNECT",    PC_CONNECT },
+	{ "SETOPTION",  PC_SETOPTION },
+	{ "CLICK",      PC_CLICK },
+	{ "MOVE",       PC_MOVE },
+	{ "SCROLL",     PC_SCROLL },
+	{ "ZOOM",       PC_ZOOM },
+	{ "KEY",        PC_KEY },
+	{ "KEYSTRING",  PC_KEYSTRING },
+	{ "GESTURE",    PC_GESTURE },
+	{ "HOTKEY",     PC_HOTKEY },
+	{ "SWITCHMODE", PC_SWITCHMODE },
+	{ "PROGRAMKEY", PC_PROGRAMKEY },
+	{ "OPENLINK",   PC_OPENLINK },
+};
+
+/* command words are hashed on length and first/last character into a
+ * small open table; BuildCommandTable() refuses to compile on collision */
+constexpr size_t COMMAND_TABLE_SIZE = 32;
+
+constexpr size_t CommandHash(std::string_view name)
+{
+	return (name.size() * 12
+			+ (unsigned char)name.front()
+			+ (unsigned char)name.back()) % COMMAND_TABLE_SIZE;
+}
+
+constexpr std::array<CommandName, COMMAND_TABLE_SIZE> BuildCommandTable()
+{
+	std::array<CommandName, COMMAND_TABLE_SIZE> table = {};
+	for (size_t i = 0; i < COMMAND_TABLE_SIZE; i++) {
+		table[i] = CommandName{ std::string_view(), PC_UNKNOWN };
+	}
+	for (const CommandName& c : commandNames) {
+		size_t h = CommandHash(c.name);
+		if (table[h].command != PC_UNKNOWN) {
+			throw "command hash collision";
+		}
+		table[h] = c;
+	}
+	return table;
+}
+
+constexpr std::array<CommandName, COMMAND_TABLE_SIZE> commandTable = BuildCommandTable();
+
+}
+
+PacketCommand LookupCommand(std::string_view name)
+{
+	if (name.empty()) {
+		return PC_UNKNOWN;
+	}
+	const CommandName& c = commandTable[CommandHash(name)];
+	return c.name == name ? c.command : PC_UNKNOWN;
+}
+
+/*
+ * Parameters:
+ *   raw, one complete packet including its \x04 terminator
+ *   packet, receives views of the command word and fields
+ *
+ * Return Value:
+ *   true if raw is a terminated packet (the command may still be PC_UNKNOWN)
+ *   false if raw is not terminated
+ *
+ * Result:
+ *   if there are more than PROTOCOL_MAX_FIELDS fields, the last field holds
+ *   the unsplit remainder of the packet
+ */
+bool ParsePacket(std::string_view raw, Packet& packet)
+{
+	if (raw.empty() || raw.back() != PROTOCOL_PACKET_TERMINATOR) {
+		return false;
+	}
+	raw.remove_suffix(1);
+
+	size_t sep = raw.find(PROTOCOL_FIELD_SEPARATOR);
+	packet.name = raw.substr(0, sep);
+	packet.command = LookupCommand(packet.name);
+	packet.count = 0;
+	packet.body = sep == std::string_view::npos ? std::string_view() : raw.substr(sep + 1);
+
+	while (sep != std::string_view::npos) {
+		size_t start = sep + 1;
+		sep = packet.count == PROTOCOL_MAX_FIELDS - 1 ? std::string_view::npos
+				: raw.find(PROTOCOL_FIELD_SEPARATOR, start);
+		packet.fields[packet.count++] = raw.substr(start, sep == std::string_view::npos ? sep : sep - start);
+	}
+
+	return true;
+}
+
+/*
+ * Parses the leading integer of field, like strtol(field, NULL, 10) would:
+ * "-3.75" yields -3 and ".5" yields 0. Returns false if field does not
+ * start with a number.
+ */
+bool ParseInt(std::string_view field, int& value)
+{
+	const char* begin = field.data();
+	const char* end = field.data() + field.size();
+	if (begin != end && *begin == '+') {
+		begin++;
+	}
+
+	std::from_chars_result r = std::from_chars(begin, end, value);
+	if (r.ec == std::errc()) {
+		return true;
+	}
+
+	/* a fraction without integer digits truncates to zero */
+	if (begin != end && *begin == '-') {
+		begin++;
+	}
+	if (r.ec == std::errc::invalid_argument && begin != end && *begin == '.') {
+		value = 0;
+		return true;
+	}
+	return false;
+}
+
+/*
+ * Parses a decimal delta such as "-3.75" or ".5" exactly into fixed point.
+ * Digits beyond MOTION_FIXED_DIGITS are truncated. Returns false if field
+ * holds anything other than an optionally signed decimal number.
+ */
+bool ParseFixed(std::string_view field, MotionFixed& value)
+{
+	size_t i = 0;
+	bool negative = false;
+	if (i < field.size() && (field[i] == '-' || field[i] == '+')) {
+		negative = field[i] == '-';
+		i++;
+	}
+
+	MotionFixed whole = 0;
+	size_t digits = 0;
+	for (; i < field.size() && field[i] >= '0' && field[i] <= '9'; i++, digits++) {
+		/* far beyond any plausible delta; refuse rather than overflow */
+		if (digits == 12) {
+			return false;
+		}
+		whole = whole * 10 + (field[i] - '0');
+	}
+
+	MotionFixed fraction = 0;
+	MotionFixed scale = MOTION_FIXED_ONE;
+	if (i < field.size() && field[i] == '.') {
+		for (i++; i < field.size() && field[i] >= '0' && field[i] <= '9'; i++, digits++) {
+			if (scale > 1) {
+				scale /= 10;
+				fraction += (field[i] - '0') * scale;
+			}
+		}
+	}
+
+	if (digits == 0 || i != field.size()) {
+		return false;
+	}
+
+	value = whole * MOTION_FIXED_ONE + fraction;
+	if (negative) {
+		value = -value;
+	}
+	return true;
+}
@@ -0,0 +1,71 @@
+/*
+   Mobile Mouse Linux Server 
+   Copyright (C) 2011 Erik Lax <erik@datahack.se>
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef _PROTOCOL_HPP_
+#define _PROTOCOL_HPP_
+
+#include <stddef.h>
+#include <string_view>
+
+#include "accumulator.hpp"
+
+/* Mobile Mouse packets are \x1e-separated fields terminated by \x04 */
+#define PROTOCOL_FIELD_SEPARATOR '\x1e'
+#define PROTOCOL_PACKET_TERMINATOR '\x04'
+#define PROTOCOL_MAX_FIELDS 8
+
+enum PacketCommand {
+	PC_UNKNOWN,
+	PC_CONNECT,
+	PC_SETOPTION,
+	PC_CLICK,
+	PC_MOVE,
+	PC_SCROLL,
+	PC_ZOOM,
+	PC_KEY,
+	PC_KEYSTRING,
+	PC_GESTURE,
+	PC_HOTKEY,
+	PC_SWITCHMODE,
+	PC_PROGRAMKEY,
+	PC_OPENLINK
+};
+
+/*
+ * A tokenized packet. All views point into the buffer the packet was parsed
+ * from, which must outlive the Packet; nothing is copied or allocated.
+ */
+struct Packet
+{
+	PacketCommand command;
+	std::string_view name;
+	std::string_view fields[PROTOCOL_MAX_FIELDS];
+	size_t count;
+
+	/* everything after the command word, up to (not including) the terminator */
+	std::string_view body;
+};
+
+PacketCommand LookupCommand(std::string_view name);
+bool ParsePacket(std::string_view raw, Packet& packet);
+
+bool ParseInt(std::string_view field, int& value);
+bool ParseFixed(std::string_view field, MotionFixed& value);
+
+#endif
@@ -0,0 +1,436 @@
+/*
+   Mobile Mouse Linux Server 
+   Copyright (C) 2011 Erik Lax <erik@datahack.se>
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "reactor.hpp"
+
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <syslog.h>
+#include <unistd.h>
+#include <stdexcept>
+#include <vector>
+
+#include "session.hpp"
+
+#define REACTOR_MAX_EVENTS 64
+
+Reactor::Reactor(Configuration& appConfig, CommandExecutor& executor, DeviceManager& devices,
+		SessionHook hook)
+: m_appConfig(appConfig)
+, m_executor(executor)
+, m_devices(devices)
+, m_hook(hook)
+, m_replies(appConfig)
+, m_cache(appConfig.getResumeTimeout())
+, m_statsTimer(-1)
+{
+	if ((m_epoll = epoll_create1(EPOLL_CLOEXEC)) < 0)
+	{
+		throw std::runtime_error("cannot create epoll instance");
+	}
+	clock_gettime(CLOCK_MONOTONIC, &m_idleSince);
+
+	if (m_appConfig.getStatsInterval() > 0)
+	{
+		if ((m_statsTimer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)) < 0)
+		{
+			close(m_epoll);
+			throw std::runtime_error("cannot create stats timer");
+		}
+
+		struct itimerspec when;
+		memset(&when, 0, sizeof when);
+		when.it_value.tv_sec = m_appConfig.getStatsInterval();
+		when.it_interval.tv_sec = m_appConfig.getStatsInterval();
+		struct epoll_event ev;
+		memset(&ev, 0, sizeof ev);
+		ev.events = EPOLLIN;
+		ev.data.fd = m_statsTimer;
+		if (timerfd_settime(m_statsTimer, 0, &when, NULL) < 0 || epoll_ctl(m_epoll, EPOLL_CTL_ADD, m_statsTimer, &ev) < 0)
+		{
+			syslog(LOG_ERR, "stats timer: %s", strerror(errno));
+		}
+	}
+
+	/* hellos wait while the devices are opened (socket activation) */
+	if (!m_devices.Ready())
+	{
+		struct epoll_event ev;
+		memset(&ev, 0, sizeof ev);
+		ev.events = EPOLLIN;
+		ev.data.fd = m_devices.GetReadyEvent();
+		if (epoll_ctl(m_epoll, EPOLL_CTL_ADD, ev.data.fd, &ev) < 0)
+		{
+			syslog(LOG_ERR, "epoll_ctl: %s", strerror(errno));
+		}
+	}
+}
+
+Reactor::~Reactor()
+{
+	while (!m_sessions.empty())
+	{
+		CloseSession(m_sessions.begin()->second);
+	}
+	if (m_statsTimer >= 0)
+		close(m_statsTimer);
+	close(m_epoll);
+}
+
+bool Reactor::AddListener(int fd)
+{
+	int flags = fcntl(fd, F_GETFL, 0);
+	if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0)
+	{
+		syslog(LOG_ERR, "fcntl: %s", strerror(errno));
+		return false;
+	}
+
+	struct epoll_event ev;
+	memset(&ev, 0, sizeof ev);
+	ev.events = EPOLLIN;
+	ev.data.fd = fd;
+	if (epoll_ctl(m_epoll, EPOLL_CTL_ADD, fd, &ev) < 0)
+	{
+		syslog(LOG_ERR, "epoll_ctl: %s", strerror(errno));
+		return false;
+	}
+
+	m_listeners.insert(fd);
+	return true;
+}
+
+void Reactor::Run()
+{
+	struct epoll_event events[REACTOR_MAX_EVENTS];
+
+	while (1)
+	{
+		int timeout = IdleWait();
+		if (timeout == 0)
+		{
+			syslog(LOG_INFO, "no clients for %u seconds; exiting", m_appConfig.getIdleTimeout());
+			return;
+		}
+
+		int n = epoll_wait(m_epoll, events, REACTOR_MAX_EVENTS, timeout);
+		if (n < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			syslog(LOG_ERR, "epoll_wait: %s", strerror(errno));
+			return;
+		}
+
+		/* a session closed by an earlier event may have had its socket or
+		 * timer number handed out again by Accept(); what the batch still
+		 * holds for that number belongs to the old session */
+		m_closed.clear();
+		for (int i = 0; i < n; i++)
+		{
+			int fd = events[i].data.fd;
+			if (m_closed.find(fd) != m_closed.end())
+				continue;
+
+			if (m_listeners.find(fd) != m_listeners.end())
+			{
+				Accept(fd);
+				continue;
+			}
+
+			if (fd == m_statsTimer)
+			{
+				uint64_t expirations;
+				if (read(fd, &expirations, sizeof expirations) > 0)
+					LogStats();
+				continue;
+			}
+
+			if (fd == m_devices.GetReadyEvent())
+			{
+				/* level-triggered: once is enough, and the hellos are still there */
+				epoll_ctl(m_epoll, EPOLL_CTL_DEL, fd, NULL);
+				for (std::map<int, MobileMouseSession*>::iterator s = m_sessions.begin(); s != m_sessions.end(); s++)
+					UpdateEvents(s->second);
+				continue;
+			}
+
+			std::map<int, MobileMouseSession*>::iterator s = m_sessions.find(fd);
+			if (s != m_sessions.end())
+			{
+				MobileMouseSession* session = s->second;
+				bool alive = true;
+				if (events[i].events & EPOLLOUT)
+					alive = session->OnWritable();
+				if (alive && (events[i].events & ~EPOLLOUT))
+				{
+					if (session->Reading())
+						alive = session->OnReadable();
+					else
+					{
+						/* not polled for input; this is a hangup or an error */
+						syslog(LOG_INFO, "[%s] disconnected (connection closed)", session->GetAddress().c_str());
+						alive = false;
+					}
+				}
+				if (alive && session->TakeWatched())
+					Watch(session);
+				if (alive && session->TakeClaim())
+				{
+					/* the older session leaves its state behind for this one */
+					TakeOver(session);
+					session->Resume();
+				}
+				if (alive)
+					UpdateEvents(session);
+				else
+					CloseSession(session);
+				continue;
+			}
+
+			s = m_watched.find(fd);
+			if (s != m_watched.end())
+			{
+				MobileMouseSession* session = s->second;
+				if (session->OnWatched(fd))
+					UpdateEvents(session);
+				else
+					CloseSession(session);
+			}
+		}
+	}
+}
+
+/*
+ * The peer as it appears in the log. IPv4 clients of a dual-stack
+ * listener (as systemd opens for ListenStream=PORT) show as IPv4.
+ */
+static std::string PeerAddress(const struct sockaddr_storage& addr)
+{
+	char text[INET6_ADDRSTRLEN];
+	if (addr.ss_family == AF_INET)
+	{
+		const struct sockaddr_in* in = (const struct sockaddr_in*)&addr;
+		if (inet_ntop(AF_INET, &in->sin_addr, text, sizeof text) != NULL)
+			return text;
+	}
+	else if (addr.ss_family == AF_INET6)
+	{
+		const struct sockaddr_in6* in6 = (const struct sockaddr_in6*)&addr;
+		if (IN6_IS_ADDR_V4MAPPED(&in6->sin6_addr))
+		{
+			if (inet_ntop(AF_INET, &in6->sin6_addr.s6_addr[12], text, sizeof text) != NULL)
+				return text;
+		}
+		else if (inet_ntop(AF_INET6, &in6->sin6_addr, text, sizeof text) != NULL)
+			return text;
+	}
+	else if (addr.ss_family == AF_UNIX)
+	{
+		/* clients of a Unix listener are a local forwarder */
+		return "local";
+	}
+	return "unknown";
+}
+
+void Reactor::Accept(int listener)
+{
+	/* drain the backlog; the listener is non-blocking */
+	while (1)
+	{
+		struct sockaddr_storage caddr;
+		socklen_t clen = sizeof caddr;
+
+		int client = accept4(listener, (struct sockaddr *)&caddr, &clen, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (client < 0)
+		{
+			if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+			{
+				syslog(LOG_WARNING, "accept failed: %s", strerror(errno));
+			}
+			return;
+		}
+
+		std::string address = PeerAddress(caddr);
+
+		MobileMouseSession* session;
+		try {
+			session = new MobileMouseSession(m_appConfig, m_executor, m_devices, m_cache, m_replies,
+					client, address);
+		}
+		catch (const std::runtime_error &err) {
+			syslog(LOG_WARNING, "[%s] rejected (%s)", address.c_str(), err.what());
+			close(client);
+			continue;
+		}
+
+		struct epoll_event ev;
+		memset(&ev, 0, sizeof ev);
+		ev.events = EPOLLIN | EPOLLRDHUP;
+		ev.data.fd = client;
+		if (epoll_ctl(m_epoll, EPOLL_CTL_ADD, client, &ev) < 0)
+		{
+			syslog(LOG_WARNING, "epoll_ctl: %s", strerror(errno));
+			delete session;
+			continue;
+		}
+
+		m_sessions[client] = session;
+		Watch(session);
+		UpdateEvents(session);
+		if (m_hook)
+			m_hook(*session, true, m_sessions.size());
+	}
+}
+
+/* adds the session's watched descriptors that are not watched yet */
+void Reactor::Watch(MobileMouseSession* session)
+{
+	std::vector<int> watched;
+	session->GetWatched(watched);
+	for (std::vector<int>::iterator w = watched.begin(); w != watched.end(); w++)
+	{
+		if (m_watched.find(*w) != m_watched.end())
+			continue;
+
+		struct epoll_event ev;
+		memset(&ev, 0, sizeof ev);
+		ev.events = EPOLLIN;
+		ev.data.fd = *w;
+		if (epoll_ctl(m_epoll, EPOLL_CTL_ADD, *w, &ev) < 0)
+		{
+			syslog(LOG_WARNING, "epoll_ctl: %s", strerror(errno));
+			continue;
+		}
+		m_watched[*w] = session;
+	}
+}
+
+/* asks for EPOLLOUT while the session has output queued, and only then;
+ * and for input only while the session is Reading() */
+void Reactor::UpdateEvents(MobileMouseSession* session)
+{
+	int fd = session->GetSocket();
+	bool writing = session->Writing();
+	bool waiting = !session->Reading();
+	if (writing == (m_writing.count(fd) > 0) && waiting == (m_waiting.count(fd) > 0))
+		return;
+
+	struct epoll_event ev;
+	memset(&ev, 0, sizeof ev);
+	if (!waiting)
+		ev.events = EPOLLIN | EPOLLRDHUP;
+	if (writing)
+		ev.events |= EPOLLOUT;
+	ev.data.fd = fd;
+	if (epoll_ctl(m_epoll, EPOLL_CTL_MOD, fd, &ev) < 0)
+	{
+		syslog(LOG_WARNING, "epoll_ctl: %s", strerror(errno));
+		return;
+	}
+	if (writing)
+		m_writing.insert(fd);
+	else
+		m_writing.erase(fd);
+	if (waiting)
+		m_waiting.insert(fd);
+	else
+		m_waiting.erase(fd);
+}
+
+/*
+ * Return Value:
+ *   milliseconds until the idle timeout runs out, 0 if it has, or -1
+ *   while there are sessions or no timeout is configured
+ */
+int Reactor::IdleWait() const
+{
+	if (!m_sessions.empty() || m_appConfig.getIdleTimeout() == 0)
+		return -1;
+
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	long elapsed = (now.tv_sec - m_idleSince.tv_sec) * 1000L + (now.tv_nsec - m_idleSince.tv_nsec) / 1000000L;
+	long left = (long)m_appConfig.getIdleTimeout() * 1000L - elapsed;
+	return left > 0 ? (int)left : 0;
+}
+
+/* how busy each stage has been since the last time */
+void Reactor::LogStats()
+{
+	for (std::map<int, MobileMouseSession*>::iterator s = m_sessions.begin(); s != m_sessions.end(); s++)
+		s->second->LogStats();
+	m_devices.LogStats();
+	m_executor.GetStats().Log("command");
+}
+
+/* closes the other sessions of the device that just logged in on session */
+void Reactor::TakeOver(MobileMouseSession* session)
+{
+	std::vector<MobileMouseSession*> stale;
+	for (std::map<int, MobileMouseSession*>::iterator s = m_sessions.begin(); s != m_sessions.end(); s++)
+	{
+		if (s->second != session && s->second->GetDeviceId() == session->GetDeviceId())
+			stale.push_back(s->second);
+	}
+
+	for (std::vector<MobileMouseSession*>::iterator s = stale.begin(); s != stale.end(); s++)
+	{
+		syslog(LOG_INFO, "[%s] disconnected (taken over by %s)", (*s)->GetAddress().c_str(),
+				session->GetAddress().c_str());
+		CloseSession(*s);
+	}
+
+	/* whatever the device held down is not coming back up */
+	if (!stale.empty())
+		m_devices.Reset();
+}
+
+void Reactor::CloseSession(MobileMouseSession* session)
+{
+	int fd = session->GetSocket();
+	epoll_ctl(m_epoll, EPOLL_CTL_DEL, fd, NULL);
+	m_sessions.erase(fd);
+	m_writing.erase(fd);
+	m_waiting.erase(fd);
+	m_closed.insert(fd);
+
+	std::vector<int> watched;
+	session->GetWatched(watched);
+	for (std::vector<int>::iterator w = watched.begin(); w != watched.end(); w++)
+	{
+		epoll_ctl(m_epoll, EPOLL_CTL_DEL, *w, NULL);
+		m_watched.erase(*w);
+		m_closed.insert(*w);
+	}
+
+	if (m_sessions.empty())
+		clock_gettime(CLOCK_MONOTONIC, &m_idleSince);
+
+	if (m_hook)
+		m_hook(*session, false, m_sessions.size());
+
+	/* the session owns its socket and closes it */
+	delete session;
+}
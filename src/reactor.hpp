@@ -0,0 +1,88 @@
+/*
+   Mobile Mouse Linux Server 
+   Copyright (C) 2011 Erik Lax <erik@datahack.se>
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef _REACTOR_HPP_
+#define _REACTOR_HPP_
+
+#include <stdint.h>
+#include <time.h>
+#include <map>
+#include <set>
+#include <string>
+
+#include "configuration.hpp"
+#include "executor.hpp"
+#include "devices.hpp"
+#include "handshake.hpp"
+#include "sessioncache.hpp"
+
+class MobileMouseSession;
+
+/*
+ * Single-threaded epoll loop that owns the listening socket(s) and every
+ * session socket. Sockets are non-blocking; each session is driven as a
+ * state machine from OnReadable() instead of holding a thread in read().
+ * A session's timers are watched alongside its socket, which is polled for
+ * writing only while it has output queued. A device that logs in again
+ * takes over from its earlier session, which is closed at once rather
+ * than left for TCP to give up on. Hellos that arrive before the devices
+ * are open are left unread until they are. With server.idleTimeout set, Run()
+ * returns once there has been no session for that long. Every
+ * server.statsInterval seconds the stage statistics are logged.
+ */
+class Reactor
+{
+	public:
+		/* invoked whenever a session starts or ends */
+		typedef void (*SessionHook)(const MobileMouseSession& session, bool connected, size_t active);
+
+		Reactor(Configuration& appConfig, CommandExecutor& executor, DeviceManager& devices,
+				SessionHook hook = NULL);
+		~Reactor();
+
+		bool AddListener(int fd);
+		void Run();
+
+	private:
+		void Accept(int listener);
+		void Watch(MobileMouseSession* session);
+		void UpdateEvents(MobileMouseSession* session);
+		void CloseSession(MobileMouseSession* session);
+		void TakeOver(MobileMouseSession* session);
+		int IdleWait() const;
+		void LogStats();
+
+		Configuration& m_appConfig;
+		CommandExecutor& m_executor;
+		DeviceManager& m_devices;
+		SessionHook m_hook;
+		HandshakeReplies m_replies;	/* outlives every session */
+		SessionCache m_cache;
+		int m_epoll;
+		int m_statsTimer;	/* -1 without server.statsInterval */
+		std::set<int> m_listeners;
+		std::map<int, MobileMouseSession*> m_sessions;	/* by socket */
+		std::map<int, MobileMouseSession*> m_watched;	/* by timer or X connection */
+		std::set<int> m_writing;	/* sockets polled for EPOLLOUT */
+		std::set<int> m_waiting;	/* sockets not polled for input; see Reading() */
+		std::set<int> m_closed;	/* closed while handling the current batch */
+		struct timespec m_idleSince;	/* when the last session ended */
+};
+
+#endif
@@ -24,8 +24,13 @@
 #include <syslog.h>
 #include <memory.h>
 #include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include <sys/stat.h>
 #include <linux/limits.h>
+#include <memory>
+#include <stdexcept>
+#include <vector>
 
 #define TOOLBAR_ICON
 #ifdef TOOLBAR_ICON
@@ -36,6 +41,8 @@
 #define PREFERENCES_EDITOR "xdg-open"
 
 void* GTKStartup(void *arg);
+class MobileMouseSession;
+void TraySessionHook(const MobileMouseSession& session, bool connected, size_t active);
 GtkStatusIcon* tray = NULL;
 GdkPixbuf *idle_icon, *connected_icon;
 #endif
@@ -43,22 +50,43 @@ GdkPixbuf *idle_icon, *connected_icon;
 #define DEFAULT_CONFIG "/usr/share/mmserver/mmserver.conf"
 #define USER_CONFIG_DIR ".mmserver"
 
+#include <X11/Xlib.h>
 #include <libconfig.h++>
 #include "configuration.hpp"
 #include "avahi.hpp"
 #include "session.hpp"
+#include "reactor.hpp"
 
 #include "version.hpp.in"
 
 int _argc;
 char** _argv;
 
+/* descriptors passed by systemd socket activation start here (sd_listen_fds(3)) */
+#define SD_LISTEN_FDS_START 3
+
+/* what StartDesktop() brings up, possibly only once the first client is in */
+struct DesktopStartup {
+	Configuration* appConfig;
+	bool zeroconf;
+	char* preferences;
+	bool started;
+};
+static DesktopStartup startup = { NULL, false, NULL, false };
+
+std::vector<int> ActivationListeners();
+void StartDesktop();
+void StartupSessionHook(const MobileMouseSession& session, bool connected, size_t active);
+
 bool CheckUserConfig(char *fpath, size_t fpathlen);
 bool CheckSystemConfig(char *fpath, size_t fpathlen);
 bool FileExists(const char *filePath);
 
 int main(int argc, char* argv[])
 {
+	/* the tray icon and the X thread both use Xlib */
+	XInitThreads();
+
 	signal(SIGPIPE, SIG_IGN);
 	char path[PATH_MAX];
 	bool foundConfig = false;
@@ -115,95 +143,137 @@ int main(int argc, char* argv[])
 		syslog(LOG_INFO, "keyboard input ignored");
 	}
 
-	syslog(LOG_INFO, "started on port %d", appConfig.getPort());
-	daemon(1, 1);
+	/* started by systemd for a client that is already waiting? */
+	std::vector<int> listeners = ActivationListeners();
+	bool activated = !listeners.empty();
 
-	if (appConfig.getZeroconf()) {
-		StartAvahi(appConfig);
+	std::vector<ListenEndpoint> endpoints = appConfig.getListen();
+	bool tcp = activated;
+	if (activated) {
+		syslog(LOG_INFO, "started by socket activation (%lu sockets)", (unsigned long)listeners.size());
+	} else {
+		for (std::vector<ListenEndpoint>::iterator i = endpoints.begin(); i != endpoints.end(); i++) {
+			syslog(LOG_INFO, "started on %s", i->Describe(appConfig.getPort()).c_str());
+			tcp = tcp || i->GetType() == ListenEndpoint::LE_TCP;
+		}
+		daemon(1, 1);
 	}
-	
+
+	/* input devices and X connections live as long as the server; a client
+	 * that reconnects finds them already set up. They open in the background
+	 * while the rest starts up. */
+	DeviceManager devices(appConfig);
+
 	/* bind.. */
-	struct sockaddr_in serv_addr;
-	bzero((char *)&serv_addr, sizeof serv_addr);
-	serv_addr.sin_family = AF_INET;
-	serv_addr.sin_addr.s_addr = INADDR_ANY;
-	serv_addr.sin_port = htons(appConfig.getPort());
-
-	/* setup network.. */
-	int sockfd = socket(AF_INET, SOCK_STREAM, 0);
-	if (sockfd < 0)
-	{
-		syslog(LOG_ERR, "socket: %s", strerror(errno));
-		exit(1);
+	if (!activated) {
+		for (std::vector<ListenEndpoint>::iterator i = endpoints.begin(); i != endpoints.end(); i++) {
+			int sockfd = i->Open(appConfig.getPort());
+			if (sockfd < 0) {
+				exit(1);
+			}
+			listeners.push_back(sockfd);
+		}
 	}
 
-	int optval = 1;
-	if (setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, &optval, sizeof optval) < 0)
-	{
-		syslog(LOG_ERR, "setsockopt: %s", strerror(errno));
-		exit(1);
-	}
+	/* only the TCP port can be found by phones on the network */
+	startup.appConfig = &appConfig;
+	startup.zeroconf = appConfig.getZeroconf() && tcp;
+#ifdef TOOLBAR_ICON
+	startup.preferences = userConfig ? path : NULL;
+#endif
 
-	if (bind(sockfd, (struct sockaddr *)&serv_addr, sizeof serv_addr) < 0)
-	{
-		syslog(LOG_ERR, "bind: %s", strerror(errno));
-		exit(1);
+	/* when activated, a client is waiting: serve it first, and bring up
+	 * the tray icon and zeroconf beside its session */
+	if (!activated) {
+		StartDesktop();
 	}
 
-	if (listen(sockfd, 1) < 0)
-	{
-		syslog(LOG_ERR, "listen: %s", strerror(errno));
-		exit(1);
-	}
+	/* hotkey commands run beside the server loop */
+	CommandExecutor executor(appConfig.getCommandConcurrency(), appConfig.getCommandTimeout());
 
-#ifdef TOOLBAR_ICON
-	pthread_t toolbarpid;
-	if (pthread_create(&toolbarpid, 0x0, GTKStartup, (void*)(userConfig ? path : NULL)) == -1)
-	{
-		syslog(LOG_WARNING, "pthread_create failed: %s", strerror(errno));
+	/* a server started by hand fails at once if it cannot inject */
+	if (!activated) {
+		try {
+			devices.Wait();
+		}
+		catch (const std::runtime_error&) {
+			/* logged by the devices */
+			exit(1);
+		}
 	}
-#endif
 
 	/* server loop.. */
-	while(1)
+	Reactor reactor(appConfig, executor, devices, StartupSessionHook);
+	for (std::vector<int>::iterator i = listeners.begin(); i != listeners.end(); i++)
 	{
-		struct sockaddr_in caddr;
-		int clen = sizeof caddr;
-
-		/* accept client.. */
-		int client = accept(sockfd, (struct sockaddr *)&caddr, (socklen_t*)&clen);
-		if (client < 0)
+		if (!reactor.AddListener(*i))
 		{
-			syslog(LOG_WARNING, "accept failed: %s", strerror(errno));
-			continue;
+			exit(1);
 		}
+	}
+	reactor.Run();
 
-		/* start new session.. */
-		SessionContext * clientContext = new SessionContext(appConfig,
-				client,
-				inet_ntoa(caddr.sin_addr));
+	return 0;
+}
 
-#ifdef TOOLBAR_ICON
-		gtk_status_icon_set_tooltip(tray, std::string(clientContext->m_address + " connected").c_str());
-		gtk_status_icon_set_from_pixbuf(tray, connected_icon);
-#endif
+/*
+ * Return Value:
+ *   the listening sockets systemd passed to this process, if it did
+ */
+std::vector<int> ActivationListeners()
+{
+	std::vector<int> fds;
+	const char* pid = getenv("LISTEN_PID");
+	const char* count = getenv("LISTEN_FDS");
+	if (pid == NULL || count == NULL || (pid_t)atol(pid) != getpid()) {
+		return fds;
+	}
 
-		pthread_t pid;
-		if (pthread_create(&pid, 0x0, MobileMouseSession, (void*)clientContext) == -1)
-		{
-			syslog(LOG_WARNING, "pthread_create failed: %s", strerror(errno));
-			delete clientContext;
-			close(client);
-		} else 
-			pthread_join(pid, 0x0);
+	int n = atoi(count);
+	for (int fd = SD_LISTEN_FDS_START; fd < SD_LISTEN_FDS_START + n; fd++) {
+		/* not for the hotkey commands we spawn */
+		fcntl(fd, F_SETFD, FD_CLOEXEC);
+		fds.push_back(fd);
+	}
+
+	unsetenv("LISTEN_PID");
+	unsetenv("LISTEN_FDS");
+	unsetenv("LISTEN_FDNAMES");
+	return fds;
+}
+
+/* zeroconf and the tray icon, each on a thread of its own; only the first call counts */
+void StartDesktop()
+{
+	if (startup.started) {
+		return;
+	}
+	startup.started = true;
+
+	if (startup.zeroconf) {
+		StartAvahi(*startup.appConfig);
+	}
 
 #ifdef TOOLBAR_ICON
-		gtk_status_icon_set_tooltip(tray, TOOLBAR_LABEL_DEFAULT);
-		gtk_status_icon_set_from_pixbuf(tray, idle_icon);
-#endif
+	pthread_t toolbarpid;
+	if (pthread_create(&toolbarpid, 0x0, GTKStartup, (void*)startup.preferences) == -1)
+	{
+		syslog(LOG_WARNING, "pthread_create failed: %s", strerror(errno));
 	}
+#endif
+}
 
-	return 0;
+void StartupSessionHook(const MobileMouseSession& session, bool connected, size_t active)
+{
+	if (connected) {
+		StartDesktop();
+	}
+#ifdef TOOLBAR_ICON
+	TraySessionHook(session, connected, active);
+#else
+	(void)session;
+	(void)active;
+#endif
 }
 
 /*
@@ -281,6 +351,21 @@ bool FileExists(const char *filePath) {
 }
 
 #ifdef TOOLBAR_ICON
+void TraySessionHook(const MobileMouseSession& session, bool connected, size_t active)
+{
+	if (tray == NULL) {
+		return;
+	}
+
+	if (connected) {
+		gtk_status_icon_set_tooltip(tray, std::string(session.GetAddress() + " connected").c_str());
+		gtk_status_icon_set_from_pixbuf(tray, connected_icon);
+	} else if (active == 0) {
+		gtk_status_icon_set_tooltip(tray, TOOLBAR_LABEL_DEFAULT);
+		gtk_status_icon_set_from_pixbuf(tray, idle_icon);
+	}
+}
+
 void GTKTrayAbout(GtkMenuItem* item __attribute__((unused)), gpointer uptr __attribute__((unused))) 
 {
 	const gchar* authors[] = { "Erik Lax <erik@datahack.se>\nhttp://sourceforge.net/projects/mmlinuxserver/\n\nKiriakos Krastillis\nhttp://github.com/kiriakos/mmserver\n\nJim DeVona\nhttp://github.com/anoved/mmserver", NULL }; 
@@ -20,838 +20,1358 @@
 #include "session.hpp"
 
 #include <stdio.h>
+#include <string.h>
+#include <ctype.h>
 #include <sys/time.h>
+#include <time.h>
 #include <errno.h>
 #include <syslog.h>
 #include <unistd.h>
 #include <math.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdexcept>
 
 #include <X11/Xlib.h>
 #include <X11/keysym.h>
 #include <X11/XF86keysym.h>
 #include <X11/extensions/XTest.h> 
-#include <iconv.h>
-
-#include <pcrecpp.h>
 
 #include "keyboardinterface.hpp"
 #include "mouseinterface.hpp"
 #include "clipboardinterface.hpp"
 #include "utils.hpp"
+#include "protocol.hpp"
+#include "utf8.hpp"
+
+/* CLIPBOARDUPDATE wraps the clipboard text; it is sent between these */
+static const std::string_view CLIPBOARD_HEADER("CLIPBOARDUPDATE\x1e" "TEXT\x1f");
+static const std::string_view CLIPBOARD_TRAILER("\x04");
 
 // pushes keysyms for any modifier keys named in `modifiers` onto the end of `keys`
-void SetModKeys(const std::string& modifiers, std::list<int>& keys) {
-	std::list<std::string> modlist = SplitString(modifiers, '+');
-	for (std::list<std::string>::const_iterator i = modlist.begin(); i != modlist.end(); i++) {
-		if (*i == "CTRL") {
+void SetModKeys(std::string_view modifiers, std::list<int>& keys) {
+	while (!modifiers.empty()) {
+		size_t plus = modifiers.find('+');
+		std::string_view mod = modifiers.substr(0, plus);
+		modifiers.remove_prefix(plus == std::string_view::npos ? modifiers.size() : plus + 1);
+
+		if (mod == "CTRL") {
 			keys.push_back(XK_Control_L);
 		}
-		if (*i == "OPT") {
+		if (mod == "OPT") {
 			keys.push_back(XK_Super_L);
 		}
-		if (*i == "ALT") {
+		if (mod == "ALT") {
 			keys.push_back(XK_Alt_L);
 		}
-		if (*i == "SHIFT") {
+		if (mod == "SHIFT") {
 			keys.push_back(XK_Shift_L);
 		}
 		// consider logging any unhandled tokens
 	}
 }
 
-/*
- * Parameters:
- *   command, string containing command to execute (unless recognized as special control code)
- *   clip, reference to the clipboard interface
- *   client, for use by any control codes that need to communicate with the client app
- * 
- * Return:
- *   2 if a memory allocation or string operation failed
- *   1 if error occurred communicating with client
- *   0 otherwise
- */
-int InvokeCommand(const std::string command, ClipboardInterface& clip, int client) {
-	
-	if (command.empty()) {
-		return 0;
+MobileMouseSession::MobileMouseSession(Configuration& appConfig, CommandExecutor& executor,
+		DeviceManager& devices, SessionCache& cache, const HandshakeReplies& replies,
+		int sock, const std::string& address)
+: m_appConfig(appConfig)
+, m_executor(executor)
+, m_cache(cache)
+, m_replies(replies)
+, m_sock(sock)
+, m_tcp(true)
+, m_address(address)
+, m_state(SS_HANDSHAKE)
+, m_handshakeTimer(-1)
+, m_claim(false)
+, m_devices(devices)
+, m_mouse(NULL)
+, m_keyboard(NULL)
+, m_clipboard(NULL)
+, m_watcher(NULL)
+, m_typing(appConfig.getKeyboardTypingRate())
+, m_clipboardEvents(-1)
+, m_watch(false)
+, m_clipboardSync(false)
+, m_clipboardSent(ClipboardWatcher::Hash(""))
+, m_received()
+, m_pendingMove(false)
+, m_pendingScroll(false)
+, m_moveX(0)
+, m_moveY(0)
+, m_moveTime()
+, m_scrollX(0)
+, m_scrollY(0)
+, m_backlogged(false)
+, m_motionMerged(0)
+, m_motionFolded(0)
+, m_moved(false)
+, m_accelerator(appConfig.getMouseAccelerationCurve())
+, m_windowMode(WM_OTHER)
+, m_presentationStatus(PS_STOPPED)
+{
+	/* a client that connects but never logs in is not kept around */
+	if (m_appConfig.getHandshakeTimeout() > 0) {
+		if ((m_handshakeTimer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)) < 0) {
+			throw std::runtime_error("cannot create handshake timer");
+		}
+		struct itimerspec when;
+		memset(&when, 0, sizeof(when));
+		when.it_value.tv_sec = m_appConfig.getHandshakeTimeout();
+		if (timerfd_settime(m_handshakeTimer, 0, &when, NULL) < 0) {
+			syslog(LOG_ERR, "timerfd_settime: %s", strerror(errno));
+		}
 	}
-	
-	/* special case commands */
-	if (command.compare("SYNC_CLIPBOARD") == 0) {
-		char *message = NULL;
-		const char *content = NULL;
-		
-		clip.Update();
-		content = clip.GetCStr();
-		
-		/*
-		15 - CLIPBOARDUPDATE
-		4  - TEXT
-		3  - (control bytes)
-		1  - (null end byte)
-		--------------------
-		23 - (message setup)
-		*/
-		
-		if ((message = (char *)malloc(23 + strlen(content))) == NULL) {
-			return 1;
+
+	syslog(LOG_INFO, "[%s] connected", m_address.c_str());
+	clock_gettime(CLOCK_MONOTONIC, &m_connected);
+
+	/* kernel receive times give the pointer speed as the packets were sent,
+	 * not as they were read; without them the framer stamps each read */
+	int on = 1;
+	if (setsockopt(m_sock, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on)) != 0) {
+		syslog(LOG_ERR, "[%s] setsockopt(SO_TIMESTAMPNS) failed: %s", m_address.c_str(), strerror(errno));
+	}
+
+	TuneSocket();
+}
+
+MobileMouseSession::~MobileMouseSession()
+{
+	/* kept for the device to come back to */
+	if (!m_deviceId.empty()) {
+		SessionSnapshot state;
+		state.windowMode = m_windowMode;
+		state.presentationStatus = m_presentationStatus;
+		state.clipboardSync = m_clipboardSync;
+		state.clipboardSent = m_clipboardSent;
+		state.pointer = m_pointer;
+		state.scroll = m_scroll;
+		m_cache.Store(m_deviceId, state);
+	}
+
+	if (m_keyboard != NULL) {
+		m_typing.Cancel(*m_keyboard);
+	}
+	if (m_clipboardEvents >= 0) {
+		m_watcher->Unsubscribe(m_clipboardEvents);
+	}
+	if (m_handshakeTimer >= 0) {
+		close(m_handshakeTimer);
+	}
+	close(m_sock);
+	if (m_appConfig.getDebug()) {
+		LogStats();
+		m_devices.LogStats();
+		m_executor.GetStats().Log("command");
+	}
+	syslog(LOG_INFO, "[%s] session ended", m_address.c_str());
+}
+
+/* what the session has read and merged since the last call */
+void MobileMouseSession::LogStats()
+{
+	if (m_motionMerged > 0 || m_motionFolded > 0) {
+		syslog(LOG_INFO, "[%s] motion events merged: %lu, folded under backlog: %lu", m_address.c_str(),
+				m_motionMerged, m_motionFolded);
+		m_motionMerged = m_motionFolded = 0;
+	}
+	m_readStats.Log(("[" + m_address + "] read").c_str());
+}
+
+int MobileMouseSession::GetSocket() const
+{
+	return m_sock;
+}
+
+/* descriptors besides the socket that need OnWatched() */
+void MobileMouseSession::GetWatched(std::vector<int>& fds) const
+{
+	fds.push_back(m_typing.GetTimer());
+	if (m_clipboardEvents >= 0) {
+		fds.push_back(m_clipboardEvents);
+	}
+	if (m_handshakeTimer >= 0) {
+		fds.push_back(m_handshakeTimer);
+	}
+}
+
+/* applies server.peerTimeout, latencyMode, busyPoll, dscp and priority to TCP
+ * clients; failures are logged, not fatal */
+void MobileMouseSession::TuneSocket()
+{
+	int on = 1;
+
+	int domain;
+	socklen_t len = sizeof(domain);
+	if (getsockopt(m_sock, SOL_SOCKET, SO_DOMAIN, &domain, &len) == 0 && domain == AF_UNIX) {
+		m_tcp = false;
+		return;
+	}
+
+	/* probe an idle client a few times within peerTimeout, and give up on
+	 * unacknowledged output after as long */
+	unsigned int timeout = m_appConfig.getPeerTimeout();
+	if (timeout > 0) {
+		int interval = (int)(timeout + 3) / 4;
+		int probes = 3;
+		unsigned int userTimeout = timeout * 1000;
+		if (setsockopt(m_sock, SOL_SOCKET, SO_KEEPALIVE, &on, sizeof(on)) != 0 ||
+				setsockopt(m_sock, IPPROTO_TCP, TCP_KEEPIDLE, &interval, sizeof(interval)) != 0 ||
+				setsockopt(m_sock, IPPROTO_TCP, TCP_KEEPINTVL, &interval, sizeof(interval)) != 0 ||
+				setsockopt(m_sock, IPPROTO_TCP, TCP_KEEPCNT, &probes, sizeof(probes)) != 0) {
+			syslog(LOG_ERR, "[%s] setsockopt(SO_KEEPALIVE) failed: %s", m_address.c_str(), strerror(errno));
 		}
-		
-		strcpy(message, "CLIPBOARDUPDATE\x1e" "TEXT\x1f");
-		strcat(message, content);
-		strcat(message, "\x04");
-		
-		syslog(LOG_INFO, "clipboard update message length: %ld", (unsigned long)strlen(message));
-		
-		if (write(client, (const char*)message, strlen(message)) < 1) {
-			free(message);
-			return 2;
+		if (setsockopt(m_sock, IPPROTO_TCP, TCP_USER_TIMEOUT, &userTimeout, sizeof(userTimeout)) != 0) {
+			syslog(LOG_ERR, "[%s] setsockopt(TCP_USER_TIMEOUT) failed: %s", m_address.c_str(), strerror(errno));
 		}
-		
-		free(message);
 	}
-	else {
-		
-		/* interpret all other commands literally */
-		system(command.c_str());
+
+	if (m_appConfig.getLatencyMode()) {
+		if (setsockopt(m_sock, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on)) != 0) {
+			syslog(LOG_ERR, "[%s] setsockopt(TCP_NODELAY) failed: %s", m_address.c_str(), strerror(errno));
+		}
+		QuickAck();
 	}
-	
-	return 0;
+
+	int busyPoll = (int)m_appConfig.getBusyPoll();
+	if (busyPoll > 0 && setsockopt(m_sock, SOL_SOCKET, SO_BUSY_POLL, &busyPoll, sizeof(busyPoll)) != 0) {
+		syslog(LOG_ERR, "[%s] setsockopt(SO_BUSY_POLL) failed: %s", m_address.c_str(), strerror(errno));
+	}
+
+	/* DSCP is the upper six bits of the TOS byte */
+	int dscp = m_appConfig.getDscp();
+	int tos = dscp << 2;
+	if (dscp >= 0 && setsockopt(m_sock, IPPROTO_IP, IP_TOS, &tos, sizeof(tos)) != 0) {
+		syslog(LOG_ERR, "[%s] setsockopt(IP_TOS) failed: %s", m_address.c_str(), strerror(errno));
+	}
+
+	/* after IP_TOS, which resets the priority to its own mapping */
+	int priority = m_appConfig.getSocketPriority();
+	if (priority >= 0 && setsockopt(m_sock, SOL_SOCKET, SO_PRIORITY, &priority, sizeof(priority)) != 0) {
+		syslog(LOG_ERR, "[%s] setsockopt(SO_PRIORITY) failed: %s", m_address.c_str(), strerror(errno));
+	}
+}
+
+/* the kernel drops back to delayed acks on its own, so this is redone after every read */
+void MobileMouseSession::QuickAck()
+{
+	int on = 1;
+	if (setsockopt(m_sock, IPPROTO_TCP, TCP_QUICKACK, &on, sizeof(on)) != 0) {
+		syslog(LOG_ERR, "[%s] setsockopt(TCP_QUICKACK) failed: %s", m_address.c_str(), strerror(errno));
+	}
+}
+
+const std::string& MobileMouseSession::GetAddress() const
+{
+	return m_address;
+}
+
+const std::string& MobileMouseSession::GetDeviceId() const
+{
+	return m_deviceId;
 }
 
-void* MobileMouseSession(void* context)
+/*
+ * Return Value:
+ *   true once after the client logged in with a device id of its own
+ */
+bool MobileMouseSession::TakeClaim()
 {
-	Configuration& appConfig = static_cast<SessionContext*>(context)->m_appConfig;
-	int client = static_cast<SessionContext*>(context)->m_sock;
-	std::string address = static_cast<SessionContext*>(context)->m_address;
-	delete static_cast<SessionContext*>(context);
+	bool claim = m_claim;
+	m_claim = false;
+	return claim;
+}
 
-	MouseInterface mousePointer;
-	KeyboardInterface keyBoard(appConfig.getKeyboardEnabled());
-	ClipboardInterface clipboard;
+/*
+ * Return Value:
+ *   true once after logging in added descriptors to GetWatched()
+ */
+bool MobileMouseSession::TakeWatched()
+{
+	bool watch = m_watch;
+	m_watch = false;
+	return watch;
+}
 
-	syslog(LOG_INFO, "[%s] connected", address.c_str());
+/* whether the reactor should report OnReadable(); a hello is left unread
+ * until the devices it would lease have been opened */
+bool MobileMouseSession::Reading() const
+{
+	return m_state != SS_HANDSHAKE || m_devices.Ready();
+}
 
-	char buffer[1024];
-	ssize_t n;
+bool MobileMouseSession::OnReadable()
+{
+	if (m_state == SS_REJECTED)
+	{
+		/* rejected client has had its answer; whatever it does next ends the session */
+		return false;
+	}
 
-	n = read(client, buffer, sizeof(buffer));
+	struct timespec start = StageClock();
+	ssize_t n = m_framer.Fill(m_sock);
+	if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+	{
+		/* spurious wakeup */
+		return true;
+	}
 	if (n < 1)
 	{
-		syslog(LOG_INFO, "[%s] disconnected (connection failed: %s)", address.c_str(), strerror(errno));
-		if (appConfig.getDebug()) {
-			dumpPacket(buffer);
+		syslog(LOG_INFO, "[%s] disconnected (%s failed: %s)", m_address.c_str(),
+				m_state == SS_HANDSHAKE ? "connection" : "read",
+				n == 0 ? "connection closed" : strerror(errno));
+		return false;
+	}
+
+	if (m_tcp && m_appConfig.getLatencyMode()) {
+		QuickAck();
+	}
+
+	/* if the connection still holds a backlog after this read, the motion
+	 * just read is summed with what is waiting behind it and goes out as
+	 * one move once the server has caught up */
+	m_backlogged = false;
+	if (m_appConfig.getMouseBacklogLimit() > 0)
+	{
+		int waiting = 0;
+		if (ioctl(m_sock, FIONREAD, &waiting) == 0 && waiting > m_appConfig.getMouseBacklogLimit())
+		{
+			m_backlogged = true;
+		}
+	}
+
+	/* the hello may arrive in pieces, or together with the first packets */
+	std::string_view packet;
+	size_t packets = 0;
+	while (m_framer.Next(packet, m_received))
+	{
+		packets++;
+		bool alive;
+		switch (m_state)
+		{
+			case SS_HANDSHAKE:
+				alive = HandleHello(packet);
+				break;
+			case SS_ACTIVE:
+				alive = HandlePacket(packet);
+				break;
+			case SS_REJECTED:
+			default:
+				/* ignore anything sent after rejection; wait for the hangup */
+				return true;
+		}
+		if (!alive)
+		{
+			return false;
 		}
-		close(client);
-		return NULL;
 	}
-	buffer[n] = '\0';
 
-	/* hello */
-	std::string password, id, name;
-	if (!pcrecpp::RE("CONNECT\x1e(.*?)\x1e(.*?)\x1e(.*?)\x1e(?:.*)\x04").FullMatch(buffer,
-				&password, &id, &name))
+	/* commit the pointer events of this read in one write; behind a
+	 * backlog the folded motion waits for the next read */
+	if (!m_backlogged)
+	{
+		FlushMotion();
+	}
+	if (m_mouse != NULL) {
+		m_mouse->Flush();
+	}
+	m_readStats.Record(start, packets);
+
+	if (m_framer.Full())
 	{
-		syslog(LOG_INFO, "[%s] disconnected (invalid protocol)", address.c_str());
+		syslog(LOG_INFO, "[%s] disconnected (packet exceeds %d bytes)", m_address.c_str(), FRAMER_CAPACITY);
+		return false;
+	}
+	return true;
+}
+
+/* the socket takes data again; resume what is queued */
+bool MobileMouseSession::OnWritable()
+{
+	return Flush();
+}
+
+/* whether output is queued, and the reactor should report OnWritable() */
+bool MobileMouseSession::Writing() const
+{
+	return !m_outbound.Empty();
+}
+
+/* picks up the state this device's last session left, if it is recent enough */
+void MobileMouseSession::Resume()
+{
+	SessionSnapshot state;
+	if (m_deviceId.empty() || !m_cache.Take(m_deviceId, state)) {
+		return;
+	}
+
+	m_windowMode = (WindowMode)state.windowMode;
+	m_presentationStatus = (PresentationStatus)state.presentationStatus;
+	m_clipboardSync = state.clipboardSync;
+	m_clipboardSent = state.clipboardSent;
+	m_pointer = state.pointer;
+	m_scroll = state.scroll;
+
+	if (m_appConfig.getDebug()) {
+		struct timespec now;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		syslog(LOG_INFO, "[%s] resumed %ld ms after connect", m_address.c_str(),
+				(now.tv_sec - m_connected.tv_sec) * 1000L + (now.tv_nsec - m_connected.tv_nsec) / 1000000L);
+	}
+}
+
+bool MobileMouseSession::OnWatched(int fd)
+{
+	if (fd == m_handshakeTimer) {
+		uint64_t expirations;
+		if (read(m_handshakeTimer, &expirations, sizeof(expirations)) < 0 && errno == EAGAIN) {
+			return true;
+		}
+		if (m_state != SS_ACTIVE) {
+			syslog(LOG_INFO, "[%s] disconnected (no login within %u seconds)", m_address.c_str(),
+					m_appConfig.getHandshakeTimeout());
+			return false;
+		}
+	} else if (fd == m_typing.GetTimer()) {
+		/* paced typing continues */
+		if (m_keyboard != NULL) {
+			m_typing.OnTimer(*m_keyboard);
+		}
+	} else if (fd == m_clipboardEvents) {
+		uint64_t changes;
+		if (read(m_clipboardEvents, &changes, sizeof(changes)) < 0 && errno == EAGAIN) {
+			return true;
+		}
+		if (m_clipboardSync && m_state == SS_ACTIVE) {
+			return SendClipboard(false);
+		}
+	}
+	return true;
+}
+
+bool MobileMouseSession::HandleHello(std::string_view raw)
+{
+	/* hello: CONNECT, password, id, name, ... */
+	Packet hello;
+	if (!ParsePacket(raw, hello) || hello.command != PC_CONNECT || hello.count < 4)
+	{
+		syslog(LOG_INFO, "[%s] disconnected (invalid protocol)", m_address.c_str());
 
 		/* dump unhandled packets */
-		if (appConfig.getDebug())
+		if (m_appConfig.getDebug())
 		{
-			dumpPacket(buffer);
+			dumpPacket(std::string(raw).c_str());
 		}
-		close(client);
-		return NULL;
+		return false;
 	}
+	const std::string password(hello.fields[0]), id(hello.fields[1]), name(hello.fields[2]);
 	
-	if (appConfig.getDebug()) {
-		syslog(LOG_INFO, "[%s] device id: %s", address.c_str(), id.c_str());
-		syslog(LOG_INFO, "[%s] device name: %s", address.c_str(), name.c_str());
+	if (m_appConfig.getDebug()) {
+		syslog(LOG_INFO, "[%s] device id: %s", m_address.c_str(), id.c_str());
+		syslog(LOG_INFO, "[%s] device name: %s", m_address.c_str(), name.c_str());
 	}
 	
 	/* verify device.id */
-	if (!appConfig.getDevices().empty() &&
-			appConfig.getDevices().find(id) == appConfig.getDevices().end())
+	if (!m_appConfig.getDevices().empty() &&
+			m_appConfig.getDevices().find(id) == m_appConfig.getDevices().end())
 	{
-		char m[1024];
-		snprintf(m, sizeof(m), "CONNECTED\x1e"
-				"NO\x1e"
-				"%s\x1e"
-				"%s\x1e"
-				"Device is not allowed\x1e"
-				"00:00:00:00:00:00\x1e"
-				"4\x04",
-				appConfig.getPlatform().c_str(),
-				appConfig.getHostname().c_str());
-		if (write(client, (const char*)m, strlen((const char*)m)) > 0)
-			n = read(client, m, sizeof(m)); /* let client disconnect */
-		syslog(LOG_INFO, "[%s] disconnected (device not allowed %s)", address.c_str(), id.c_str());
-		close(client);
-		return NULL;
+		syslog(LOG_INFO, "[%s] disconnected (device not allowed %s)", m_address.c_str(), id.c_str());
+		m_outbound.Append(std::shared_ptr<const void>(), m_replies.NotAllowed());
+		if (!Flush())
+			return false;
+		m_state = SS_REJECTED; /* let client disconnect */
+		return true;
 	}
 
 	/* verify device.password */
-	if (!appConfig.getPassword().empty() &&
-			password != appConfig.getPassword())
-	{
-		char m[1024];
-		snprintf(m, sizeof(m), "CONNECTED\x1e"
-				"NO\x1e"
-				"%s\x1e"
-				"%s\x1e"
-				"Incorrect password\x1e"
-				"00:00:00:00:00:00\x1e"
-				"4\x04",
-				appConfig.getPlatform().c_str(),
-				appConfig.getHostname().c_str());
-		if (write(client, (const char*)m, strlen((const char*)m)) > 0)
-			n = read(client, m, sizeof(m)); /* let client disconnect */
-		syslog(LOG_INFO, "[%s] disconnected (incorrect password)", address.c_str());
-		close(client);
-		return NULL;
-	}
-
-	/* complete handshake... */
+	if (!m_appConfig.getPassword().empty() &&
+			password != m_appConfig.getPassword())
 	{
-		char m[1024];
-		snprintf(m, sizeof(m), "CONNECTED\x1e"
-				"YES\x1e"
-				"%s\x1e"
-				"%s\x1e"
-				"Welcome\x1e"
-				"00:00:00:00:00:00\x1e"
-				"4\x04",
-				appConfig.getPlatform().c_str(),
-				appConfig.getHostname().c_str());
-		if (write(client, (const char*)m, strlen((const char*)m)) < 1)
-		{
-			syslog(LOG_INFO, "[%s] disconnected (write failed: %s)", address.c_str(), strerror(errno));
-			close(client);
-			return NULL;
-		}
+		syslog(LOG_INFO, "[%s] disconnected (incorrect password)", m_address.c_str());
+		m_outbound.Append(std::shared_ptr<const void>(), m_replies.BadPassword());
+		if (!Flush())
+			return false;
+		m_state = SS_REJECTED; /* let client disconnect */
+		return true;
+	}
+
+	/* only read once Ready(), so this does not block the reactor */
+	try {
+		m_devices.Wait();
 	}
+	catch (const std::runtime_error&) {
+		syslog(LOG_INFO, "[%s] disconnected (no input devices)", m_address.c_str());
+		return false;
+	}
+	m_mouse = &m_devices.GetMouse();
+	m_keyboard = &m_devices.GetKeyboard();
+	m_clipboard = &m_devices.GetClipboard();
+	m_watcher = &m_devices.GetWatcher();
+	if ((m_clipboardEvents = m_watcher->Subscribe()) < 0) {
+		syslog(LOG_INFO, "[%s] disconnected (cannot watch clipboard)", m_address.c_str());
+		return false;
+	}
+	m_watch = true;
+
+	/* complete handshake; the replies outlive us and go out in one writev */
+	m_outbound.Append(std::shared_ptr<const void>(), m_replies.Welcome());
 
 	/* register hotkeys */
 	// Disabled if reported client id is "Android" to circumvent connection problems.
 	// Android Mobile Mouse Lite appears to not support hotkey name definitions (and, critically, fails to connect if supplied)
 	// Untested with Android Mobile Mouse Pro
 	if (id != "Android") {
-		char m[1024];
-		snprintf(m, sizeof(m), "HOTKEYS\x1e"
-				"%s\x1e"
-				"%s\x1e"
-				"%s\x1e"
-				"%s\x04",
-				appConfig.getHotKeyName(1).c_str(),
-				appConfig.getHotKeyName(2).c_str(),
-				appConfig.getHotKeyName(3).c_str(),
-				appConfig.getHotKeyName(4).c_str()
-				);
-		if (write(client, (const char*)m, strlen((const char*)m)) < 1)
-		{
-			syslog(LOG_INFO, "[%s] disconnected (write failed: %s)", address.c_str(), strerror(errno));
-			close(client);
-			return NULL;
-		}
+		m_outbound.Append(std::shared_ptr<const void>(), m_replies.HotKeys());
+	}
+	if (!Flush())
+	{
+		return false;
 	}
 
-	struct timeval lastMouseEvent;
-	timerclear(&lastMouseEvent);
+	m_lease.reset(new DeviceLease(m_devices));
+	m_state = SS_ACTIVE;
+
+	/* the Android apps all log in as "Android"; those cannot be told apart */
+	if (id != "Android") {
+		m_deviceId = id;
+		m_claim = true;
+	}
+	return true;
+}
 
-	enum WindowMode {
-		WM_OTHER,
-		WM_MEDIA,
-		WM_WEB,
-		WM_PRESENTATION
-	} currentWindowMode = WM_OTHER;
+bool MobileMouseSession::HandlePacket(std::string_view raw)
+{
+	Packet packet;
+	PacketResult result = PR_UNHANDLED;
 
-	enum PresentationStatus
+	if (ParsePacket(raw, packet))
 	{
-		PS_STOPPED,
-		PS_STARTED
-	} presentationStatus = PS_STOPPED;
-
-	/* protocol loop */
-	std::string packet_buffer;
-	std::string packet;
-	while(1)
-	{
-		if (packet_buffer.find('\x04') != std::string::npos)
+		/* motion is coalesced and pointer events are batched; deliver
+		 * them ahead of any other packet that follows them */
+		if (packet.command != PC_MOVE && packet.command != PC_SCROLL)
 		{
-			packet = packet_buffer.substr(0, packet_buffer.find('\x04') + 1);
-			packet_buffer.erase(0, packet_buffer.find('\x04') + 1);
-		} else {
-			n = read(client, buffer, sizeof(buffer));
-			if (n < 1)
+			FlushMotion();
+			if (packet.command != PC_CLICK)
 			{
-				syslog(LOG_INFO, "[%s] disconnected (read failed: %s)", address.c_str(), strerror(errno));
-				if (appConfig.getDebug()) {
-					dumpPacket(buffer);
-				}
-				close(client);
-				break;
+				m_mouse->Flush();
 			}
-			packet_buffer.append(buffer, n);
-			continue;
 		}
-		
-		/* options */
-		std::string option, optval;
-		if (pcrecpp::RE("SETOPTION\x1e(.*?)\x1e(.*?)\x04").FullMatch(packet, &option, &optval))
+		result = DispatchPacket(packet);
+	}
+
+	if (result == PR_UNHANDLED)
+	{
+		syslog(LOG_INFO, "[%s] unhandled packet: size(%lu)", m_address.c_str(), (long unsigned int)raw.size());
+
+		/* dump unhandled packets */
+		if (m_appConfig.getDebug())
 		{
-			if (option == "CLIPBOARDSYNC") {
-				syslog(LOG_INFO, "Clipboard sync: %s", optval.c_str());
-			}
-			else if (option == "PRESENTATION") {
-				/* Presumably concerns the extra in-app purchase "pro presentation module" */
-				syslog(LOG_INFO, "Presentation mode: %s", optval.c_str());
-			}
-			else {
-				syslog(LOG_ERR, "Unknown option: %s", option.c_str());
-			}
-			continue;
+			dumpPacket(std::string(raw).c_str());
 		}
-		
-		/* mouse clicks */
-		std::string key, state, modifier;
- 		if (pcrecpp::RE("CLICK\x1e([LR])\x1e([DU])\x1e(.*?)\x04").FullMatch(packet, &key, &state, &modifier))
-		{
-			std::list<int> modkeys;
-			SetModKeys(modifier, modkeys);
-			
-			if (!modkeys.empty() && state == "D") {
-				keyBoard.PressKeys(modkeys);
-			}
-			
-			mousePointer.MouseClick(
-					key == "L" ? MouseInterface::LEFT : MouseInterface::RIGHT,
-					state == "D" ? MouseInterface::DOWN : MouseInterface::UP);
-			
-			if (!modkeys.empty() && state == "U") {
-				keyBoard.ReleaseKeys(modkeys);
-			}
-			
-			continue;
+	}
+
+	return result != PR_DISCONNECT;
+}
+
+/*
+ * Validates the fields of a tokenized packet and hands them to the typed
+ * handler for its command. Motion packets are listed first but the switch
+ * makes the order irrelevant; no packet pays for another's parsing.
+ */
+MobileMouseSession::PacketResult MobileMouseSession::DispatchPacket(const Packet& packet)
+{
+	MotionFixed dx, dy;
+	int x;
+
+	switch (packet.command)
+	{
+		case PC_MOVE:
+			/* MOVE, x, y, 1|0 */
+			if (packet.count >= 3 && ParseFixed(packet.fields[0], dx) && ParseFixed(packet.fields[1], dy))
+				return HandleMove(dx, dy);
+			break;
+		case PC_SCROLL:
+			/* SCROLL, x, y, modifier */
+			if (packet.count >= 3 && ParseFixed(packet.fields[0], dx) && ParseFixed(packet.fields[1], dy))
+				return HandleScroll(dx, dy);
+			break;
+		case PC_CLICK:
+			/* CLICK, L|R, D|U, modifier */
+			if (packet.count >= 3
+					&& (packet.fields[0] == "L" || packet.fields[0] == "R")
+					&& (packet.fields[1] == "D" || packet.fields[1] == "U"))
+				return HandleClick(
+						packet.fields[0] == "L" ? MouseInterface::LEFT : MouseInterface::RIGHT,
+						packet.fields[1] == "D" ? MouseInterface::DOWN : MouseInterface::UP,
+						packet.fields[2]);
+			break;
+		case PC_SETOPTION:
+			if (packet.count >= 2)
+				return HandleSetOption(packet.fields[0], packet.fields[1]);
+			break;
+		case PC_ZOOM:
+			if (packet.count >= 1 && ParseInt(packet.fields[0], x))
+				return HandleZoom(x);
+			break;
+		case PC_KEY:
+			/* KEY, keysym, utf8, modifier */
+			if (packet.count >= 3)
+				return HandleKey(packet.fields[0], packet.fields[1], packet.fields[2]);
+			break;
+		case PC_KEYSTRING:
+			return HandleKeyString(packet.body);
+		case PC_GESTURE:
+			if (packet.count >= 1)
+				return HandleGesture(packet.fields[0]);
+			break;
+		case PC_HOTKEY:
+			if (packet.count >= 1)
+				return HandleHotKey(packet.fields[0]);
+			break;
+		case PC_SWITCHMODE:
+			if (packet.count >= 1)
+				return HandleSwitchMode(packet.fields[0]);
+			break;
+		case PC_PROGRAMKEY:
+			if (packet.count >= 1)
+				return HandleProgramKey(packet.fields[0]);
+			break;
+		case PC_OPENLINK:
+			/* promotional links */
+			syslog(LOG_INFO, "Promotional link: %.*s", (int)packet.body.size(), packet.body.data());
+			return PR_HANDLED;
+		case PC_CONNECT:
+		case PC_UNKNOWN:
+			break;
+	}
+
+	return PR_UNHANDLED;
+}
+
+/* options */
+MobileMouseSession::PacketResult MobileMouseSession::HandleSetOption(std::string_view option, std::string_view optval)
+{
+	if (option == "CLIPBOARDSYNC") {
+		syslog(LOG_INFO, "Clipboard sync: %.*s", (int)optval.size(), optval.data());
+		m_clipboardSync = optval == "YES" || optval == "ON" || optval == "TRUE" || optval == "1";
+
+		/* catch the client up with what it missed */
+		if (m_clipboardSync && !SendClipboard(false)) {
+			return PR_DISCONNECT;
 		}
+	}
+	else if (option == "PRESENTATION") {
+		/* Presumably concerns the extra in-app purchase "pro presentation module" */
+		syslog(LOG_INFO, "Presentation mode: %.*s", (int)optval.size(), optval.data());
+	}
+	else {
+		syslog(LOG_ERR, "Unknown option: %.*s", (int)option.size(), option.data());
+	}
+	return PR_HANDLED;
+}
 
-		/* mouse movements */
-		std::string xp, yp;
-		if (pcrecpp::RE("MOVE\x1e(-?[\\d\x2e]+)\x1e(-?[\\d\x2e]+)\x1e[10]\x1e?\x04").FullMatch(packet, &xp, &yp))
-		{
-			struct timeval currentMouseEvent;
-			gettimeofday(&currentMouseEvent, NULL);
-			struct timeval diff;
-			timersub(&currentMouseEvent, &lastMouseEvent, &diff);
-			lastMouseEvent = currentMouseEvent;
-			double usecdiff = ((double)diff.tv_sec * 1000000.0) + (double)diff.tv_usec;
-			
-			int dx, dy;
-			double distance, speed;
-			dx = (int)strtol(xp.c_str(), NULL, 10);
-			dy = (int)strtol(yp.c_str(), NULL, 10);
-			distance = sqrt((dx * dx) + (dy * dy));
-			speed = distance / usecdiff;
-			
-			// if acceleration is enabled, apply when estimated cursor speed exceeds given rate (pixels per microsecond)
-			if (appConfig.getMouseAcceleration() && (speed > appConfig.getMouseAccelerationSpeed())) {
-				dx *= appConfig.getMouseAccelerationFactor();
-				dy *= appConfig.getMouseAccelerationFactor();
+/* mouse clicks */
+MobileMouseSession::PacketResult MobileMouseSession::HandleClick(MouseInterface::MouseButton button,
+		MouseInterface::MouseState state, std::string_view modifier)
+{
+	if (modifier.empty())
+	{
+		m_mouse->MouseClick(button, state);
+		return PR_HANDLED;
+	}
+
+	std::list<int> modkeys;
+	SetModKeys(modifier, modkeys);
+
+	// paced typing would otherwise go on under the held modifiers
+	if (!modkeys.empty()) {
+		m_typing.Flush(*m_keyboard);
+	}
+
+	// modifiers may go through another device and thread; keep them in order with the click
+	m_mouse->Flush();
+
+	if (!modkeys.empty() && state == MouseInterface::DOWN) {
+		m_keyboard->PressKeys(modkeys);
+		m_keyboard->Sync();
+	}
+	
+	m_mouse->MouseClick(button, state);
+	m_mouse->Flush();
+	
+	if (!modkeys.empty() && state == MouseInterface::UP) {
+		m_mouse->Sync();
+		m_keyboard->ReleaseKeys(modkeys);
+	}
+	
+	return PR_HANDLED;
+}
+
+/* mouse movements */
+MobileMouseSession::PacketResult MobileMouseSession::HandleMove(MotionFixed dx, MotionFixed dy)
+{
+	if (!m_appConfig.getMouseCoalesce() && !m_backlogged) {
+		InjectMove(dx, dy, m_received);
+		return PR_HANDLED;
+	}
+
+	if (m_backlogged) {
+		m_motionFolded++;
+	} else if (m_pendingMove) {
+		m_motionMerged++;
+	}
+	m_pendingMove = true;
+	m_moveTime = m_received;
+	m_moveX += dx;
+	m_moveY += dy;
+	return PR_HANDLED;
+}
+
+void MobileMouseSession::InjectMove(MotionFixed dx, MotionFixed dy, const struct timespec& when)
+{
+	// gain comes from the configured curve at the smoothed pointer speed,
+	// timed by when the (last merged) packet arrived
+	double distance = hypot((double)dx, (double)dy) / MOTION_FIXED_ONE;
+	double factor = m_accelerator.Factor(distance, when);
+	dx = (MotionFixed)llround((double)dx * factor);
+	dy = (MotionFixed)llround((double)dy * factor);
+	
+	// only whole pixels reach the device; the fraction waits for the next move
+	int x, y;
+	m_pointer.Add(dx, dy);
+	if (m_pointer.Take(x, y)) {
+		m_mouse->MouseMove(x, y);
+
+		/* how soon a (re)connected client gets the pointer moving */
+		if (!m_moved) {
+			m_moved = true;
+			if (m_appConfig.getDebug()) {
+				struct timespec now;
+				clock_gettime(CLOCK_MONOTONIC, &now);
+				syslog(LOG_INFO, "[%s] first motion %ld ms after connect", m_address.c_str(),
+						(now.tv_sec - m_connected.tv_sec) * 1000 + (now.tv_nsec - m_connected.tv_nsec) / 1000000);
 			}
-			
-			mousePointer.MouseMove(dx, dy);
-			continue;
 		}
+	}
+}
 
-		/* mouse scrolling */
-		std::string xs, ys;
-		if (pcrecpp::RE("SCROLL\x1e(-?\\d+.?\\d+)\x1e(-?\\d+.?\\d+)\x1e(.*?)\x04").FullMatch(packet, &xs, &ys, &modifier))
-		{
-			int dx, dy;
-			dx = appConfig.getMouseHorizontalScrolling() ? (int)strtol(xs.c_str(), NULL, 10) : 0;
-			dy = (int)strtol(ys.c_str(), NULL, 10);
-			
-			// scrollmax is at least 1
-			int maxd = appConfig.getMouseScrollMax();
-			if (abs(dx) > maxd) {
-				dx = maxd * dx / abs(dx);
-			}
-			if (abs(dy) > maxd) {
-				dy = maxd * dy / abs(dy);
-			}
-			
-			mousePointer.MouseScroll(dx, dy);
-			continue;
+/* mouse scrolling */
+MobileMouseSession::PacketResult MobileMouseSession::HandleScroll(MotionFixed dx, MotionFixed dy)
+{
+	if (!m_appConfig.getMouseHorizontalScrolling()) {
+		dx = 0;
+	}
+	
+	// scrollmax is at least 1; it limits each packet, merged or not
+	MotionFixed maxd = m_appConfig.getMouseScrollMax() * MOTION_FIXED_ONE;
+	if (dx > maxd) dx = maxd;
+	if (dx < -maxd) dx = -maxd;
+	if (dy > maxd) dy = maxd;
+	if (dy < -maxd) dy = -maxd;
+	
+	if (!m_appConfig.getMouseCoalesce() && !m_backlogged) {
+		InjectScroll(dx, dy);
+		return PR_HANDLED;
+	}
+
+	if (m_backlogged) {
+		m_motionFolded++;
+	} else if (m_pendingScroll) {
+		m_motionMerged++;
+	}
+	m_pendingScroll = true;
+	m_scrollX += dx;
+	m_scrollY += dy;
+	return PR_HANDLED;
+}
+
+void MobileMouseSession::InjectScroll(MotionFixed dx, MotionFixed dy)
+{
+	int x, y;
+	if (m_appConfig.getMouseSmoothScrolling()) {
+		// scroll values are in detents; the wheel reports 120ths of one
+		m_scroll.Add(dx * MOUSE_HIRES_DETENT, dy * MOUSE_HIRES_DETENT);
+		if (m_scroll.Take(x, y)) {
+			m_mouse->MouseScrollHiRes(x, y);
+		}
+		return;
+	}
+
+	// fractional scroll values add up to whole detents over several packets
+	m_scroll.Add(dx, dy);
+	if (m_scroll.Take(x, y)) {
+		m_mouse->MouseScroll(x, y);
+	}
+}
+
+/* injects the motion coalesced so far as one move and one scroll */
+void MobileMouseSession::FlushMotion()
+{
+	if (m_pendingMove) {
+		InjectMove(m_moveX, m_moveY, m_moveTime);
+		m_pendingMove = false;
+		m_moveX = m_moveY = 0;
+	}
+	if (m_pendingScroll) {
+		InjectScroll(m_scrollX, m_scrollY);
+		m_pendingScroll = false;
+		m_scrollX = m_scrollY = 0;
+	}
+}
+
+/* zooming */
+/* consider handling in/out zoom as generic spread/pinch gesture hotkeys */ 
+MobileMouseSession::PacketResult MobileMouseSession::HandleZoom(int zoom)
+{
+	std::list<int> keys;
+	for(int i = abs(zoom); i > 0; i--)
+	{
+		keys.push_back(XK_Control_L);
+		if (zoom < 0)
+			keys.push_back('-');
+		else
+			keys.push_back('+');
+	}
+	m_typing.Chord(keys);
+	m_typing.Submit(*m_keyboard);
+	return PR_HANDLED;
+}
+
+/*
+ * Parameters:
+ *   keyboard, answers whether the character needs Shift
+ *   utf8, the typed character
+ *   keys, Shift is appended if the character's key needs it
+ *
+ * Return Value:
+ *   keysym of the character, 0 if there is none
+ */
+static int CharacterKeysym(KeyboardInterface& keyboard, std::string_view utf8, std::list<int>& keys)
+{
+	uint32_t codepoint;
+	if (!Utf8Next(utf8, codepoint)) {
+		return 0;
+	}
+	int keysym = CodepointToKeysym(codepoint);
+	if (keysym != 0 && keyboard.keysymIsShiftVariant((KeySym)keysym)) {
+		keys.push_back(XK_Shift_L);
+	}
+	return keysym;
+}
+
+/* key board */
+MobileMouseSession::PacketResult MobileMouseSession::HandleKey(std::string_view chr, std::string_view utf8, std::string_view modifier)
+{
+	if (chr != "-1" && modifier.empty() && Paste(utf8)) {
+		return PR_HANDLED;
+	}
+
+	// text of several characters (e.g. a completed word) is typed as a whole
+	if (chr != "-1") {
+		std::string_view rest = utf8;
+		uint32_t codepoint;
+		if (Utf8Next(rest, codepoint) && !rest.empty()) {
+			m_typing.Type(*m_keyboard, utf8);
+			m_typing.Submit(*m_keyboard);
+			return PR_HANDLED;
+		}
+	}
+
+	std::list<int> keys;
+	int keyCode = 0;
+	if (chr == "-1")
+	{
+		/* keyboard page */
+		if (utf8 == "ENTER") keyCode = XK_Return;
+		if (utf8 == "BACKSPACE") keyCode = XK_BackSpace;
+		if (utf8 == "TAB") keyCode = XK_Tab;
+
+		/* keypad */
+		if (utf8 == "NUM_DIVIDE") keyCode = XK_KP_Divide;
+		if (utf8 == "NUM_MULTIPLY") keyCode = XK_KP_Multiply;
+		if (utf8 == "NUM_SUBTRACT") keyCode = XK_KP_Subtract;
+		if (utf8 == "NUM_ADD") keyCode = XK_KP_Add;
+		if (utf8 == "NUM_ENTER") keyCode = XK_KP_Enter;
+		if (utf8 == "NUM_EQUAL") keyCode = XK_KP_Equal;
+		if (utf8 == "NUM_DECIMAL") keyCode = XK_KP_Decimal;
+		if (utf8 == "INSERT") keyCode = XK_KP_Insert;
+		if (utf8 == "NUM0") keyCode = XK_KP_0;
+		if (utf8 == "NUM1") keyCode = XK_KP_1;
+		if (utf8 == "NUM2") keyCode = XK_KP_2;
+		if (utf8 == "NUM3") keyCode = XK_KP_3;
+		if (utf8 == "NUM4") keyCode = XK_KP_4;
+		if (utf8 == "NUM5") keyCode = XK_KP_5;
+		if (utf8 == "NUM6") keyCode = XK_KP_6;
+		if (utf8 == "NUM7") keyCode = XK_KP_7;
+		if (utf8 == "NUM8") keyCode = XK_KP_8;
+		if (utf8 == "NUM9") keyCode = XK_KP_9;
+		
+		// non-num-locked keypad equivalents are received directly (as HOME, END, PGUP, etc)
+		// so prefix keypad input with shift to interpet as regular numerals
+		if (keyCode == XK_KP_0 ||
+				keyCode == XK_KP_1 || keyCode == XK_KP_2 || keyCode == XK_KP_3
+				|| keyCode == XK_KP_4 || keyCode == XK_KP_5 || keyCode == XK_KP_6
+				|| keyCode == XK_KP_7 || keyCode == XK_KP_8 || keyCode == XK_KP_9) {
+			keys.push_back(XK_Shift_L);
 		}
 		
-		/* zooming */
-		/* consider handling in/out zoom as generic spread/pinch gesture hotkeys */ 
-		std::string zoom;
-		if (pcrecpp::RE("ZOOM\x1e(-?\\d+)\x04").FullMatch(packet, &zoom))
+		/* function page */
+		if (utf8 == "ESCAPE") keyCode = XK_Escape;
+		if (utf8 == "DELETE") keyCode = XK_Delete;
+		if (utf8 == "HOME") keyCode = XK_Home;
+		if (utf8 == "END") keyCode = XK_End;
+		if (utf8 == "PGUP") keyCode = XK_Page_Up;
+		if (utf8 == "PGDN") keyCode = XK_Page_Down;
+		if (utf8 == "UP") keyCode = XK_Up;
+		if (utf8 == "DOWN") keyCode = XK_Down;
+		if (utf8 == "RIGHT") keyCode = XK_Right;
+		if (utf8 == "LEFT") keyCode = XK_Left;
+		if (utf8 == "F1") keyCode = XK_F1;
+		if (utf8 == "F2") keyCode = XK_F2;
+		if (utf8 == "F3") keyCode = XK_F3;
+		if (utf8 == "F4") keyCode = XK_F4;
+		if (utf8 == "F5") keyCode = XK_F5;
+		if (utf8 == "F6") keyCode = XK_F6;
+		if (utf8 == "F7") keyCode = XK_F7;
+		if (utf8 == "F8") keyCode = XK_F8;
+		if (utf8 == "F9") keyCode = XK_F9;
+		if (utf8 == "F10") keyCode = XK_F10;
+		if (utf8 == "F11") keyCode = XK_F11;
+		if (utf8 == "F12") keyCode = XK_F12;
+
+		/* media player */
+		if (utf8 == "VOLDOWN") keyCode = XF86XK_AudioLowerVolume;
+		if (utf8 == "VOLUP") keyCode = XF86XK_AudioRaiseVolume;
+		if (utf8 == "VOLMUTE") keyCode = XF86XK_AudioMute;
+		if (utf8 == "EJECT") keyCode = XF86XK_Eject;
+
+		if (keyCode == 0) {
+			keyCode = CharacterKeysym(*m_keyboard, utf8, keys);
+		}
+	}
+	else
+	{
+		keyCode = CharacterKeysym(*m_keyboard, utf8, keys);
+	}
+	
+	if (keyCode <= 0)
+	{
+		return PR_UNHANDLED;
+	}
+
+	SetModKeys(modifier, keys);
+	keys.push_back(keyCode);
+
+	// typed keys queue behind any text still being typed
+	m_typing.Chord(keys);
+	m_typing.Submit(*m_keyboard);
+	return PR_HANDLED;
+}
+
+/* keystrings */
+MobileMouseSession::PacketResult MobileMouseSession::HandleKeyString(std::string_view keystring)
+{
+	if (Paste(keystring)) {
+		return PR_HANDLED;
+	}
+
+
+	// keystrings are currently only generated when the client's shift-lock button
+	// is toggled on... so every character that could be a shift variant presumably is.
+	// Except for the last character, because keystrings are only sent once shift-lock
+	// is disabled and another character is entered (which is included). Weird.
+	m_typing.Type(*m_keyboard, keystring);
+	m_typing.Submit(*m_keyboard);
+	return PR_HANDLED;
+}
+
+/*
+ * Pastes long text through the clipboard instead of typing it key by key.
+ *
+ * Return Value:
+ *   false if the text should be typed: too short, pasting is disabled,
+ *   keys are still queued ahead of it, or the clipboard is unavailable
+ */
+bool MobileMouseSession::Paste(std::string_view text)
+{
+	unsigned int threshold = m_appConfig.getKeyboardPasteThreshold();
+	if (threshold == 0 || text.size() < threshold || !m_appConfig.getKeyboardEnabled()
+			|| m_typing.Pending()) {
+		return false;
+	}
+
+	if (!m_clipboard->Paste(std::string(text), *m_watcher)) {
+		return false;
+	}
+
+	m_typing.Chord(m_appConfig.getKeyboardPasteKeys());
+	m_typing.Submit(*m_keyboard);
+	return true;
+}
+
+/* gestures */
+MobileMouseSession::PacketResult MobileMouseSession::HandleGesture(std::string_view gesture)
+{
+	int hotkey = 0;
+	if (gesture == "TWOFINGERDOUBLETAP")   hotkey = 7;
+	if (gesture == "THREEFINGERSINGLETAP") hotkey = 8;
+	if (gesture == "THREEFINGERDOUBLETAP") hotkey = 9;
+	if (gesture == "FOURFINGERPINCH")      hotkey = 10;
+	if (gesture == "FOURFINGERSPREAD")     hotkey = 11;
+	if (gesture == "FOURFINGERSWIPELEFT")  hotkey = 12;
+	if (gesture == "FOURFINGERSWIPERIGHT") hotkey = 13;
+	if (gesture == "FOURFINGERSWIPEUP")    hotkey = 14;
+	if (gesture == "FOURFINGERSWIPEDOWN")  hotkey = 15;
+	if (hotkey == 0) {
+		return PR_UNHANDLED;
+	}
+
+	return RunCommand(m_appConfig.getHotKeyCommandLine(hotkey));
+}
+
+/* run hotkey commands */
+MobileMouseSession::PacketResult MobileMouseSession::HandleHotKey(std::string_view hotkey)
+{
+	unsigned int id;
+
+	if (hotkey.size() == 3 && hotkey.substr(0, 2) == "HK" && isdigit(hotkey[2]))
+	{
+		id = (unsigned int)(hotkey[2] - '0');
+	}
+	// B1 is invoked when scroll pad is tapped (but not scrolled),
+	// like clicking the middle mouse button of a scroll mouse.
+	// So, if no hotkey command is defined, fake a middle button click.
+	else if (hotkey == "B1")
+	{
+		id = 5;
+		if (m_appConfig.getHotKeyCommandLine(id).line.empty()) {
+			m_mouse->MouseClick(MouseInterface::MIDDLE, MouseInterface::DOWN);
+			m_mouse->MouseClick(MouseInterface::MIDDLE, MouseInterface::UP);
+		}
+	}
+	// I don't know how to invoke B2.
+	else if (hotkey == "B2")
+	{
+		id = 6;
+	}
+	else
+	{
+		return PR_UNHANDLED;
+	}
+	
+	return RunCommand(m_appConfig.getHotKeyCommandLine(id));
+}
+
+/*
+ * Parameters:
+ *   command, command to execute (unless recognized as special control code)
+ */
+MobileMouseSession::PacketResult MobileMouseSession::RunCommand(const CommandLine& command)
+{
+	/* special case commands */
+	if (command.line == "SYNC_CLIPBOARD") {
+		return SendClipboard(true) ? PR_HANDLED : PR_DISCONNECT;
+	}
+
+	/* interpret all other commands literally; queued, never waited for */
+	m_executor.Run(command);
+	return PR_HANDLED;
+}
+
+/*
+ * Sends the clipboard as last fetched by the watcher.
+ *
+ * Parameters:
+ *   always, send even if the client already has this text
+ *
+ * Return Value:
+ *   false if the write failed and the session should end
+ */
+bool MobileMouseSession::SendClipboard(bool always)
+{
+	std::shared_ptr<const ClipboardText> content = m_watcher->Get();
+	if (!always && content->hash == m_clipboardSent) {
+		return true;
+	}
+
+	if (m_appConfig.getDebug()) {
+		syslog(LOG_INFO, "[%s] clipboard update message length: %lu", m_address.c_str(),
+				(unsigned long)(CLIPBOARD_HEADER.size() + content->size + CLIPBOARD_TRAILER.size()));
+	}
+
+	/* the text goes out from the watcher's cache, chunk by chunk */
+	std::shared_ptr<const void> none;
+	m_outbound.Append(none, CLIPBOARD_HEADER);
+	for (std::vector<std::string>::const_iterator i = content->chunks.begin(); i != content->chunks.end(); i++) {
+		m_outbound.Append(content, *i);
+	}
+	m_outbound.Append(none, CLIPBOARD_TRAILER);
+
+	m_clipboardSent = content->hash;
+	return Flush();
+}
+
+/*
+ * Queues a message behind anything not yet sent and writes what it can.
+ *
+ * Return Value:
+ *   false if the write failed and the session should end
+ */
+bool MobileMouseSession::Send(std::string_view message)
+{
+	m_outbound.Append(message);
+	return Flush();
+}
+
+bool MobileMouseSession::Flush()
+{
+	if (m_outbound.Flush(m_sock) < 0) {
+		syslog(LOG_INFO, "[%s] disconnected (write failed: %s)", m_address.c_str(), strerror(errno));
+		return false;
+	}
+	if (m_outbound.Size() > OUTBOUND_MAX_BYTES) {
+		syslog(LOG_INFO, "[%s] disconnected (client stopped reading)", m_address.c_str());
+		return false;
+	}
+	return true;
+}
+
+/* screens */
+MobileMouseSession::PacketResult MobileMouseSession::HandleSwitchMode(std::string_view mode)
+{
+	if (mode == "MEDIA")
+	{
+		m_windowMode = WM_MEDIA;
 		{
-			std::list<int> keys;
-			for(int i = abs((int)strtol(zoom.c_str(), 0x0, 10)); i > 0; i--)
+			/* current implementation supports totem */
+			static const char m[] = "MEDIACUSTOMKEYS\x1e"
+					"Playlist\x1e"
+					"\x1e"
+					"\x1e"
+					"\x1e"
+					"Full Screen\x1e"
+					"\x1e"
+					"\x1e"
+					"\x04";
+			if (!Send(std::string_view(m, sizeof(m) - 1)))
 			{
-				keys.push_back(XK_Control_L);
-				if (zoom[0] == '-')
-					keys.push_back('-');
-				else
-					keys.push_back('+');
+				return PR_DISCONNECT;
 			}
-			keyBoard.SendKey(keys);
-			continue;
 		}
+		/* launch mediaplayer */
+		//m_keyboard->SendKey(XF86XK_AudioMedia);
+		return PR_HANDLED;
+	}
+	if (mode == "WEB")
+	{
+		m_windowMode = WM_WEB;
+		/* launch webbrowser */
+		//m_keyboard->SendKey(XF86XK_WWW);
+		return PR_HANDLED;
+	}
+	if (mode == "PRESENTATION")
+	{
+		/* launch presentation */
+		m_windowMode = WM_PRESENTATION;
+		m_presentationStatus = PS_STOPPED;
+		return PR_HANDLED;
+	}
+	return PR_UNHANDLED;
+}
 
-		/* key board */
-		std::string chr, utf8;
-		if (pcrecpp::RE("KEY\x1e(.*?)\x1e(.*?)\x1e(.*?)\x04").FullMatch(packet, &chr, &utf8, &modifier))
-		{
-			std::list<int> keys;
-			int keyCode = 0;
-			if (chr == "-61")
+/* program keys queue behind any text still being typed, like typed keys */
+void MobileMouseSession::QueueKey(int keysym)
+{
+	std::list<int> keys;
+	keys.push_back(keysym);
+	QueueKey(keys);
+}
+
+void MobileMouseSession::QueueKey(const std::list<int>& keys)
+{
+	m_typing.Chord(keys);
+	m_typing.Submit(*m_keyboard);
+}
+
+/* program keys */
+MobileMouseSession::PacketResult MobileMouseSession::HandleProgramKey(std::string_view key)
+{
+	switch(m_windowMode)
+	{
+		case WM_OTHER:
 			{
-				iconv_t cd;
-				if ((cd = iconv_open(appConfig.getKeyboardLayout().c_str(), "UTF-8")) == (iconv_t)-1)
+			}
+		break;
+		case WM_MEDIA:
+			{
+				if (key == "PLAYPAUSE")
 				{
-					syslog(LOG_ERR, "iconv_open failed: %s", strerror(errno));
-					continue;
+					QueueKey(XF86XK_AudioPlay);
+					return PR_HANDLED;
 				}
-				char* inptr = (char*)utf8.c_str();
-				size_t inlen = utf8.size();
-
-				char out[1];
-				bzero(out, sizeof(out));
-				size_t outlen = sizeof(out);
-				char *outptr = out;
-				if (iconv(cd, &inptr, &inlen, &outptr, &outlen) == (size_t)-1)
+				if (key == "TRACKPREV")
 				{
-					iconv_close(cd);
-					syslog(LOG_ERR, "iconv failed: %s", strerror(errno));
-					continue;
+					QueueKey(XF86XK_AudioNext);
+					return PR_HANDLED;
 				}
-				iconv_close(cd);
-				keyCode = 0xff & out[0];
-			}
-			else if (chr == "-1")
-			{
-				/* keyboard page */
-				if (utf8 == "ENTER") keyCode = XK_Return;
-				if (utf8 == "BACKSPACE") keyCode = XK_BackSpace;
-				if (utf8 == "TAB") keyCode = XK_Tab;
-
-				/* keypad */
-				if (utf8 == "NUM_DIVIDE") keyCode = XK_KP_Divide;
-				if (utf8 == "NUM_MULTIPLY") keyCode = XK_KP_Multiply;
-				if (utf8 == "NUM_SUBTRACT") keyCode = XK_KP_Subtract;
-				if (utf8 == "NUM_ADD") keyCode = XK_KP_Add;
-				if (utf8 == "NUM_ENTER") keyCode = XK_KP_Enter;
-				if (utf8 == "NUM_EQUAL") keyCode = XK_KP_Equal;
-				if (utf8 == "NUM_DECIMAL") keyCode = XK_KP_Decimal;
-				if (utf8 == "INSERT") keyCode = XK_KP_Insert;
-				if (utf8 == "NUM0") keyCode = XK_KP_0;
-				if (utf8 == "NUM1") keyCode = XK_KP_1;
-				if (utf8 == "NUM2") keyCode = XK_KP_2;
-				if (utf8 == "NUM3") keyCode = XK_KP_3;
-				if (utf8 == "NUM4") keyCode = XK_KP_4;
-				if (utf8 == "NUM5") keyCode = XK_KP_5;
-				if (utf8 == "NUM6") keyCode = XK_KP_6;
-				if (utf8 == "NUM7") keyCode = XK_KP_7;
-				if (utf8 == "NUM8") keyCode = XK_KP_8;
-				if (utf8 == "NUM9") keyCode = XK_KP_9;
-				
-				// non-num-locked keypad equivalents are received directly (as HOME, END, PGUP, etc)
-				// so prefix keypad input with shift to interpet as regular numerals
-				if (keyCode == XK_KP_0 ||
-						keyCode == XK_KP_1 || keyCode == XK_KP_2 || keyCode == XK_KP_3
-						|| keyCode == XK_KP_4 || keyCode == XK_KP_5 || keyCode == XK_KP_6
-						|| keyCode == XK_KP_7 || keyCode == XK_KP_8 || keyCode == XK_KP_9) {
-					keys.push_back(XK_Shift_L);
+				if (key == "TRACKNEXT")
+				{
+					QueueKey(XF86XK_AudioNext);
+					return PR_HANDLED;
 				}
-				
-				/* function page */
-				if (utf8 == "ESCAPE") keyCode = XK_Escape;
-				if (utf8 == "DELETE") keyCode = XK_Delete;
-				if (utf8 == "HOME") keyCode = XK_Home;
-				if (utf8 == "END") keyCode = XK_End;
-				if (utf8 == "PGUP") keyCode = XK_Page_Up;
-				if (utf8 == "PGDN") keyCode = XK_Page_Down;
-				if (utf8 == "UP") keyCode = XK_Up;
-				if (utf8 == "DOWN") keyCode = XK_Down;
-				if (utf8 == "RIGHT") keyCode = XK_Right;
-				if (utf8 == "LEFT") keyCode = XK_Left;
-				if (utf8 == "F1") keyCode = XK_F1;
-				if (utf8 == "F2") keyCode = XK_F2;
-				if (utf8 == "F3") keyCode = XK_F3;
-				if (utf8 == "F4") keyCode = XK_F4;
-				if (utf8 == "F5") keyCode = XK_F5;
-				if (utf8 == "F6") keyCode = XK_F6;
-				if (utf8 == "F7") keyCode = XK_F7;
-				if (utf8 == "F8") keyCode = XK_F8;
-				if (utf8 == "F9") keyCode = XK_F9;
-				if (utf8 == "F10") keyCode = XK_F10;
-				if (utf8 == "F11") keyCode = XK_F11;
-				if (utf8 == "F12") keyCode = XK_F12;
-
-				/* media player */
-				if (utf8 == "VOLDOWN") keyCode = XF86XK_AudioLowerVolume;
-				if (utf8 == "VOLUP") keyCode = XF86XK_AudioRaiseVolume;
-				if (utf8 == "VOLMUTE") keyCode = XF86XK_AudioMute;
-				if (utf8 == "EJECT") keyCode = XF86XK_Eject;
-
-				if (keyCode == 0) {
-					// utf8 could contain multibyte characters; currently unhandled
-					keyCode = utf8[0];
-
-					// check if the shift key is required to generate input character (hack)
-					if (keyBoard.keysymIsShiftVariant((KeySym)strtol(chr.c_str(), NULL, 10))) {
-						keys.push_back(XK_Shift_L);
-					}
+				if (key == "MEDIAPLUS")
+				{
+					QueueKey(XF86XK_AudioRaiseVolume);
+					return PR_HANDLED;
 				}
-			}
-			else
-			{
-				// utf8 could contain multibyte characters; currently unhandled
-				keyCode = utf8[0];
-				
-				// check if the shift key is required to generate input character (hack)
-				if (keyBoard.keysymIsShiftVariant((KeySym)strtol(chr.c_str(), NULL, 10))) {
-					keys.push_back(XK_Shift_L);
+				if (key == "MEDIAMINUS")
+				{
+					QueueKey(XF86XK_AudioLowerVolume);
+					return PR_HANDLED;
+				}
+				if (key == "MEDIACUSTOMKEY1")
+				{
+					QueueKey(XK_F9);
+					return PR_HANDLED;
+				}
+				if (key == "MEDIACUSTOMKEY5")
+				{
+					QueueKey(XK_F11);
+					return PR_HANDLED;
 				}
 			}
-			
-			SetModKeys(modifier, keys);
-			
-			if (keyCode > 0)
-			{
-				keys.push_back(keyCode);
-				keyBoard.SendKey(keys);
-				continue;
-			}
-		}
-		
-		/* keystrings */
-		std::string keystring;
-		if (pcrecpp::RE("KEYSTRING\x1e(.*?)\x04").FullMatch(packet, &keystring))
-		{
-			std::list<int> keys;
-			for (std::string::const_iterator i = keystring.begin(); i != keystring.end(); i++)
+			break;
+		case WM_WEB:
 			{
-				// keystrings are currently only generated when the client's shift-lock button
-				// is toggled on... so every character that could be a shift variant presumably is.
-				// Except for the last character, because keystrings are only sent once shift-lock
-				// is disabled and another character is entered (which is included). Weird.
-				if (keyBoard.keysymIsShiftVariant((KeySym)*i)) {
-					keys.push_back(XK_Shift_L);
+				if (key == "BROWSERNEWWINDOW")
+				{
+					QueueKey(XF86XK_WWW);
+					return PR_HANDLED;
 				}
-				
-				keys.push_back(*i);
-			}
-			keyBoard.SendKey(keys);
-			continue;
-		}
-		
-		/* gestures */
-		std::string gesture;
-		if (pcrecpp::RE("GESTURE\x1e(.*?)\x04").FullMatch(packet, &gesture)) {
-			int hotkey = 0;
-			if (gesture == "TWOFINGERDOUBLETAP")   hotkey = 7;
-			if (gesture == "THREEFINGERSINGLETAP") hotkey = 8;
-			if (gesture == "THREEFINGERDOUBLETAP") hotkey = 9;
-			if (gesture == "FOURFINGERPINCH")      hotkey = 10;
-			if (gesture == "FOURFINGERSPREAD")     hotkey = 11;
-			if (gesture == "FOURFINGERSWIPELEFT")  hotkey = 12;
-			if (gesture == "FOURFINGERSWIPERIGHT") hotkey = 13;
-			if (gesture == "FOURFINGERSWIPEUP")    hotkey = 14;
-			if (gesture == "FOURFINGERSWIPEDOWN")  hotkey = 15;
-			if (hotkey != 0) {
-				std::string command = appConfig.getHotKeyCommand(hotkey);
-				if (InvokeCommand(command, clipboard, client)) {
-					syslog(LOG_INFO, "[%s] disconnected (write failed: %s)", address.c_str(), strerror(errno));
-					close(client);
-					break;
+				if (key == "BROWSERNEWTAB")
+				{
+					std::list<int> keys;
+					keys.push_back(XK_Control_L);
+					keys.push_back('t');
+					QueueKey(keys);
+					return PR_HANDLED;
 				}
-				continue;
-			}
-		}
-
-		/* run hotkey commands */
-		std::string hotkey;
-		if (pcrecpp::RE("HOTKEY\x1eHK(\\d)\x04").FullMatch(packet, &hotkey))
-		{
-			std::string command = appConfig.getHotKeyCommand((unsigned int)strtoul(hotkey.c_str(), 0x0, 10));
-			if(InvokeCommand(command, clipboard, client)) {
-				syslog(LOG_INFO, "[%s] disconnected (write failed: %s)", address.c_str(), strerror(errno));
-				close(client);
-				break;
-			}
-			continue;
-		}
-		if (pcrecpp::RE("HOTKEY\x1e(B[12])\x04").FullMatch(packet, &hotkey))
-		{
-			std::string command;
-			
-			// B1 is invoked when scroll pad is tapped (but not scrolled),
-			// like clicking the middle mouse button of a scroll mouse.
-			// So, if no hotkey command is defined, fake a middle button click.
-			if (hotkey == "B1") {
-				command = appConfig.getHotKeyCommand(5);
-				if (command.empty()) {
-					mousePointer.MouseClick(MouseInterface::MIDDLE, MouseInterface::DOWN);
-					mousePointer.MouseClick(MouseInterface::MIDDLE, MouseInterface::UP);
+				if (key == "BROWSERLOCATION")
+				{
+					std::list<int> keys;
+					keys.push_back(XK_Control_L);
+					keys.push_back('l');
+					QueueKey(keys);
+					return PR_HANDLED;
 				}
-			}
-			// I don't know how to invoke B2.
-			if (hotkey == "B2") {
-				command = appConfig.getHotKeyCommand(6);
-			}
-			
-			if (InvokeCommand(command, clipboard, client)) {
-				syslog(LOG_INFO, "[%s] disconnected (write failed: %s)", address.c_str(), strerror(errno));
-				close(client);
-				break;
-			}
-			continue;
-		}
-		
-		/* screens */
-		std::string mode;
-		if (pcrecpp::RE("SWITCHMODE\x1e(.*?)\x04").FullMatch(packet, &mode))
-		{
-			if (mode == "MEDIA")
-			{
-				currentWindowMode = WM_MEDIA;
+				if (key == "BROWSERBACK")
 				{
-					/* current implementation supports totem */
-					char m[1024];
-					snprintf(m, sizeof(m), "MEDIACUSTOMKEYS\x1e"
-							"Playlist\x1e"
-							"\x1e"
-							"\x1e"
-							"\x1e"
-							"Full Screen\x1e"
-							"\x1e"
-							"\x1e"
-							"\x04"
-							);
-					if (write(client, (const char*)m, strlen((const char*)m)) < 1)
-					{
-						syslog(LOG_INFO, "[%s] disconnected (write failed: %s)", address.c_str(), strerror(errno));
-						close(client);
-						return NULL;
-					}
+					std::list<int> keys;
+					keys.push_back(XK_Alt_L);
+					keys.push_back(XK_Left);
+					QueueKey(keys);
+					return PR_HANDLED;
+				}
+				if (key == "BROWSERNEXT")
+				{
+					std::list<int> keys;
+					keys.push_back(XK_Alt_L);
+					keys.push_back(XK_Right);
+					QueueKey(keys);
+					return PR_HANDLED;
+				}
+				if (key == "BROWSERHOME")
+				{
+					std::list<int> keys;
+					keys.push_back(XK_Alt_L);
+					keys.push_back(XK_Home);
+					QueueKey(keys);
+					return PR_HANDLED;
+				}
+				if (key == "BROWSERSEARCH")
+				{
+					std::list<int> keys;
+					keys.push_back(XK_Control_L);
+					keys.push_back('k');
+					QueueKey(keys);
+					return PR_HANDLED;
+				}
+				if (key == "BROWSERRELOAD")
+				{
+					std::list<int> keys;
+					keys.push_back(XK_Control_L);
+					keys.push_back('r');
+					QueueKey(keys);
+					return PR_HANDLED;
+				}
+				if (key == "BROWSERSTOP")
+				{
+					std::list<int> keys;
+					keys.push_back(XK_Escape);
+					QueueKey(keys);
+					return PR_HANDLED;
+				}
+				if (key == "BROWSERBOOKMARKS")
+				{
+					std::list<int> keys;
+					keys.push_back(XK_Control_L);
+					keys.push_back('b');
+					QueueKey(keys);
+					return PR_HANDLED;
+				}
+				if (key == "BROWSERPLUS")
+				{
+					std::list<int> keys;
+					keys.push_back(XK_Control_L);
+					keys.push_back(XK_Tab);
+					QueueKey(keys);
+					return PR_HANDLED;
+				}
+				if (key == "BROWSERMINUS")
+				{
+					std::list<int> keys;
+					keys.push_back(XK_Control_L);
+					keys.push_back(XK_Shift_L);
+					keys.push_back(XK_Tab);
+					QueueKey(keys);
+					return PR_HANDLED;
 				}
-				/* launch mediaplayer */
-				//keyBoard.SendKey(XF86XK_AudioMedia);
-				continue;
-			}
-			if (mode == "WEB")
-			{
-				currentWindowMode = WM_WEB;
-				/* launch webbrowser */
-				//keyBoard.SendKey(XF86XK_WWW);
-				continue;
-			}
-			if (mode == "PRESENTATION")
-			{
-				/* launch presentation */
-				currentWindowMode = WM_PRESENTATION;
-				presentationStatus = PS_STOPPED;
-				continue;
 			}
-		}
-
-		/* program keys */
-		if (pcrecpp::RE("PROGRAMKEY\x1e(.*?)\x04").FullMatch(packet, &key))
-		{
-			switch(currentWindowMode)
+			break;
+		case WM_PRESENTATION:
 			{
-				case WM_OTHER:
-					{
-					}
-				break;
-				case WM_MEDIA:
-					{
-						if (key == "PLAYPAUSE")
-						{
-							keyBoard.SendKey(XF86XK_AudioPlay);
-							continue;
-						}
-						if (key == "TRACKPREV")
-						{
-							keyBoard.SendKey(XF86XK_AudioNext);
-							continue;
-						}
-						if (key == "TRACKNEXT")
-						{
-							keyBoard.SendKey(XF86XK_AudioNext);
-							continue;
-						}
-						if (key == "MEDIAPLUS")
-						{
-							keyBoard.SendKey(XF86XK_AudioRaiseVolume);
-							continue;
-						}
-						if (key == "MEDIAMINUS")
-						{
-							keyBoard.SendKey(XF86XK_AudioLowerVolume);
-							continue;
-						}
-						if (key == "MEDIACUSTOMKEY1")
-						{
-							keyBoard.SendKey(XK_F9);
-							continue;
-						}
-						if (key == "MEDIACUSTOMKEY5")
-						{
-							keyBoard.SendKey(XK_F11);
-							continue;
-						}
-					}
-					break;
-				case WM_WEB:
+				if (key == "PRESENTATIONSTART")
+				{
+					if (m_presentationStatus == PS_STOPPED)
 					{
-						if (key == "BROWSERNEWWINDOW")
-						{
-							keyBoard.SendKey(XF86XK_WWW);
-							continue;
-						}
-						if (key == "BROWSERNEWTAB")
-						{
-							std::list<int> keys;
-							keys.push_back(XK_Control_L);
-							keys.push_back('t');
-							keyBoard.SendKey(keys);
-							continue;
-						}
-						if (key == "BROWSERLOCATION")
-						{
-							std::list<int> keys;
-							keys.push_back(XK_Control_L);
-							keys.push_back('l');
-							keyBoard.SendKey(keys);
-							continue;
-						}
-						if (key == "BROWSERBACK")
-						{
-							std::list<int> keys;
-							keys.push_back(XK_Alt_L);
-							keys.push_back(XK_Left);
-							keyBoard.SendKey(keys);
-							continue;
-						}
-						if (key == "BROWSERNEXT")
-						{
-							std::list<int> keys;
-							keys.push_back(XK_Alt_L);
-							keys.push_back(XK_Right);
-							keyBoard.SendKey(keys);
-							continue;
-						}
-						if (key == "BROWSERHOME")
-						{
-							std::list<int> keys;
-							keys.push_back(XK_Alt_L);
-							keys.push_back(XK_Home);
-							keyBoard.SendKey(keys);
-							continue;
-						}
-						if (key == "BROWSERSEARCH")
-						{
-							std::list<int> keys;
-							keys.push_back(XK_Control_L);
-							keys.push_back('k');
-							keyBoard.SendKey(keys);
-							continue;
-						}
-						if (key == "BROWSERRELOAD")
-						{
-							std::list<int> keys;
-							keys.push_back(XK_Control_L);
-							keys.push_back('r');
-							keyBoard.SendKey(keys);
-							continue;
-						}
-						if (key == "BROWSERSTOP")
-						{
-							std::list<int> keys;
-							keys.push_back(XK_Escape);
-							keyBoard.SendKey(keys);
-							continue;
-						}
-						if (key == "BROWSERBOOKMARKS")
-						{
-							std::list<int> keys;
-							keys.push_back(XK_Control_L);
-							keys.push_back('b');
-							keyBoard.SendKey(keys);
-							continue;
-						}
-						if (key == "BROWSERPLUS")
-						{
-							std::list<int> keys;
-							keys.push_back(XK_Control_L);
-							keys.push_back(XK_Tab);
-							keyBoard.SendKey(keys);
-							continue;
-						}
-						if (key == "BROWSERMINUS")
-						{
-							std::list<int> keys;
-							keys.push_back(XK_Control_L);
-							keys.push_back(XK_Shift_L);
-							keys.push_back(XK_Tab);
-							keyBoard.SendKey(keys);
-							continue;
-						}
+						QueueKey(XK_F5);
+						m_presentationStatus = PS_STARTED;
+						return PR_HANDLED;
 					}
-					break;
-				case WM_PRESENTATION:
+					if (m_presentationStatus == PS_STARTED)
 					{
-						if (key == "PRESENTATIONSTART")
-						{
-							if (presentationStatus == PS_STOPPED)
-							{
-								keyBoard.SendKey(XK_F5);
-								presentationStatus = PS_STARTED;
-								continue;
-							}
-							if (presentationStatus == PS_STARTED)
-							{
-								keyBoard.SendKey(XK_Escape);
-								presentationStatus = PS_STOPPED;
-								continue;
-							}
-						}
-						if (key == "PRESENTATIONNEXT")
-						{
-							keyBoard.SendKey(XK_Right);
-							continue;
-						}
-						if (key == "PRESENTATIONBACK")
-						{
-							keyBoard.SendKey(XK_Left);
-							continue;
-						}
+						QueueKey(XK_Escape);
+						m_presentationStatus = PS_STOPPED;
+						return PR_HANDLED;
 					}
-					break;
+				}
+				if (key == "PRESENTATIONNEXT")
+				{
+					QueueKey(XK_Right);
+					return PR_HANDLED;
+				}
+				if (key == "PRESENTATIONBACK")
+				{
+					QueueKey(XK_Left);
+					return PR_HANDLED;
+				}
 			}
-		}
-
-
-		/* promotional links */
-		std::string url;
-		if (pcrecpp::RE("OPENLINK\x1e(.*?)\x04").FullMatch(packet, &url)) {
-			syslog(LOG_INFO, "Promotional link: %s", url.c_str());
-			continue;
-		}
-
-		syslog(LOG_INFO, "[%s] unhandled packet: size(%lu)", address.c_str(), (long unsigned int)packet.size());
-
-		/* dump unhandled packets */
-		if (appConfig.getDebug())
-		{
-			dumpPacket(packet.c_str());
-		}
+			break;
 	}
 
-	syslog(LOG_INFO, "[%s] session ended", address.c_str());
-	return NULL;
+	return PR_UNHANDLED;
 }
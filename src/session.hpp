@@ -20,23 +20,165 @@
 #ifndef _SESSION_HPP_
 #define _SESSION_HPP_
 
+#include <string>
+#include <string_view>
+#include <memory>
+#include <vector>
+
 #include "configuration.hpp"
+#include "devices.hpp"
+#include "protocol.hpp"
+#include "framer.hpp"
+#include "accumulator.hpp"
+#include "acceleration.hpp"
+#include "typing.hpp"
+#include "executor.hpp"
+#include "outbound.hpp"
+#include "handshake.hpp"
+#include "sessioncache.hpp"
+#include "stagestats.hpp"
 
-class SessionContext
+/*
+ * One connected Mobile Mouse client. The session owns its (non-blocking)
+ * socket and is driven by the reactor: OnReadable() is called whenever data
+ * is available and returns false once the session should be torn down.
+ * Output that the socket does not take at once is queued; while Writing(),
+ * OnWritable() is called as the socket drains.
+ * The descriptors of its typing timer, handshake deadline and clipboard
+ * notifications (GetWatched()) are watched as well, and OnWatched() is
+ * called when one becomes readable. The shared devices are only taken up
+ * at login; until the DeviceManager is Ready() the hello is not Reading().
+ * A client that logs in claims its device id once (TakeClaim()); the
+ * reactor then ends any older session of the same device and lets this
+ * one Resume() from the state the device left in the SessionCache.
+ */
+class MobileMouseSession
 {
 	public:
-		SessionContext(Configuration& appConfig, int sock, const std::string address)
-		: m_appConfig(appConfig)
-		, m_sock(sock)
-		, m_address(address)
-		{
-		}
+		MobileMouseSession(Configuration& appConfig, CommandExecutor& executor,
+				DeviceManager& devices, SessionCache& cache, const HandshakeReplies& replies,
+				int sock, const std::string& address);
+		~MobileMouseSession();
+
+		bool OnReadable();
+		bool OnWritable();
+		bool OnWatched(int fd);
+
+		int GetSocket() const;
+		void GetWatched(std::vector<int>& fds) const;
+		const std::string& GetAddress() const;
+		const std::string& GetDeviceId() const;
+		bool TakeClaim();
+		bool TakeWatched();
+		void Resume();
+		bool Reading() const;
+		bool Writing() const;
+		void LogStats();
+
+	private:
+		enum SessionState {
+			SS_HANDSHAKE,
+			SS_REJECTED,
+			SS_ACTIVE
+		};
+
+		enum WindowMode {
+			WM_OTHER,
+			WM_MEDIA,
+			WM_WEB,
+			WM_PRESENTATION
+		};
+
+		enum PresentationStatus {
+			PS_STOPPED,
+			PS_STARTED
+		};
+
+		enum PacketResult {
+			PR_HANDLED,
+			PR_UNHANDLED,
+			PR_DISCONNECT
+		};
+
+		bool HandleHello(std::string_view raw);
+		bool HandlePacket(std::string_view raw);
+		PacketResult DispatchPacket(const Packet& packet);
+
+		PacketResult HandleSetOption(std::string_view option, std::string_view optval);
+		PacketResult HandleClick(MouseInterface::MouseButton button, MouseInterface::MouseState state, std::string_view modifier);
+		PacketResult HandleMove(MotionFixed dx, MotionFixed dy);
+		PacketResult HandleScroll(MotionFixed dx, MotionFixed dy);
+		PacketResult HandleZoom(int zoom);
+		PacketResult HandleKey(std::string_view chr, std::string_view utf8, std::string_view modifier);
+		PacketResult HandleKeyString(std::string_view keystring);
+		bool Paste(std::string_view text);
+		PacketResult HandleGesture(std::string_view gesture);
+		PacketResult HandleHotKey(std::string_view hotkey);
+		PacketResult HandleSwitchMode(std::string_view mode);
+		PacketResult HandleProgramKey(std::string_view key);
+		void QueueKey(int keysym);
+		void QueueKey(const std::list<int>& keys);
+		PacketResult RunCommand(const CommandLine& command);
+		bool SendClipboard(bool always);
+		bool Send(std::string_view message);
+		bool Flush();
+		void TuneSocket();
+		void QuickAck();
+
+		void InjectMove(MotionFixed dx, MotionFixed dy, const struct timespec& when);
+		void InjectScroll(MotionFixed dx, MotionFixed dy);
+		void FlushMotion();
 
 		Configuration& m_appConfig;
+		CommandExecutor& m_executor;
+		SessionCache& m_cache;
+		const HandshakeReplies& m_replies;
 		int m_sock;
+		bool m_tcp;	/* false for a Unix socket, which has no TCP options */
 		std::string m_address;
-};
+		SessionState m_state;
+		int m_handshakeTimer;	/* -1 without a deadline */
+		std::string m_deviceId;	/* empty until logged in */
+		bool m_claim;
+
+		/* shared with every session; leased once the client has logged in */
+		DeviceManager& m_devices;
+		std::unique_ptr<DeviceLease> m_lease;
+		MouseInterface* m_mouse;	/* NULL until logged in */
+		KeyboardInterface* m_keyboard;
+		ClipboardInterface* m_clipboard;
+		ClipboardWatcher* m_watcher;
+		TypingQueue m_typing;
+
+		/* CLIPBOARDSYNC; m_clipboardSent is the hash of what the client has */
+		int m_clipboardEvents;	/* -1 until logged in */
+		bool m_watch;
+		bool m_clipboardSync;
+		uint64_t m_clipboardSent;
 
-void* MobileMouseSession(void* context);
+		PacketFramer m_framer;
+		OutboundQueue m_outbound;
+		struct timespec m_received;	/* arrival of the packet being handled */
+
+		/* motion coalesced from the current read batch, or the backlog */
+		bool m_pendingMove, m_pendingScroll;
+		MotionFixed m_moveX, m_moveY;
+		struct timespec m_moveTime;
+		MotionFixed m_scrollX, m_scrollY;
+		bool m_backlogged;	/* motion is held until the backlog is read */
+		unsigned long m_motionMerged;
+		unsigned long m_motionFolded;
+		struct timespec m_connected;
+		bool m_moved;	/* first motion since connect injected */
+		StageStats m_readStats;	/* one job per read, packets framed as depth */
+
+		/* sub-pixel (and sub-detent) remainders carried between packets */
+		MotionAccumulator m_pointer;
+		MotionAccumulator m_scroll;
+
+		PointerAccelerator m_accelerator;
+		WindowMode m_windowMode;
+		PresentationStatus m_presentationStatus;
+};
 
 #endif
@@ -0,0 +1,91 @@
+/*
+   Mobile Mouse Linux Server 
+   Copyright (C) 2011 Erik Lax <erik@datahack.se>
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "sessioncache.hpp"
+
+static bool Before(const struct timespec& a, const struct timespec& b)
+{
+	return a.tv_sec < b.tv_sec || (a.tv_sec == b.tv_sec && a.tv_nsec < b.tv_nsec);
+}
+
+/*
+ * Parameters:
+ *   ttl, seconds a snapshot is kept after Store()
+ */
+SessionCache::SessionCache(unsigned int ttl)
+: m_ttl(ttl)
+{
+}
+
+void SessionCache::Store(const std::string& id, const SessionSnapshot& state)
+{
+	if (m_ttl == 0) {
+		return;
+	}
+
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	Expire(now);
+
+	/* all expire after the same ttl, so the oldest expires first */
+	if (m_entries.size() >= SESSIONCACHE_MAX_DEVICES && m_entries.find(id) == m_entries.end()) {
+		std::map<std::string, Entry>::iterator oldest = m_entries.begin();
+		for (std::map<std::string, Entry>::iterator i = m_entries.begin(); i != m_entries.end(); i++) {
+			if (Before(i->second.expires, oldest->second.expires)) {
+				oldest = i;
+			}
+		}
+		m_entries.erase(oldest);
+	}
+
+	Entry& entry = m_entries[id];
+	entry.state = state;
+	entry.expires = now;
+	entry.expires.tv_sec += m_ttl;
+}
+
+/*
+ * Return Value:
+ *   true if a snapshot of id was still kept; it is handed over and forgotten
+ */
+bool SessionCache::Take(const std::string& id, SessionSnapshot& state)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	Expire(now);
+
+	std::map<std::string, Entry>::iterator i = m_entries.find(id);
+	if (i == m_entries.end()) {
+		return false;
+	}
+	state = i->second.state;
+	m_entries.erase(i);
+	return true;
+}
+
+void SessionCache::Expire(const struct timespec& now)
+{
+	for (std::map<std::string, Entry>::iterator i = m_entries.begin(); i != m_entries.end(); ) {
+		if (Before(i->second.expires, now)) {
+			m_entries.erase(i++);
+		} else {
+			i++;
+		}
+	}
+}
@@ -0,0 +1,68 @@
+/*
+   Mobile Mouse Linux Server 
+   Copyright (C) 2011 Erik Lax <erik@datahack.se>
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef _SESSIONCACHE_HPP_
+#define _SESSIONCACHE_HPP_
+
+#include <stdint.h>
+#include <time.h>
+#include <map>
+#include <string>
+
+#include "accumulator.hpp"
+
+/* devices remembered at most; the oldest is forgotten first */
+#define SESSIONCACHE_MAX_DEVICES 32
+
+/* what a session knows about its client that the client does not resend */
+struct SessionSnapshot {
+	int windowMode;
+	int presentationStatus;
+	bool clipboardSync;
+	uint64_t clipboardSent;
+	MotionAccumulator pointer;
+	MotionAccumulator scroll;
+};
+
+/*
+ * Session state kept by device id for a while after the session ends, so
+ * that a phone which drops off the network and comes back picks up where
+ * it left off. Only touched by the reactor thread.
+ */
+class SessionCache
+{
+	public:
+		SessionCache(unsigned int ttl);
+
+		void Store(const std::string& id, const SessionSnapshot& state);
+		bool Take(const std::string& id, SessionSnapshot& state);
+
+	private:
+		struct Entry {
+			SessionSnapshot state;
+			struct timespec expires;
+		};
+
+		void Expire(const struct timespec& now);
+
+		unsigned int m_ttl;	/* seconds; 0 keeps nothing */
+		std::map<std::string, Entry> m_entries;
+};
+
+#endif
@@ -0,0 +1,91 @@
+/*
+   Mobile Mouse Linux Server 
+   Copyright (C) 2011 Erik Lax <erik@datahack.se>
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef _SPSCRING_HPP_
+#define _SPSCRING_HPP_
+
+#include <stddef.h>
+#include <atomic>
+
+/*
+ * Bounded lock-free queue between exactly one producer thread and one
+ * consumer thread. Slots are filled and emptied in place: the producer
+ * writes into Reserve() and publishes it with Commit(), the consumer
+ * reads Front() and hands the slot back with Release(). N must be a
+ * power of two.
+ */
+template <typename T, size_t N>
+class SpscRing
+{
+	static_assert(N > 0 && (N & (N - 1)) == 0, "ring size must be a power of two");
+
+	public:
+		SpscRing()
+		: m_head(0)
+		, m_tail(0)
+		{
+		}
+
+		/* producer: the next free slot, or NULL while the ring is full */
+		T* Reserve()
+		{
+			size_t head = m_head.load(std::memory_order_relaxed);
+			if (head - m_tail.load(std::memory_order_acquire) == N) {
+				return NULL;
+			}
+			return &m_slots[head & (N - 1)];
+		}
+
+		void Commit()
+		{
+			m_head.store(m_head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+		}
+
+		/* consumer: the oldest committed slot, or NULL while the ring is empty */
+		T* Front()
+		{
+			size_t tail = m_tail.load(std::memory_order_relaxed);
+			if (tail == m_head.load(std::memory_order_acquire)) {
+				return NULL;
+			}
+			return &m_slots[tail & (N - 1)];
+		}
+
+		void Release()
+		{
+			m_tail.store(m_tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+		}
+
+		/* committed and not yet released; a snapshot from any thread */
+		size_t Size() const
+		{
+			return m_head.load(std::memory_order_acquire) - m_tail.load(std::memory_order_acquire);
+		}
+
+	private:
+		SpscRing(const SpscRing&);
+		SpscRing& operator=(const SpscRing&);
+
+		/* on lines of their own, so the two sides do not share a cache line */
+		alignas(64) std::atomic<size_t> m_head;	/* written by the producer */
+		alignas(64) std::atomic<size_t> m_tail;	/* written by the consumer */
+		alignas(64) T m_slots[N];
+};
+
+#endif
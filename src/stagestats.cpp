@@ -0,0 +1,84 @@
+/*
+   Mobile Mouse Linux Server 
+   Copyright (C) 2011 Erik Lax <erik@datahack.se>
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "stagestats.hpp"
+
+#include <syslog.h>
+
+struct timespec StageClock()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now;
+}
+
+/* only the recording thread stores a maximum, so load and store suffice */
+static void Raise(std::atomic<unsigned long>& max, unsigned long value)
+{
+	if (value > max.load(std::memory_order_relaxed)) {
+		max.store(value, std::memory_order_relaxed);
+	}
+}
+
+StageStats::StageStats()
+: m_jobs(0)
+, m_totalUsec(0)
+, m_maxUsec(0)
+, m_totalDepth(0)
+, m_maxDepth(0)
+{
+}
+
+/*
+ * Parameters:
+ *   start, StageClock() when the job was taken up
+ *   depth, jobs that were queued for the stage at that point
+ */
+void StageStats::Record(const struct timespec& start, size_t depth)
+{
+	struct timespec end = StageClock();
+	unsigned long usec = (end.tv_sec - start.tv_sec) * 1000000L
+		+ (end.tv_nsec - start.tv_nsec) / 1000L;
+
+	m_jobs.fetch_add(1, std::memory_order_relaxed);
+	m_totalUsec.fetch_add(usec, std::memory_order_relaxed);
+	m_totalDepth.fetch_add(depth, std::memory_order_relaxed);
+	Raise(m_maxUsec, usec);
+	Raise(m_maxDepth, depth);
+}
+
+void StageStats::Log(const char* stage)
+{
+	unsigned long jobs = m_jobs.exchange(0, std::memory_order_relaxed);
+	unsigned long totalUsec = m_totalUsec.exchange(0, std::memory_order_relaxed);
+	unsigned long maxUsec = m_maxUsec.exchange(0, std::memory_order_relaxed);
+	unsigned long totalDepth = m_totalDepth.exchange(0, std::memory_order_relaxed);
+	unsigned long maxDepth = m_maxDepth.exchange(0, std::memory_order_relaxed);
+
+	if (jobs == 0) {
+		return;
+	}
+	syslog(LOG_INFO, "%s stage: %lu jobs, service %lu us avg %lu us max, queue depth %.1f avg %lu max",
+			stage,
+			jobs,
+			totalUsec / jobs,
+			maxUsec,
+			(double)totalDepth / (double)jobs,
+			maxDepth);
+}
@@ -0,0 +1,51 @@
+/*
+   Mobile Mouse Linux Server 
+   Copyright (C) 2011 Erik Lax <erik@datahack.se>
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef _STAGESTATS_HPP_
+#define _STAGESTATS_HPP_
+
+#include <stddef.h>
+#include <time.h>
+#include <atomic>
+
+/* now, on the clock the pipeline stages are timed with */
+struct timespec StageClock();
+
+/*
+ * How long one pipeline stage spends on each job, and how much work was
+ * waiting for it when it started. The stage's own thread records; Log()
+ * may be called from any thread and starts a new interval.
+ */
+class StageStats
+{
+	public:
+		StageStats();
+
+		void Record(const struct timespec& start, size_t depth);
+		void Log(const char* stage);
+
+	private:
+		std::atomic<unsigned long> m_jobs;
+		std::atomic<unsigned long> m_totalUsec;
+		std::atomic<unsigned long> m_maxUsec;
+		std::atomic<unsigned long> m_totalDepth;
+		std::atomic<unsigned long> m_maxDepth;
+};
+
+#endif
@@ -0,0 +1,210 @@
+/*
+   Mobile Mouse Linux Server 
+   Copyright (C) 2011 Erik Lax <erik@datahack.se>
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "typing.hpp"
+
+#include <sys/timerfd.h>
+#include <errno.h>
+#include <string.h>
+#include <syslog.h>
+#include <unistd.h>
+#include <stdexcept>
+
+#include "utf8.hpp"
+
+/*
+ * Parameters:
+ *   rate, most key transitions per second; 0 delivers everything at once
+ */
+TypingQueue::TypingQueue(unsigned int rate)
+: m_next(0)
+, m_rate(rate)
+, m_timer(-1)
+, m_armed(false)
+{
+	if ((m_timer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)) < 0)
+	{
+		throw std::runtime_error("cannot create typing timer");
+	}
+}
+
+TypingQueue::~TypingQueue()
+{
+	close(m_timer);
+}
+
+void TypingQueue::Add(int keysym, bool press)
+{
+	KeyStroke stroke;
+	stroke.keysym = keysym;
+	stroke.press = press;
+	m_strokes.push_back(stroke);
+}
+
+/*
+ * Parameters:
+ *   keyboard, answers which characters need Shift
+ *   text, UTF-8 characters to type
+ */
+void TypingQueue::Type(KeyboardInterface& keyboard, std::string_view text)
+{
+	bool shifted = false;
+	uint32_t codepoint;
+	while (Utf8Next(text, codepoint))
+	{
+		int keysym = CodepointToKeysym(codepoint);
+		if (keysym == 0) {
+			continue;
+		}
+		bool shift = keyboard.keysymIsShiftVariant((KeySym)keysym);
+		if (shift != shifted) {
+			Add(XK_Shift_L, shift);
+			shifted = shift;
+		}
+		Add(keysym, true);
+		Add(keysym, false);
+	}
+	if (shifted) {
+		Add(XK_Shift_L, false);
+	}
+}
+
+/* queues keys pressed in order and released in reverse, like SendKey() */
+void TypingQueue::Chord(const std::list<int>& keys)
+{
+	for (std::list<int>::const_iterator i = keys.begin(); i != keys.end(); i++) {
+		Add(*i, true);
+	}
+	for (std::list<int>::const_reverse_iterator i = keys.rbegin(); i != keys.rend(); i++) {
+		Add(*i, false);
+	}
+}
+
+/* delivers what may go now; the rest follows from OnTimer() */
+void TypingQueue::Submit(KeyboardInterface& keyboard)
+{
+	if (m_armed) {
+		return;
+	}
+
+	size_t chunk = TYPING_CHUNK_STROKES;
+	if (m_rate > 0) {
+		chunk = m_rate * TYPING_TICK_MSEC / 1000;
+		if (chunk < 1) {
+			chunk = 1;
+		}
+		if (chunk > TYPING_CHUNK_STROKES) {
+			chunk = TYPING_CHUNK_STROKES;
+		}
+	}
+
+	while (m_next < m_strokes.size())
+	{
+		size_t count = m_strokes.size() - m_next;
+		if (count > chunk) {
+			count = chunk;
+		}
+		keyboard.SendStrokes(&m_strokes[m_next], count);
+		m_next += count;
+
+		if (m_rate > 0) {
+			Arm((uint64_t)count * 1000000000ULL / m_rate);
+			break;
+		}
+	}
+
+	if (m_next == m_strokes.size()) {
+		m_strokes.clear();
+		m_next = 0;
+	}
+}
+
+void TypingQueue::OnTimer(KeyboardInterface& keyboard)
+{
+	uint64_t expirations;
+	if (read(m_timer, &expirations, sizeof(expirations)) < 0 && errno == EAGAIN) {
+		return;
+	}
+	m_armed = false;
+	Submit(keyboard);
+}
+
+/* delivers the rest at once, for keys that must not overtake it */
+void TypingQueue::Flush(KeyboardInterface& keyboard)
+{
+	if (!Pending()) {
+		return;
+	}
+	keyboard.SendStrokes(&m_strokes[m_next], m_strokes.size() - m_next);
+	m_strokes.clear();
+	m_next = 0;
+	Arm(0);
+}
+
+/* drops what has not been typed yet, releasing keys it left pressed */
+void TypingQueue::Cancel(KeyboardInterface& keyboard)
+{
+	std::vector<KeyStroke> releases;
+	for (size_t i = m_next; i < m_strokes.size(); i++)
+	{
+		if (m_strokes[i].press) {
+			continue;
+		}
+		bool pressedLater = false;
+		for (size_t j = m_next; j < i; j++) {
+			if (m_strokes[j].press && m_strokes[j].keysym == m_strokes[i].keysym) {
+				pressedLater = true;
+				break;
+			}
+		}
+		if (!pressedLater) {
+			releases.push_back(m_strokes[i]);
+		}
+	}
+	if (!releases.empty()) {
+		keyboard.SendStrokes(&releases[0], releases.size());
+	}
+
+	m_strokes.clear();
+	m_next = 0;
+	Arm(0);
+}
+
+bool TypingQueue::Pending() const
+{
+	return m_next < m_strokes.size();
+}
+
+int TypingQueue::GetTimer() const
+{
+	return m_timer;
+}
+
+/* arms the one-shot timer; 0 disarms it */
+void TypingQueue::Arm(uint64_t nsec)
+{
+	struct itimerspec when;
+	memset(&when, 0, sizeof(when));
+	when.it_value.tv_sec = (time_t)(nsec / 1000000000ULL);
+	when.it_value.tv_nsec = (long)(nsec % 1000000000ULL);
+	if (timerfd_settime(m_timer, 0, &when, NULL) < 0) {
+		syslog(LOG_ERR, "timerfd_settime: %s", strerror(errno));
+	}
+	m_armed = nsec > 0;
+}
@@ -0,0 +1,73 @@
+/*
+   Mobile Mouse Linux Server 
+   Copyright (C) 2011 Erik Lax <erik@datahack.se>
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef _TYPING_HPP_
+#define _TYPING_HPP_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <list>
+#include <string_view>
+#include <vector>
+
+#include "keyboardinterface.hpp"
+
+/* most key transitions delivered with one flush */
+#define TYPING_CHUNK_STROKES 64
+
+/* interval between paced chunks when a typing rate is set */
+#define TYPING_TICK_MSEC 10
+
+/*
+ * Turns typed text into a flat sequence of key transitions and delivers it
+ * in chunks, one flush per chunk. Shift is pressed and released only where
+ * the text changes between plain and shifted characters. With a rate set,
+ * chunks are spaced by a timer (GetTimer(), to be watched for readability)
+ * so that slow clients are not handed more key events than they can take;
+ * keys queued meanwhile wait their turn behind the text.
+ */
+class TypingQueue
+{
+	public:
+		TypingQueue(unsigned int rate = 0);
+		~TypingQueue();
+
+		void Type(KeyboardInterface& keyboard, std::string_view text);
+		void Chord(const std::list<int>& keys);
+
+		void Submit(KeyboardInterface& keyboard);
+		void OnTimer(KeyboardInterface& keyboard);
+		void Flush(KeyboardInterface& keyboard);
+		void Cancel(KeyboardInterface& keyboard);
+
+		bool Pending() const;
+		int GetTimer() const;
+
+	private:
+		void Add(int keysym, bool press);
+		void Arm(uint64_t nsec);
+
+		std::vector<KeyStroke> m_strokes;
+		size_t m_next;
+		unsigned int m_rate;
+		int m_timer;
+		bool m_armed;
+};
+
+#endif
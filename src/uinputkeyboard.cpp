@@ -0,0 +1,145 @@
+/*
+   Mobile Mouse Linux Server 
+   Copyright (C) 2011 Erik Lax <erik@datahack.se>
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "uinputkeyboard.hpp"
+
+#include <xkbcommon/xkbcommon.h>
+#include <stdexcept>
+#include <string.h>
+
+/*
+ * Parameters:
+ *   injector, stage that writes the key events
+ *   layout, xkb layout name (empty for the xkbcommon default)
+ *   variant, xkb layout variant (may be empty)
+ */
+UinputKeyboard::UinputKeyboard(InputInjector& injector, bool enabled, const std::string& layout, const std::string& variant)
+: KeyboardInterface(enabled)
+, m_injector(injector)
+, m_dev(NULL)
+, m_uidev(NULL)
+, m_level3(0)
+, m_shift(0)
+{
+	struct xkb_context* context = xkb_context_new(XKB_CONTEXT_NO_FLAGS);
+	if (context == NULL) {
+		throw std::runtime_error("cannot create xkb context");
+	}
+
+	struct xkb_rule_names names;
+	memset(&names, 0, sizeof(names));
+	names.layout = layout.empty() ? NULL : layout.c_str();
+	names.variant = variant.empty() ? NULL : variant.c_str();
+
+	struct xkb_keymap* keymap = xkb_keymap_new_from_names(context, &names, XKB_KEYMAP_COMPILE_NO_FLAGS);
+	xkb_context_unref(context);
+	if (keymap == NULL) {
+		throw std::runtime_error("cannot compile xkb keymap");
+	}
+
+	xkb_keycode_t minKeycode = xkb_keymap_min_keycode(keymap);
+	xkb_keycode_t maxKeycode = xkb_keymap_max_keycode(keymap);
+	if (minKeycode < UINPUT_XKB_KEYCODE_OFFSET + 1) {
+		minKeycode = UINPUT_XKB_KEYCODE_OFFSET + 1;
+	}
+	if (maxKeycode > 255) {
+		maxKeycode = 255;
+	}
+
+	// first layout only; same precedence as the X keymap snapshot
+	m_keymap.Build(keymap, minKeycode, maxKeycode);
+	xkb_keymap_unref(keymap);
+
+	// the keys that select levels 2 and 3 are held around those keysyms
+	unsigned int level;
+	if (!m_keymap.Lookup(XK_ISO_Level3_Shift, m_level3, level)) {
+		m_level3 = 0;
+	}
+	if (!m_keymap.Lookup(XK_Shift_L, m_shift, level)) {
+		m_shift = 0;
+	}
+
+	m_dev = libevdev_new();
+	libevdev_set_name(m_dev, "mmouse keyboard");
+	libevdev_enable_event_type(m_dev, EV_KEY);
+	for (xkb_keycode_t keycode = minKeycode; keycode <= maxKeycode; keycode++) {
+		libevdev_enable_event_code(m_dev, EV_KEY, keycode - UINPUT_XKB_KEYCODE_OFFSET, nullptr);
+	}
+
+	int err = libevdev_uinput_create_from_device(m_dev, LIBEVDEV_UINPUT_OPEN_MANAGED, &m_uidev);
+	if (err != 0) {
+		libevdev_free(m_dev);
+		throw std::runtime_error(std::string("cannot create uinput keyboard: ") + strerror(-err));
+	}
+	m_batch.SetDevice(libevdev_uinput_get_fd(m_uidev), &m_injector);
+}
+
+UinputKeyboard::~UinputKeyboard()
+{
+	m_batch.Flush();
+	m_injector.Sync();
+	libevdev_uinput_destroy(m_uidev);
+	libevdev_free(m_dev);
+}
+
+// AltGr (and Shift for level 3) is held around keys of levels 2 and 3
+void UinputKeyboard::KeyEvent(int keysym, bool press)
+{
+	KeyCode keycode;
+	unsigned int level;
+	if (!m_keymap.Lookup((KeySym)keysym, keycode, level)) {
+		return;
+	}
+
+	if (press && level >= 2) {
+		WriteKey(m_level3, true);
+		if (level == 3) {
+			WriteKey(m_shift, true);
+		}
+	}
+	WriteKey(keycode, press);
+	if (!press && level >= 2) {
+		if (level == 3) {
+			WriteKey(m_shift, false);
+		}
+		WriteKey(m_level3, false);
+	}
+}
+
+// each key transition is a report of its own, as from a real keyboard
+void UinputKeyboard::WriteKey(KeyCode keycode, bool press)
+{
+	if (keycode == 0) {
+		return;
+	}
+	m_batch.Add(EV_KEY, (unsigned short)(keycode - UINPUT_XKB_KEYCODE_OFFSET), press ? 1 : 0);
+	m_batch.Sync();
+}
+
+void UinputKeyboard::Flush()
+{
+	m_batch.Flush();
+}
+
+bool UinputKeyboard::keysymIsShiftVariant(KeySym key)
+{
+	KeyCode keycode;
+	unsigned int level;
+	return m_keymap.Lookup(key, keycode, level) && level == 1;
+}
@@ -0,0 +1,65 @@
+/*
+   Mobile Mouse Linux Server 
+   Copyright (C) 2011 Erik Lax <erik@datahack.se>
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef _UINPUTKEYBOARD_HPP_
+#define _UINPUTKEYBOARD_HPP_
+
+#include <libevdev/libevdev-uinput.h>
+#include <string>
+#include <list>
+
+#include "keyboardinterface.hpp"
+#include "keymap.hpp"
+#include "eventbatch.hpp"
+#include "injector.hpp"
+
+/* xkb keycodes are evdev key codes offset by this */
+#define UINPUT_XKB_KEYCODE_OFFSET 8
+
+/*
+ * Keyboard backend that writes key events to a uinput keyboard of its own,
+ * next to the uinput mouse, without going through the X server. Keysyms
+ * are translated with an xkbcommon keymap compiled from the configured
+ * layout, which has to match the layout the desktop applies to it. Its
+ * events share the mouse's injector, and so stay in order with clicks.
+ */
+class UinputKeyboard : public KeyboardInterface
+{
+	public:
+		UinputKeyboard(InputInjector& injector, bool enabled, const std::string& layout, const std::string& variant);
+		~UinputKeyboard();
+
+		bool keysymIsShiftVariant(KeySym key);
+
+	protected:
+		void KeyEvent(int keysym, bool press);
+		void Flush();
+
+	private:
+		void WriteKey(KeyCode keycode, bool press);
+
+		InputInjector& m_injector;
+		struct libevdev *m_dev;
+		struct libevdev_uinput *m_uidev;
+		InputEventBatch m_batch;
+		KeymapCache m_keymap;
+		KeyCode m_level3;	/* ISO_Level3_Shift; 0 if the layout has none */
+		KeyCode m_shift;
+};
+#endif
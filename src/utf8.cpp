@@ -0,0 +1,118 @@
+/*
+   Mobile Mouse Linux Server 
+   Copyright (C) 2011 Erik Lax <erik@datahack.se>
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "utf8.hpp"
+
+#include <X11/keysym.h>
+#include <xkbcommon/xkbcommon.h>
+
+#define UTF8_REPLACEMENT 0xfffd
+
+/*
+ * Parameters:
+ *   text, UTF-8 input; the decoded sequence is removed from its front
+ *   codepoint, set to the decoded character; malformed input yields
+ *   U+FFFD for the offending byte
+ *
+ * Return Value:
+ *   false if text was empty
+ */
+bool Utf8Next(std::string_view& text, uint32_t& codepoint)
+{
+	if (text.empty()) {
+		return false;
+	}
+
+	unsigned char lead = (unsigned char)text[0];
+	size_t length;
+	uint32_t min;
+	if (lead < 0x80) {
+		codepoint = lead;
+		text.remove_prefix(1);
+		return true;
+	} else if ((lead & 0xe0) == 0xc0) {
+		length = 2;
+		min = 0x80;
+		codepoint = lead & 0x1f;
+	} else if ((lead & 0xf0) == 0xe0) {
+		length = 3;
+		min = 0x800;
+		codepoint = lead & 0x0f;
+	} else if ((lead & 0xf8) == 0xf0) {
+		length = 4;
+		min = 0x10000;
+		codepoint = lead & 0x07;
+	} else {
+		codepoint = UTF8_REPLACEMENT;
+		text.remove_prefix(1);
+		return true;
+	}
+
+	if (text.size() < length) {
+		codepoint = UTF8_REPLACEMENT;
+		text.remove_prefix(1);
+		return true;
+	}
+	for (size_t i = 1; i < length; i++) {
+		unsigned char c = (unsigned char)text[i];
+		if ((c & 0xc0) != 0x80) {
+			codepoint = UTF8_REPLACEMENT;
+			text.remove_prefix(1);
+			return true;
+		}
+		codepoint = (codepoint << 6) | (c & 0x3f);
+	}
+
+	/* overlong forms, surrogates and values past Unicode are not characters */
+	if (codepoint < min || codepoint > 0x10ffff || (codepoint >= 0xd800 && codepoint <= 0xdfff)) {
+		codepoint = UTF8_REPLACEMENT;
+		text.remove_prefix(1);
+		return true;
+	}
+	text.remove_prefix(length);
+	return true;
+}
+
+/*
+ * Return Value:
+ *   keysym that types the code point: the legacy keysym where there is
+ *   one (EuroSign, Cyrillic_*, ...), as keymaps bind those, or else the
+ *   Unicode keysym; 0 for control characters that have no key
+ */
+int CodepointToKeysym(uint32_t codepoint)
+{
+	switch (codepoint) {
+		case '\b': return XK_BackSpace;
+		case '\t': return XK_Tab;
+		case '\n':
+		case '\r': return XK_Return;
+		case 0x1b: return XK_Escape;
+		case 0x7f: return XK_Delete;
+	}
+
+	if (codepoint < 0x20 || (codepoint >= 0x80 && codepoint < 0xa0)) {
+		return 0;
+	}
+
+	xkb_keysym_t keysym = xkb_utf32_to_keysym(codepoint);
+	if (keysym == XKB_KEY_NoSymbol) {
+		return (int)(UNICODE_KEYSYM_OFFSET | codepoint);
+	}
+	return (int)keysym;
+}
@@ -0,0 +1,32 @@
+/*
+   Mobile Mouse Linux Server 
+   Copyright (C) 2011 Erik Lax <erik@datahack.se>
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef _UTF8_HPP_
+#define _UTF8_HPP_
+
+#include <stdint.h>
+#include <string_view>
+
+/* Unicode keysyms are the code point offset by this */
+#define UNICODE_KEYSYM_OFFSET 0x01000000
+
+bool Utf8Next(std::string_view& text, uint32_t& codepoint);
+int CodepointToKeysym(uint32_t codepoint);
+
+#endif
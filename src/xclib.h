@@ -1,38 +0,0 @@
-/*
- *  xclib.h - header file for functions in xclib.c
- *  Copyright (C) 2001 Kim Saunders
- *  Copyright (C) 2007-2008 Peter Åstrand
- *
- *  This program is free software; you can redistribute it and/or modify
- *  it under the terms of the GNU General Public License as published by
- *  the Free Software Foundation; either version 2 of the License, or
- *  (at your option) any later version.
- *
- *  This program is distributed in the hope that it will be useful,
- *  but WITHOUT ANY WARRANTY; without even the implied warranty of
- *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
- *  GNU General Public License for more details.
- *  You should have received a copy of the GNU General Public License
- *  along with this program; if not, write to the Free Software
- *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
- */
-
-#include <X11/Xlib.h>
-
-/* xcout() contexts */
-#define XCLIB_XCOUT_NONE	0	/* no context */
-#define XCLIB_XCOUT_SENTCONVSEL	1	/* sent a request */
-#define XCLIB_XCOUT_INCR	2	/* in an incr loop */
-#define XCLIB_XCOUT_FALLBACK	3	/* UTF8_STRING failed, need fallback to XA_STRING */
-
-/* functions in xclib.c */
-extern int xcout(
-	Display*,
-	Window,
-	XEvent,
-	Atom,
-	Atom,
-	unsigned char**,
-	unsigned long*,
-	unsigned int*
-);
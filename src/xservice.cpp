@@ -0,0 +1,306 @@
+/*
+   Mobile Mouse Linux Server 
+   Copyright (C) 2011 Erik Lax <erik@datahack.se>
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "xservice.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <errno.h>
+#include <poll.h>
+#include <stdint.h>
+#include <string.h>
+#include <syslog.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+/* the service whose thread this is, if any */
+static thread_local const XService* t_service = NULL;
+
+XServiceClient::~XServiceClient()
+{
+}
+
+int XServiceClient::Idle()
+{
+	return -1;
+}
+
+/*
+ * Requests on windows of other clients can fail when those go away
+ * meanwhile (a paste requestor closing mid-transfer); Xlib's default
+ * handler would exit the server for that.
+ */
+static int LogXError(Display* display, XErrorEvent* err)
+{
+	char text[128];
+	XGetErrorText(display, err->error_code, text, sizeof(text));
+	syslog(LOG_WARNING, "X error ignored: %s (request %d, resource 0x%lx)", text, err->request_code, err->resourceid);
+	return 0;
+}
+
+XService::XService(const std::string display)
+: m_signalled(false)
+, m_stop(false)
+, m_head(&m_stub)
+, m_tail(&m_stub)
+{
+	m_stub.next.store(NULL);
+
+	if ((m_display = XOpenDisplay(display.empty()?NULL:display.c_str())) == NULL) {
+		throw std::runtime_error("cannot open xdisplay");
+	}
+	XSetErrorHandler(LogXError);
+
+	if ((m_wake = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0) {
+		XCloseDisplay(m_display);
+		throw std::runtime_error("cannot create X thread eventfd");
+	}
+
+	if (pthread_create(&m_thread, NULL, Thread, this) != 0) {
+		close(m_wake);
+		XCloseDisplay(m_display);
+		throw std::runtime_error("cannot start X thread");
+	}
+}
+
+/* what is still queued is run before the connection closes */
+XService::~XService()
+{
+	m_stop.store(true);
+	uint64_t one = 1;
+	if (write(m_wake, &one, sizeof(one)) < 0) {
+		syslog(LOG_ERR, "cannot stop X thread: %s", strerror(errno));
+	}
+	pthread_join(m_thread, NULL);
+
+	close(m_wake);
+	XCloseDisplay(m_display);
+}
+
+/* only to be used from tasks, on the X thread */
+Display* XService::GetDisplay() const
+{
+	return m_display;
+}
+
+/* queues task for the X thread without waiting for it */
+void XService::Post(const Task& task)
+{
+	if (OnThread()) {
+		task(m_display);
+		return;
+	}
+
+	Node* node = new Node;
+	node->task = task;
+	Push(node);
+
+	/* the first post since the thread last woke up wakes it again */
+	if (!m_signalled.exchange(true)) {
+		uint64_t one = 1;
+		if (write(m_wake, &one, sizeof(one)) < 0) {
+			syslog(LOG_ERR, "cannot wake X thread: %s", strerror(errno));
+		}
+	}
+}
+
+/* runs task on the X thread and returns once it has */
+void XService::Wait(const Task& task)
+{
+	if (OnThread()) {
+		task(m_display);
+		return;
+	}
+
+	std::shared_ptr<std::promise<void> > done = std::make_shared<std::promise<void> >();
+	std::future<void> result = done->get_future();
+	Post([done, task](Display* display) {
+		try {
+			task(display);
+			done->set_value();
+		}
+		catch (...) {
+			done->set_exception(std::current_exception());
+		}
+	});
+	result.get();
+}
+
+void XService::AddClient(XServiceClient* client)
+{
+	Wait([this, client](Display*) {
+		m_clients.push_back(client);
+	});
+}
+
+/* once this returns, the client gets no more calls */
+void XService::RemoveClient(XServiceClient* client)
+{
+	Wait([this, client](Display*) {
+		m_clients.erase(std::remove(m_clients.begin(), m_clients.end(), client), m_clients.end());
+	});
+}
+
+StageStats& XService::GetStats()
+{
+	return m_stats;
+}
+
+void* XService::Thread(void* arg)
+{
+	((XService*)arg)->Loop();
+	return NULL;
+}
+
+void XService::Loop()
+{
+	t_service = this;
+
+	while (1) {
+		uint64_t posts;
+		if (read(m_wake, &posts, sizeof(posts)) < 0 && errno != EAGAIN) {
+			syslog(LOG_ERR, "X thread eventfd: %s", strerror(errno));
+		}
+		m_signalled.store(false);
+
+		struct timespec start = StageClock();
+		size_t tasks = Drain();
+
+		while (XPending(m_display) > 0) {
+			XEvent evt;
+			XNextEvent(m_display, &evt);
+			Dispatch(evt);
+		}
+
+		int timeout = -1;
+		for (std::vector<XServiceClient*>::iterator i = m_clients.begin(); i != m_clients.end(); i++) {
+			int wait = (*i)->Idle();
+			if (wait >= 0 && (timeout < 0 || wait < timeout)) {
+				timeout = wait;
+			}
+		}
+
+		/* everything the tasks and clients asked for goes out at once */
+		XFlush(m_display);
+		m_stats.Record(start, tasks);
+
+		if (m_stop.load()) {
+			Drain();
+			XFlush(m_display);
+			return;
+		}
+
+		/* replies read meanwhile may have brought events along */
+		if (XQLength(m_display) > 0) {
+			continue;
+		}
+
+		struct pollfd fds[2];
+		fds[0].fd = ConnectionNumber(m_display);
+		fds[0].events = POLLIN;
+		fds[1].fd = m_wake;
+		fds[1].events = POLLIN;
+		if (poll(fds, 2, timeout) < 0 && errno != EINTR) {
+			syslog(LOG_ERR, "X thread poll: %s", strerror(errno));
+			return;
+		}
+	}
+}
+
+void XService::Push(Node* node)
+{
+	node->next.store(NULL, std::memory_order_relaxed);
+	Node* prev = m_head.exchange(node, std::memory_order_acq_rel);
+	prev->next.store(node, std::memory_order_release);
+}
+
+/*
+ * Return Value:
+ *   the oldest node, or NULL if the queue is empty (or a producer is
+ *   halfway through a push; it wakes the thread once it is done)
+ */
+XService::Node* XService::Pop()
+{
+	Node* tail = m_tail;
+	Node* next = tail->next.load(std::memory_order_acquire);
+	if (tail == &m_stub) {
+		if (next == NULL) {
+			return NULL;
+		}
+		m_tail = next;
+		tail = next;
+		next = next->next.load(std::memory_order_acquire);
+	}
+	if (next != NULL) {
+		m_tail = next;
+		return tail;
+	}
+	if (tail != m_head.load(std::memory_order_acquire)) {
+		return NULL;
+	}
+
+	/* tail is the last node; put the stub behind it to take it out */
+	Push(&m_stub);
+	next = tail->next.load(std::memory_order_acquire);
+	if (next != NULL) {
+		m_tail = next;
+		return tail;
+	}
+	return NULL;
+}
+
+/*
+ * Return Value:
+ *   number of tasks run
+ */
+size_t XService::Drain()
+{
+	size_t tasks = 0;
+	Node* node;
+	while ((node = Pop()) != NULL) {
+		tasks++;
+		try {
+			node->task(m_display);
+		}
+		catch (const std::exception& err) {
+			syslog(LOG_ERR, "X task failed: %s", err.what());
+		}
+		delete node;
+	}
+	return tasks;
+}
+
+void XService::Dispatch(XEvent& evt)
+{
+	/* keep Xlib's keysym tables current for every client */
+	if (evt.type == MappingNotify) {
+		XRefreshKeyboardMapping(&evt.xmapping);
+	}
+
+	for (std::vector<XServiceClient*>::iterator i = m_clients.begin(); i != m_clients.end(); i++) {
+		if ((*i)->HandleEvent(evt)) {
+			return;
+		}
+	}
+}
+
+bool XService::OnThread() const
+{
+	return t_service == this;
+}
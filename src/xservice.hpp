@@ -0,0 +1,130 @@
+/*
+   Mobile Mouse Linux Server 
+   Copyright (C) 2011 Erik Lax <erik@datahack.se>
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef _XSERVICE_HPP_
+#define _XSERVICE_HPP_
+
+#include <X11/Xlib.h>
+#include <pthread.h>
+#include <atomic>
+#include <functional>
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "stagestats.hpp"
+
+/*
+ * Code that lives on the X thread: XTest injection, the clipboard owner
+ * and the clipboard watcher. HandleEvent() is offered every X event until
+ * a client takes it. Idle() is called once per drain, before the flush;
+ * it returns how many milliseconds may pass before it wants to be called
+ * again (-1 for no limit).
+ */
+class XServiceClient
+{
+	public:
+		virtual ~XServiceClient();
+
+		virtual bool HandleEvent(const XEvent& evt) = 0;
+		virtual int Idle();
+};
+
+/*
+ * The one connection to the X server, and the thread that owns it. Other
+ * threads never call Xlib on it themselves; they Post() tasks to a
+ * lock-free queue, or Call() them and get the result through a future.
+ * The thread runs whatever is queued, dispatches the events that came in,
+ * and then flushes once, so a burst of requests costs one write. Each
+ * such pass is timed as one job of the X stage.
+ */
+class XService
+{
+	public:
+		typedef std::function<void(Display*)> Task;
+
+		XService(const std::string display = "");
+		~XService();
+
+		Display* GetDisplay() const;
+
+		void Post(const Task& task);
+		void Wait(const Task& task);
+		template <typename R> std::future<R> Call(const std::function<R(Display*)>& fn);
+
+		void AddClient(XServiceClient* client);
+		void RemoveClient(XServiceClient* client);
+
+		StageStats& GetStats();
+
+	private:
+		struct Node {
+			Task task;
+			std::atomic<Node*> next;
+		};
+
+		static void* Thread(void* arg);
+		void Loop();
+		void Push(Node* node);
+		Node* Pop();
+		size_t Drain();
+		void Dispatch(XEvent& evt);
+		bool OnThread() const;
+
+		Display *m_display;
+		pthread_t m_thread;
+		int m_wake;	/* eventfd */
+		std::atomic<bool> m_signalled;
+		std::atomic<bool> m_stop;
+
+		/* intrusive MPSC queue: producers swap m_head, the X thread pops m_tail */
+		std::atomic<Node*> m_head;
+		Node* m_tail;
+		Node m_stub;
+
+		/* only touched by the X thread */
+		std::vector<XServiceClient*> m_clients;
+
+		StageStats m_stats;
+};
+
+/*
+ * Runs fn on the X thread.
+ *
+ * Return Value:
+ *   future for its result, or for the exception it threw
+ */
+template <typename R>
+std::future<R> XService::Call(const std::function<R(Display*)>& fn)
+{
+	std::shared_ptr<std::promise<R> > promise = std::make_shared<std::promise<R> >();
+	std::future<R> result = promise->get_future();
+	Post([promise, fn](Display* display) {
+		try {
+			promise->set_value(fn(display));
+		}
+		catch (...) {
+			promise->set_exception(std::current_exception());
+		}
+	});
+	return result;
+}
+
+#endif
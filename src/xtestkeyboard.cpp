@@ -0,0 +1,245 @@
+/*
+   Mobile Mouse Linux Server
+   Copyright (C) 2011 Erik Lax <erik@datahack.se>
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "xtestkeyboard.hpp"
+
+#include <X11/extensions/XTest.h>
+#include <X11/XKBlib.h>
+#include <string.h>
+#include <syslog.h>
+
+XTestKeyboard::XTestKeyboard(XService& x, bool enabled)
+: KeyboardInterface(enabled)
+, m_x(x)
+, m_keymap(new KeymapCache())
+, m_xkbEventBase(-1)
+, m_stale(false)
+, m_pendingRemaps(0)
+{
+	pthread_mutex_init(&m_keymapLock, NULL);
+	m_x.Wait([this](Display* display) { Setup(display); });
+	m_x.AddClient(this);
+}
+
+XTestKeyboard::~XTestKeyboard()
+{
+	m_x.RemoveClient(this);
+	m_x.Wait([this](Display* display) { Restore(display); });
+	pthread_mutex_destroy(&m_keymapLock);
+}
+
+void XTestKeyboard::Setup(Display* display)
+{
+	// core MappingNotify events arrive unasked; a new XKB keyboard has to be selected
+	int opcode, errorBase, major = XkbMajorVersion, minor = XkbMinorVersion;
+	if (XkbQueryExtension(display, &opcode, &m_xkbEventBase, &errorBase, &major, &minor)) {
+		XkbSelectEvents(display, XkbUseCoreKbd, XkbNewKeyboardNotifyMask, XkbNewKeyboardNotifyMask);
+	} else {
+		m_xkbEventBase = -1;
+	}
+
+	m_keymap->Build(display);
+
+	memset(m_remappable, 0, sizeof(m_remappable));
+	const std::vector<KeyCode>& unused = m_keymap->GetUnused();
+	for (std::vector<KeyCode>::const_iterator i = unused.begin(); i != unused.end(); i++) {
+		LentKey remap;
+		remap.keycode = *i;
+		remap.keysym = NoSymbol;
+		m_remaps.push_back(remap);
+		m_remappable[*i] = true;
+	}
+}
+
+// gives back the keycodes lent to characters; they stay available for lending
+void XTestKeyboard::Restore(Display* display)
+{
+	KeySym none[2] = { NoSymbol, NoSymbol };
+	pthread_mutex_lock(&m_keymapLock);
+	for (std::list<LentKey>::iterator i = m_remaps.begin(); i != m_remaps.end(); i++) {
+		if (i->keysym != NoSymbol) {
+			XChangeKeyboardMapping(display, i->keycode, 2, none, 1);
+			m_pendingRemaps++;
+			m_keymap->Unbind(i->keysym);
+			i->keysym = NoSymbol;
+		}
+	}
+	pthread_mutex_unlock(&m_keymapLock);
+}
+
+void XTestKeyboard::ReturnKeys()
+{
+	Flush();
+	m_x.Wait([this](Display* display) { Restore(display); });
+}
+
+/* the server's announcement of our own remap of the keycode at arg */
+static Bool IsRemapNotify(Display*, XEvent* evt, XPointer arg)
+{
+	return evt->type == MappingNotify && evt->xmapping.request == MappingKeyboard
+		&& evt->xmapping.first_keycode == *(KeyCode*)arg;
+}
+
+/*
+ * Binds an unused (or the least recently used lent) keycode to a keysym
+ * the keymap lacks, so that any character can be typed. Called on the X
+ * thread with m_keymapLock held; takes a round trip to the server.
+ *
+ * Return Value:
+ *   false if there is no keycode to spare
+ */
+bool XTestKeyboard::Remap(Display* display, KeySym keysym, KeyCode& keycode)
+{
+	if (m_remaps.empty()) {
+		syslog(LOG_ERR, "no unused keycode to type keysym 0x%lx", (unsigned long)keysym);
+		return false;
+	}
+
+	LentKey& remap = m_remaps.back();
+	if (remap.keysym != NoSymbol) {
+		m_keymap->Unbind(remap.keysym);
+	}
+
+	// both levels, so that a held Shift does not matter
+	KeySym syms[2] = { keysym, keysym };
+	XChangeKeyboardMapping(display, remap.keycode, 2, syms, 1);
+
+	/* the server announces the new mapping to every client before it answers
+	 * the sync; only then may the key follow, or the focused client could
+	 * read it with the symbol the keycode had before */
+	XSync(display, False);
+	XEvent notify;
+	if (!XCheckIfEvent(display, &notify, IsRemapNotify, (XPointer)&remap.keycode)) {
+		m_pendingRemaps++;
+	}
+
+	remap.keysym = keysym;
+	m_keymap->Bind(keysym, remap.keycode, 0);
+	keycode = remap.keycode;
+	Touch(keycode);
+	return true;
+}
+
+/* marks a lent keycode as just used */
+void XTestKeyboard::Touch(KeyCode keycode)
+{
+	for (std::list<LentKey>::iterator i = m_remaps.begin(); i != m_remaps.end(); i++) {
+		if (i->keycode == keycode) {
+			m_remaps.splice(m_remaps.begin(), m_remaps, i);
+			return;
+		}
+	}
+}
+
+// notes a new mapping announced by the server; the keymap is rebuilt in Idle()
+bool XTestKeyboard::HandleEvent(const XEvent& evt)
+{
+	if (evt.type == MappingNotify) {
+		if (evt.xmapping.request == MappingKeyboard && evt.xmapping.count == 1
+				&& m_pendingRemaps > 0 && m_remappable[evt.xmapping.first_keycode & 0xff]) {
+			/* our own remap; the snapshot already has it */
+			m_pendingRemaps--;
+			return true;
+		}
+		m_stale = m_stale || evt.xmapping.request != MappingPointer;
+		return true;
+	}
+	if (m_xkbEventBase >= 0 && evt.type == m_xkbEventBase
+			&& ((const XkbEvent*)&evt)->any.xkb_type == XkbNewKeyboardNotify) {
+		m_stale = true;
+		return true;
+	}
+	return false;
+}
+
+int XTestKeyboard::Idle()
+{
+	if (m_stale) {
+		m_stale = false;
+		Rebuild(m_x.GetDisplay());
+	}
+	return -1;
+}
+
+// builds the new snapshot aside, so that lookups only wait for the swap
+void XTestKeyboard::Rebuild(Display* display)
+{
+	std::unique_ptr<KeymapCache> keymap(new KeymapCache());
+	keymap->Build(display);
+
+	pthread_mutex_lock(&m_keymapLock);
+	m_keymap.swap(keymap);
+	pthread_mutex_unlock(&m_keymapLock);
+}
+
+bool XTestKeyboard::keysymIsShiftVariant(KeySym key)
+{
+	// the key that produces this keysym needs shift if it is on the second level
+	KeyCode keycode;
+	unsigned int level;
+	pthread_mutex_lock(&m_keymapLock);
+	bool found = m_keymap->Lookup(key, keycode, level);
+	pthread_mutex_unlock(&m_keymapLock);
+	return found && level == 1;
+}
+
+void XTestKeyboard::KeyEvent(int keysym, bool press)
+{
+	KeyStroke stroke;
+	stroke.keysym = keysym;
+	stroke.press = press;
+	m_strokes.push_back(stroke);
+}
+
+// hands the queued keys to the X thread; they go out with its next flush
+void XTestKeyboard::Flush()
+{
+	if (m_strokes.empty()) {
+		return;
+	}
+
+	std::shared_ptr<std::vector<KeyStroke> > strokes = std::make_shared<std::vector<KeyStroke> >();
+	strokes->swap(m_strokes);
+	m_x.Post([this, strokes](Display* display) { Inject(display, *strokes); });
+}
+
+// waits until the X thread has written the queued keys to the server
+void XTestKeyboard::Sync()
+{
+	Flush();
+	m_x.Wait([](Display* display) { XFlush(display); });
+}
+
+void XTestKeyboard::Inject(Display* display, const std::vector<KeyStroke>& strokes)
+{
+	pthread_mutex_lock(&m_keymapLock);
+	for (std::vector<KeyStroke>::const_iterator i = strokes.begin(); i != strokes.end(); i++) {
+		KeyCode key;
+		unsigned int level;
+		if (!m_keymap->Lookup((KeySym)i->keysym, key, level)) {
+			if (!i->press || !Remap(display, (KeySym)i->keysym, key)) {
+				continue;
+			}
+		} else if (m_remappable[key]) {
+			Touch(key);
+		}
+		XTestFakeKeyEvent(display, key, i->press ? True : False, CurrentTime);
+	}
+	pthread_mutex_unlock(&m_keymapLock);
+}
@@ -0,0 +1,85 @@
+/*
+   Mobile Mouse Linux Server 
+   Copyright (C) 2011 Erik Lax <erik@datahack.se>
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef _XTESTKEYBOARD_HPP_
+#define _XTESTKEYBOARD_HPP_
+
+#include <X11/Xlib.h>
+#include <pthread.h>
+#include <list>
+#include <memory>
+#include <vector>
+
+#include "keyboardinterface.hpp"
+#include "keymap.hpp"
+#include "xservice.hpp"
+
+/*
+ * Keyboard backend that fakes key events through the X server. The keys
+ * of a Flush() go to the X thread as one task; the keymap is kept there
+ * and rebuilt when the server announces a new mapping, while lookups
+ * from other threads take m_keymapLock.
+ */
+class XTestKeyboard : public KeyboardInterface, public XServiceClient
+{
+	public:
+		XTestKeyboard(XService& x, bool enabled = true);
+		~XTestKeyboard();
+
+		bool keysymIsShiftVariant(KeySym key);
+		void Sync();
+		void ReturnKeys();
+
+		bool HandleEvent(const XEvent& evt);
+		int Idle();
+
+	protected:
+		void KeyEvent(int keysym, bool press);
+		void Flush();
+
+	private:
+		struct LentKey {
+			KeyCode keycode;
+			KeySym keysym;	/* NoSymbol while the keycode is still free */
+		};
+
+		void Setup(Display* display);
+		void Restore(Display* display);
+		void Inject(Display* display, const std::vector<KeyStroke>& strokes);
+		void Rebuild(Display* display);
+		bool Remap(Display* display, KeySym keysym, KeyCode& keycode);
+		void Touch(KeyCode keycode);
+
+		XService& m_x;
+		std::vector<KeyStroke> m_strokes;	/* queued until Flush() */
+
+		std::unique_ptr<KeymapCache> m_keymap;
+		pthread_mutex_t m_keymapLock;
+
+		/* only touched by the X thread */
+		int m_xkbEventBase;	/* -1 without the XKB extension */
+		bool m_stale;
+
+		/* unused keycodes lent to characters the keymap lacks, most
+		 * recently used first; given back when the last session ends */
+		std::list<LentKey> m_remaps;
+		bool m_remappable[256];
+		unsigned int m_pendingRemaps;
+};
+#endif
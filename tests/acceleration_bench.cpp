@@ -0,0 +1,85 @@
+/*
+   Mobile Mouse Linux Server 
+   Copyright (C) 2011 Erik Lax <erik@datahack.se>
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include <math.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "acceleration.hpp"
+
+#define BENCH_ITERATIONS 10000000
+
+static double Elapsed(const struct timespec& start)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (double)(now.tv_sec - start.tv_sec) * 1e9 + (double)(now.tv_nsec - start.tv_nsec);
+}
+
+/* a sum the compiler cannot discard */
+static volatile double g_sink;
+
+/*
+ * Reports the cost of a gain lookup per profile, and of a full pointer
+ * update with the velocity window, in nanoseconds per call.
+ */
+int main()
+{
+	static const struct {
+		const char* name;
+		AccelerationCurve::Profile profile;
+	} profiles[] = {
+		{ "flat", AccelerationCurve::AP_FLAT },
+		{ "step", AccelerationCurve::AP_STEP },
+		{ "linear", AccelerationCurve::AP_LINEAR },
+		{ "adaptive", AccelerationCurve::AP_ADAPTIVE },
+	};
+
+	for (size_t p = 0; p < sizeof(profiles) / sizeof(profiles[0]); p++) {
+		AccelerationCurve curve;
+		curve.Build(profiles[p].profile, 0.4, 4.0, AccelerationCurve::Points());
+
+		struct timespec start;
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		double sum = 0.0;
+		for (int i = 0; i < BENCH_ITERATIONS; i++) {
+			sum += curve.Factor((double)(i & 2047) / 1024.0);
+		}
+		g_sink = sum;
+		printf("%-8s Factor():  %6.2f ns\n", profiles[p].name, Elapsed(start) / BENCH_ITERATIONS);
+	}
+
+	AccelerationCurve curve;
+	curve.Build(AccelerationCurve::AP_ADAPTIVE, 0.4, 4.0, AccelerationCurve::Points());
+	PointerAccelerator accel(curve);
+
+	struct timespec start, when;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	double sum = 0.0;
+	for (int i = 0; i < BENCH_ITERATIONS; i++) {
+		/* a move every 8 ms, as a phone trackpad sends them */
+		long msec = (long)i * 8;
+		when.tv_sec = msec / 1000;
+		when.tv_nsec = (msec % 1000) * 1000000L;
+		sum += accel.Factor(hypot((double)(i % 7), (double)(i % 5)), when);
+	}
+	g_sink = sum;
+	printf("pointer update:    %6.2f ns\n", Elapsed(start) / BENCH_ITERATIONS);
+	return 0;
+}
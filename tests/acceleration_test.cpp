@@ -0,0 +1,152 @@
+/*
+   Mobile Mouse Linux Server 
+   Copyright (C) 2011 Erik Lax <erik@datahack.se>
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "acceleration.hpp"
+#include "check.hpp"
+
+#define EPS 1e-9
+
+static struct timespec At(long msec)
+{
+	struct timespec t;
+	t.tv_sec = 1000 + msec / 1000;
+	t.tv_nsec = (msec % 1000) * 1000000L;
+	return t;
+}
+
+static void TestFlat()
+{
+	AccelerationCurve curve;
+	CHECK_NEAR(curve.Factor(0.0), 1.0, EPS);
+	CHECK_NEAR(curve.Factor(0.5), 1.0, EPS);
+	CHECK_NEAR(curve.Factor(100.0), 1.0, EPS);
+}
+
+/* the original response: full gain only past the threshold */
+static void TestStep()
+{
+	AccelerationCurve curve;
+	curve.Build(AccelerationCurve::AP_STEP, 0.4, 4.0, AccelerationCurve::Points());
+	CHECK_NEAR(curve.Factor(0.0), 1.0, EPS);
+	CHECK_NEAR(curve.Factor(0.4), 1.0, EPS);
+	CHECK_NEAR(curve.Factor(0.401), 4.0, EPS);
+	CHECK_NEAR(curve.Factor(10.0), 4.0, EPS);
+}
+
+static void TestLinear()
+{
+	AccelerationCurve curve;
+	curve.Build(AccelerationCurve::AP_LINEAR, 0.4, 4.0, AccelerationCurve::Points());
+	CHECK_NEAR(curve.Factor(0.0), 1.0, EPS);
+	CHECK_NEAR(curve.Factor(0.1), 1.75, EPS);
+	CHECK_NEAR(curve.Factor(0.2), 2.5, EPS);
+	CHECK_NEAR(curve.Factor(0.4), 4.0, EPS);
+	CHECK_NEAR(curve.Factor(1.0), 4.0, EPS);
+}
+
+static void TestAdaptive()
+{
+	AccelerationCurve curve;
+	curve.Build(AccelerationCurve::AP_ADAPTIVE, 0.4, 4.0, AccelerationCurve::Points());
+	CHECK_NEAR(curve.Factor(0.0), 0.5, EPS);
+	CHECK_NEAR(curve.Factor(0.1), 0.75, 1e-3);
+	CHECK_NEAR(curve.Factor(0.3), 1.0, EPS);
+	CHECK_NEAR(curve.Factor(0.4), 1.0, EPS);
+	CHECK_NEAR(curve.Factor(1.0), 2.5, 1e-3);
+	CHECK_NEAR(curve.Factor(1.6), 4.0, EPS);
+	CHECK_NEAR(curve.Factor(5.0), 4.0, EPS);
+
+	/* the table never strays from the curve by more than a step's worth */
+	double last = curve.Factor(0.0);
+	for (double speed = 0.0; speed < 2.0; speed += 0.001) {
+		double f = curve.Factor(speed);
+		CHECK(f >= 0.5 && f <= 4.0);
+		if (speed > 0.2) {
+			CHECK(f >= last - EPS);
+		}
+		last = f;
+	}
+}
+
+static void TestCustom()
+{
+	AccelerationCurve::Points points;
+	points.push_back(std::make_pair(1.6, 4.0));
+	points.push_back(std::make_pair(0.0, 0.6));
+	points.push_back(std::make_pair(0.4, 1.0));
+
+	AccelerationCurve curve;
+	curve.Build(AccelerationCurve::AP_CUSTOM, 0.4, 4.0, points);
+	CHECK_NEAR(curve.Factor(0.0), 0.6, EPS);
+	CHECK_NEAR(curve.Factor(0.2), 0.8, 1e-3);
+	CHECK_NEAR(curve.Factor(0.4), 1.0, 1e-3);
+	CHECK_NEAR(curve.Factor(1.0), 2.5, 1e-3);
+	CHECK_NEAR(curve.Factor(3.0), 4.0, EPS);
+
+	/* without points there is nothing to follow */
+	curve.Build(AccelerationCurve::AP_CUSTOM, 0.4, 4.0, AccelerationCurve::Points());
+	CHECK_NEAR(curve.Factor(1.0), 1.0, EPS);
+}
+
+static void TestParseProfile()
+{
+	AccelerationCurve::Profile profile;
+	CHECK(AccelerationCurve::ParseProfile("flat", profile) && profile == AccelerationCurve::AP_FLAT);
+	CHECK(AccelerationCurve::ParseProfile("step", profile) && profile == AccelerationCurve::AP_STEP);
+	CHECK(AccelerationCurve::ParseProfile("linear", profile) && profile == AccelerationCurve::AP_LINEAR);
+	CHECK(AccelerationCurve::ParseProfile("adaptive", profile) && profile == AccelerationCurve::AP_ADAPTIVE);
+	CHECK(AccelerationCurve::ParseProfile("custom", profile) && profile == AccelerationCurve::AP_CUSTOM);
+	CHECK(!AccelerationCurve::ParseProfile("Flat", profile));
+}
+
+/* speed comes from the moves inside the window only */
+static void TestWindow()
+{
+	AccelerationCurve curve;
+	curve.Build(AccelerationCurve::AP_LINEAR, 0.4, 4.0, AccelerationCurve::Points());
+	PointerAccelerator accel(curve);
+
+	/* nothing to measure the first move against */
+	CHECK_NEAR(accel.Factor(5.0, At(0)), 1.0, EPS);
+
+	/* 2 pixels in 10 ms: 0.2 px/ms */
+	CHECK_NEAR(accel.Factor(2.0, At(10)), 2.5, 1e-3);
+
+	/* 2 + 2 pixels over 20 ms, the first move only marking the start */
+	CHECK_NEAR(accel.Factor(2.0, At(20)), 2.5, 1e-3);
+
+	/* after a pause the old moves say nothing; the move is not damped */
+	CHECK_NEAR(accel.Factor(20.0, At(5000)), 1.0, EPS);
+	CHECK_NEAR(accel.Factor(8.0, At(5010)), 4.0, EPS);
+
+	/* a clock stepped back starts over */
+	CHECK_NEAR(accel.Factor(8.0, At(100)), 1.0, EPS);
+}
+
+int main()
+{
+	TestFlat();
+	TestStep();
+	TestLinear();
+	TestAdaptive();
+	TestCustom();
+	TestParseProfile();
+	TestWindow();
+	return CheckResult();
+}
@@ -0,0 +1,108 @@
+/*
+   Mobile Mouse Linux Server 
+   Copyright (C) 2011 Erik Lax <erik@datahack.se>
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include <stdlib.h>
+#include <string>
+
+#include "accumulator.hpp"
+#include "protocol.hpp"
+#include "check.hpp"
+
+static void TestParseFixed()
+{
+	MotionFixed v;
+	CHECK(ParseFixed("3", v) && v == 3 * MOTION_FIXED_ONE);
+	CHECK(ParseFixed("-3.75", v) && v == -3750000);
+	CHECK(ParseFixed(".5", v) && v == 500000);
+	CHECK(ParseFixed("-.5", v) && v == -500000);
+	CHECK(ParseFixed("+2.25", v) && v == 2250000);
+	CHECK(ParseFixed("1.", v) && v == MOTION_FIXED_ONE);
+	CHECK(ParseFixed("0.0000019", v) && v == 1);
+
+	CHECK(!ParseFixed("", v));
+	CHECK(!ParseFixed("-", v));
+	CHECK(!ParseFixed(".", v));
+	CHECK(!ParseFixed("1.2.3", v));
+	CHECK(!ParseFixed("4px", v));
+	CHECK(!ParseFixed("1234567890123", v));
+}
+
+/* a pixel's worth of tenths moves the pointer by one pixel */
+static void TestSubPixel()
+{
+	MotionAccumulator acc;
+	int x, y, total = 0;
+	for (int i = 0; i < 10; i++) {
+		MotionFixed d;
+		CHECK(ParseFixed("0.1", d));
+		acc.Add(d, -d);
+		if (acc.Take(x, y)) {
+			CHECK(x == -y);
+			total += x;
+		}
+	}
+	CHECK(total == 1);
+}
+
+/*
+ * Replays a long stream of fractional MOVE deltas, formatted the way the
+ * client sends them, and checks that the pointer ends up where the sum of
+ * the deltas says, to within the fraction still carried.
+ */
+static void TestReplay()
+{
+	srand(1);
+
+	MotionAccumulator acc;
+	long long sentX = 0, sentY = 0;	/* thousandths of a pixel */
+	long long movedX = 0, movedY = 0;
+	for (int i = 0; i < 100000; i++) {
+		long long dx = rand() % 4001 - 2000;
+		long long dy = rand() % 601 - 300;
+		sentX += dx;
+		sentY += dy;
+
+		char fx[32], fy[32];
+		snprintf(fx, sizeof(fx), "%s%lld.%03lld", dx < 0 ? "-" : "", llabs(dx) / 1000, llabs(dx) % 1000);
+		snprintf(fy, sizeof(fy), "%s%lld.%03lld", dy < 0 ? "-" : "", llabs(dy) / 1000, llabs(dy) % 1000);
+
+		MotionFixed mx, my;
+		CHECK(ParseFixed(fx, mx) && mx == dx * 1000);
+		CHECK(ParseFixed(fy, my) && my == dy * 1000);
+
+		int x, y;
+		acc.Add(mx, my);
+		if (acc.Take(x, y)) {
+			movedX += x;
+			movedY += y;
+		}
+	}
+
+	/* nothing is lost; less than a pixel is still carried */
+	CHECK(llabs(sentX - movedX * 1000) < 1000);
+	CHECK(llabs(sentY - movedY * 1000) < 1000);
+}
+
+int main()
+{
+	TestParseFixed();
+	TestSubPixel();
+	TestReplay();
+	return CheckResult();
+}
@@ -0,0 +1,57 @@
+/*
+   Mobile Mouse Linux Server 
+   Copyright (C) 2011 Erik Lax <erik@datahack.se>
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef _CHECK_HPP_
+#define _CHECK_HPP_
+
+#include <math.h>
+#include <stdio.h>
+
+/*
+ * Just enough of a test harness for the unit tests: a failed check is
+ * reported and counted, and main() returns CheckResult() so that ctest
+ * sees the failure.
+ */
+static int g_checkFailures = 0;
+
+#define CHECK(cond) do { \
+	if (!(cond)) { \
+		fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+		g_checkFailures++; \
+	} \
+} while (0)
+
+#define CHECK_NEAR(a, b, eps) do { \
+	double _a = (a), _b = (b); \
+	if (fabs(_a - _b) > (eps)) { \
+		fprintf(stderr, "%s:%d: check failed: %s == %s (%g != %g)\n", __FILE__, __LINE__, #a, #b, _a, _b); \
+		g_checkFailures++; \
+	} \
+} while (0)
+
+static inline int CheckResult()
+{
+	if (g_checkFailures > 0) {
+		fprintf(stderr, "%d check(s) failed\n", g_checkFailures);
+		return 1;
+	}
+	return 0;
+}
+
+#endif
@@ -0,0 +1,99 @@
+/*
+   Mobile Mouse Linux Server 
+   Copyright (C) 2011 Erik Lax <erik@datahack.se>
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include <stdlib.h>
+
+#include "accumulator.hpp"
+#include "protocol.hpp"
+#include "check.hpp"
+
+static void TestDetents()
+{
+	DetentAccumulator wheel;
+	CHECK(wheel.Take(60) == 0);
+	CHECK(wheel.Take(59) == 0);
+	CHECK(wheel.Take(1) == 1);
+	CHECK(wheel.Take(250) == 2);
+	CHECK(wheel.Take(110) == 1);
+
+	/* turning back drops the partial detent of the other direction */
+	CHECK(wheel.Take(-119) == 0);
+	CHECK(wheel.Take(-1) == -1);
+	CHECK(wheel.Take(100) == 0);
+	CHECK(wheel.Take(20) == 1);
+
+	wheel.Take(119);
+	wheel.Reset();
+	CHECK(wheel.Take(1) == 0);
+}
+
+/*
+ * Replays fractional SCROLL deltas through the session's path: parsed to
+ * fixed point, scaled to 120ths of a detent, emitted as whole hi-res
+ * units and split into legacy detents. Scrolling one way, the hi-res
+ * total must match the client's sum and the legacy clicks must match the
+ * whole detents in it.
+ */
+static void TestReplay()
+{
+	srand(2);
+
+	MotionAccumulator scroll;
+	DetentAccumulator wheel;
+	long long sent = 0;	/* thousandths of a detent */
+	long long hires = 0, detents = 0;
+	for (int i = 0; i < 20000; i++) {
+		long long d = rand() % 1500;
+		sent += d;
+
+		char field[32];
+		snprintf(field, sizeof(field), "%lld.%03lld", d / 1000, d % 1000);
+		MotionFixed value;
+		CHECK(ParseFixed(field, value));
+
+		int x, y;
+		scroll.Add(0, value * MOUSE_HIRES_DETENT);
+		if (scroll.Take(x, y)) {
+			CHECK(x == 0);
+			hires += y;
+			detents += wheel.Take(y);
+		}
+	}
+
+	CHECK(hires == sent * MOUSE_HIRES_DETENT / 1000);
+	CHECK(detents == hires / MOUSE_HIRES_DETENT);
+}
+
+/* whole-detent scrolling reports exactly what the legacy wheel did */
+static void TestWholeDetents()
+{
+	DetentAccumulator wheel;
+	for (int i = 0; i < 100; i++) {
+		int d = (i % 7) - 3;
+		CHECK(wheel.Take(d * MOUSE_HIRES_DETENT) == d);
+	}
+}
+
+int main()
+{
+	TestDetents();
+	TestReplay();
+	TestWholeDetents();
+	return CheckResult();
+}
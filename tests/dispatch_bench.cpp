@@ -0,0 +1,183 @@
+/*
+   Mobile Mouse Linux Server 
+   Copyright (C) 2011 Erik Lax <erik@datahack.se>
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+/* logins timed per load level, one per round of motion */
+#define BENCH_PROBES 200
+#define BENCH_ROUND_USEC 5000
+#define BENCH_BURST_PACKETS 3
+
+static int64_t Now()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (int64_t)now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+static int Connect(const struct addrinfo* addr)
+{
+	int fd = socket(addr->ai_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0 || connect(fd, addr->ai_addr, addr->ai_addrlen) < 0) {
+		perror("connect");
+		if (fd >= 0) {
+			close(fd);
+		}
+		return -1;
+	}
+	return fd;
+}
+
+/*
+ * Sends the hello and reads up to the end of the CONNECTED reply.
+ *
+ * Return Value:
+ *   false if the server turned the login away or hung up
+ */
+static bool Login(int fd, const std::string& password, const std::string& id)
+{
+	std::string hello = "CONNECT\x1e" + password + "\x1e" + id + "\x1e" "dispatch_bench\x1e" "2\x1e" "2\x04";
+	if (write(fd, hello.data(), hello.size()) != (ssize_t)hello.size()) {
+		return false;
+	}
+
+	std::string reply;
+	char buf[512];
+	while (reply.find('\x04') == std::string::npos) {
+		ssize_t n = read(fd, buf, sizeof(buf));
+		if (n <= 0) {
+			return false;
+		}
+		reply.append(buf, (size_t)n);
+	}
+	return reply.compare(0, 13, "CONNECTED\x1eYES") == 0;
+}
+
+/* one touch event's worth of motion on each session; replies are dropped */
+static void Move(const std::vector<int>& sessions)
+{
+	static const char packet[] = "MOVE\x1e" "1\x1e-1\x1e" "1\x04";
+	char buf[4096];
+	for (size_t s = 0; s < sessions.size(); s++) {
+		for (int p = 0; p < BENCH_BURST_PACKETS; p++) {
+			if (write(sessions[s], packet, sizeof(packet) - 1) < 0 && errno != EAGAIN) {
+				perror("write");
+			}
+		}
+		while (read(sessions[s], buf, sizeof(buf)) > 0) {
+		}
+	}
+}
+
+/*
+ * Logs in BENCH_PROBES times while the given sessions stream motion, and
+ * reports how long the server took from hello to CONNECTED.
+ */
+static bool Probe(const struct addrinfo* addr, const std::string& password, const std::vector<int>& sessions)
+{
+	std::vector<int64_t> latencies;
+	for (int i = 0; i < BENCH_PROBES; i++) {
+		Move(sessions);
+
+		int fd = Connect(addr);
+		if (fd < 0) {
+			return false;
+		}
+		int64_t start = Now();
+		bool ok = Login(fd, password, "dispatch_bench-probe");
+		int64_t end = Now();
+		close(fd);
+		if (!ok) {
+			fprintf(stderr, "login refused; check server.password and device.id\n");
+			return false;
+		}
+		latencies.push_back(end - start);
+		usleep(BENCH_ROUND_USEC);
+	}
+
+	std::sort(latencies.begin(), latencies.end());
+	printf("%4zu sessions  login p50 %8.1f us  p99 %8.1f us  max %8.1f us\n", sessions.size(),
+			(double)latencies[latencies.size() / 2] / 1e3,
+			(double)latencies[latencies.size() * 99 / 100] / 1e3,
+			(double)latencies.back() / 1e3);
+	return true;
+}
+
+/*
+ * Usage: dispatch_bench [host [port [sessions [password]]]]
+ *
+ * Opens up to the given number of concurrent synthetic sessions on a
+ * running mmserver, each streaming MOVE packets, and reports the
+ * hello-to-CONNECTED latency of a further client at each load. The
+ * hello is dispatched by the same loop as every other session's
+ * packets, so this is what a packet waits behind the others. The
+ * server's own per-read service times are logged every
+ * server.statsInterval seconds.
+ */
+int main(int argc, char* argv[])
+{
+	const char* host = argc > 1 ? argv[1] : "127.0.0.1";
+	const char* port = argc > 2 ? argv[2] : "9099";
+	size_t count = argc > 3 ? (size_t)atoi(argv[3]) : 64;
+	std::string password = argc > 4 ? argv[4] : "";
+
+	struct addrinfo hints, *addr;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_socktype = SOCK_STREAM;
+	int err = getaddrinfo(host, port, &hints, &addr);
+	if (err != 0) {
+		fprintf(stderr, "%s: %s\n", host, gai_strerror(err));
+		return 1;
+	}
+
+	std::vector<int> sessions;
+	bool ok = Probe(addr, password, sessions);
+	for (size_t load = 1; ok && load <= count; load *= 4) {
+		while (sessions.size() < load) {
+			int fd = Connect(addr);
+			char id[32];
+			snprintf(id, sizeof(id), "dispatch_bench-%zu", sessions.size());
+			if (fd < 0 || !Login(fd, password, id)) {
+				ok = false;
+				break;
+			}
+			fcntl(fd, F_SETFL, O_NONBLOCK);
+			sessions.push_back(fd);
+		}
+		ok = ok && Probe(addr, password, sessions);
+	}
+
+	for (size_t s = 0; s < sessions.size(); s++) {
+		close(sessions[s]);
+	}
+	freeaddrinfo(addr);
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,162 @@
+/*
+   Mobile Mouse Linux Server 
+   Copyright (C) 2011 Erik Lax <erik@datahack.se>
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include "eventbatch.hpp"
+#include "injector.hpp"
+
+#define BENCH_MOVES 1000000
+#define BENCH_COUNTED_MOVES 1000
+
+/* MOVE packets that arrive in one read while the trackpad is in use */
+#define BENCH_READ_MOVES 4
+
+static double Elapsed(const struct timespec& start)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (double)(now.tv_sec - start.tv_sec) * 1e9 + (double)(now.tv_nsec - start.tv_nsec);
+}
+
+/* as libevdev_uinput_write_event() did it: one write() per event */
+static void WriteEvent(int fd, unsigned short type, unsigned short code, int value)
+{
+	struct input_event ev;
+	memset(&ev, 0, sizeof(ev));
+	ev.type = type;
+	ev.code = code;
+	ev.value = value;
+	if (write(fd, &ev, sizeof(ev)) < 0) {
+		perror("write");
+	}
+}
+
+/* MouseMove() before the batch: X, Y and SYN_REPORT per packet */
+static void MovePerEvent(int fd, int moves)
+{
+	for (int i = 0; i < moves; i++) {
+		WriteEvent(fd, EV_REL, REL_X, 1 + (i & 3));
+		WriteEvent(fd, EV_REL, REL_Y, -(i & 1));
+		WriteEvent(fd, EV_SYN, SYN_REPORT, 0);
+	}
+}
+
+/* the session now: a read's motion in one frame, one Flush() per read */
+static void MoveBatched(int fd, int moves)
+{
+	InputEventBatch batch;
+	batch.SetDevice(fd);
+	for (int i = 0; i < moves; i++) {
+		batch.Add(EV_REL, REL_X, 1 + (i & 3));
+		batch.Add(EV_REL, REL_Y, -(i & 1));
+		if (i % BENCH_READ_MOVES == BENCH_READ_MOVES - 1) {
+			batch.Sync();
+			batch.Flush();
+		}
+	}
+	batch.Flush();
+}
+
+/* as the session runs: the same batches, written by the injection thread;
+ * timed until the last of them is written */
+static void MoveInjected(int fd, int moves)
+{
+	InputInjector injector;
+	InputEventBatch batch;
+	batch.SetDevice(fd, &injector);
+	for (int i = 0; i < moves; i++) {
+		batch.Add(EV_REL, REL_X, 1 + (i & 3));
+		batch.Add(EV_REL, REL_Y, -(i & 1));
+		if (i % BENCH_READ_MOVES == BENCH_READ_MOVES - 1) {
+			batch.Sync();
+			batch.Flush();
+		}
+	}
+	batch.Flush();
+	injector.Sync();
+}
+
+/* writes the path made, each one a datagram of a SOCK_SEQPACKET pair */
+static unsigned long CountWrites(void (*path)(int, int), int moves)
+{
+	int fds[2];
+	if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, fds) < 0) {
+		perror("socketpair");
+		return 0;
+	}
+	int size = 4 << 20;
+	setsockopt(fds[0], SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+	setsockopt(fds[1], SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+	fcntl(fds[0], F_SETFL, O_NONBLOCK);
+
+	path(fds[1], moves);
+
+	unsigned long writes = 0;
+	struct input_event buf[EVENTBATCH_MAX_EVENTS];
+	while (recv(fds[0], buf, sizeof(buf), 0) > 0) {
+		writes++;
+	}
+	close(fds[0]);
+	close(fds[1]);
+	return writes;
+}
+
+/*
+ * Reports write() calls per MOVE packet, and the cost of writing a
+ * packet's motion, per event, batched, and batched through the injection
+ * thread, to /dev/null in place of /dev/uinput.
+ */
+int main()
+{
+	static const struct {
+		const char* name;
+		void (*path)(int, int);
+	} paths[] = {
+		{ "per event", MovePerEvent },
+		{ "batched", MoveBatched },
+		{ "injected", MoveInjected },
+	};
+
+	int fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+	if (fd < 0) {
+		perror("/dev/null");
+		return 1;
+	}
+
+	printf("%d MOVE packets per read\n", BENCH_READ_MOVES);
+	for (size_t p = 0; p < sizeof(paths) / sizeof(paths[0]); p++) {
+		unsigned long writes = CountWrites(paths[p].path, BENCH_COUNTED_MOVES);
+
+		struct timespec start;
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		paths[p].path(fd, BENCH_MOVES);
+		double ns = Elapsed(start) / BENCH_MOVES;
+
+		printf("%-9s  %5.2f writes/packet  %8.1f ns/packet  %6.2f M packets/s\n", paths[p].name,
+				(double)writes / BENCH_COUNTED_MOVES, ns, 1e3 / ns);
+	}
+	close(fd);
+	return 0;
+}
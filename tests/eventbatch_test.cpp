@@ -0,0 +1,164 @@
+/*
+   Mobile Mouse Linux Server 
+   Copyright (C) 2011 Erik Lax <erik@datahack.se>
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <vector>
+
+#include "eventbatch.hpp"
+#include "injector.hpp"
+#include "check.hpp"
+
+/* everything written to the pipe so far, as events */
+static std::vector<struct input_event> Drain(int fd)
+{
+	std::vector<struct input_event> events;
+	struct input_event buf[EVENTBATCH_MAX_EVENTS];
+	ssize_t n;
+	while ((n = read(fd, buf, sizeof(buf))) > 0) {
+		CHECK(n % (ssize_t)sizeof(struct input_event) == 0);
+		events.insert(events.end(), buf, buf + n / (ssize_t)sizeof(struct input_event));
+	}
+	return events;
+}
+
+static bool Is(const struct input_event& ev, unsigned short type, unsigned short code, int value)
+{
+	return ev.type == type && ev.code == code && ev.value == value;
+}
+
+/* relative motion is summed within a frame, which gets one SYN_REPORT */
+static void TestFold(int fds[2])
+{
+	InputEventBatch batch;
+	batch.SetDevice(fds[1]);
+
+	CHECK(batch.Empty());
+	CHECK(batch.Flush());
+	CHECK(Drain(fds[0]).empty());
+
+	batch.Add(EV_REL, REL_X, 3);
+	batch.Add(EV_REL, REL_Y, 2);
+	batch.Add(EV_REL, REL_X, 4);
+	CHECK(!batch.Empty());
+	CHECK(batch.Flush());
+	CHECK(batch.Empty());
+
+	std::vector<struct input_event> events = Drain(fds[0]);
+	CHECK(events.size() == 3);
+	if (events.size() == 3) {
+		CHECK(Is(events[0], EV_REL, REL_X, 7));
+		CHECK(Is(events[1], EV_REL, REL_Y, 2));
+		CHECK(Is(events[2], EV_SYN, SYN_REPORT, 0));
+	}
+}
+
+/* motion is not folded across frames, so a click stays between its moves */
+static void TestFrames(int fds[2])
+{
+	InputEventBatch batch;
+	batch.SetDevice(fds[1]);
+
+	batch.Add(EV_REL, REL_X, 1);
+	batch.Sync();
+	batch.Add(EV_KEY, BTN_LEFT, 1);
+	batch.Sync();
+	batch.Sync();
+	batch.Add(EV_KEY, BTN_LEFT, 0);
+	batch.Sync();
+	batch.Add(EV_REL, REL_X, 1);
+	CHECK(batch.Flush());
+
+	std::vector<struct input_event> events = Drain(fds[0]);
+	CHECK(events.size() == 8);
+	if (events.size() == 8) {
+		CHECK(Is(events[0], EV_REL, REL_X, 1));
+		CHECK(Is(events[1], EV_SYN, SYN_REPORT, 0));
+		CHECK(Is(events[2], EV_KEY, BTN_LEFT, 1));
+		CHECK(Is(events[3], EV_SYN, SYN_REPORT, 0));
+		CHECK(Is(events[4], EV_KEY, BTN_LEFT, 0));
+		CHECK(Is(events[5], EV_SYN, SYN_REPORT, 0));
+		CHECK(Is(events[6], EV_REL, REL_X, 1));
+		CHECK(Is(events[7], EV_SYN, SYN_REPORT, 0));
+	}
+}
+
+/* a frame too long for the batch is written in parts, none lost */
+static void TestOverflow(int fds[2])
+{
+	InputEventBatch batch;
+	batch.SetDevice(fds[1]);
+
+	for (int i = 0; i < 100; i++) {
+		batch.Add(EV_KEY, (unsigned short)(KEY_A + i % 20), i & 1);
+	}
+	CHECK(batch.Flush());
+
+	std::vector<struct input_event> events = Drain(fds[0]);
+	size_t keys = 0, syncs = 0;
+	for (size_t i = 0; i < events.size(); i++) {
+		if (events[i].type == EV_KEY) {
+			CHECK(events[i].code == KEY_A + keys % 20);
+			keys++;
+		} else if (Is(events[i], EV_SYN, SYN_REPORT, 0)) {
+			syncs++;
+		}
+	}
+	CHECK(keys == 100);
+	CHECK(syncs == 2);
+	CHECK(!events.empty() && Is(events.back(), EV_SYN, SYN_REPORT, 0));
+}
+
+/* through the injection thread, batches arrive whole and in order */
+static void TestInjector(int fds[2])
+{
+	InputInjector injector;
+	InputEventBatch batch;
+	batch.SetDevice(fds[1], &injector);
+
+	for (int i = 1; i <= 200; i++) {
+		batch.Add(EV_REL, REL_X, i);
+		CHECK(batch.Flush());
+	}
+	injector.Sync();
+
+	std::vector<struct input_event> events = Drain(fds[0]);
+	CHECK(events.size() == 400);
+	for (size_t i = 0; i + 1 < events.size(); i += 2) {
+		CHECK(Is(events[i], EV_REL, REL_X, (int)(i / 2 + 1)));
+		CHECK(Is(events[i + 1], EV_SYN, SYN_REPORT, 0));
+	}
+}
+
+int main()
+{
+	/* a pipe stands in for the uinput device */
+	int fds[2];
+	CHECK(pipe(fds) == 0);
+	fcntl(fds[0], F_SETFL, O_NONBLOCK);
+
+	TestFold(fds);
+	TestFrames(fds);
+	TestOverflow(fds);
+	TestInjector(fds);
+
+	close(fds[0]);
+	close(fds[1]);
+	return CheckResult();
+}
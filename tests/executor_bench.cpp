@@ -0,0 +1,106 @@
+/*
+   Mobile Mouse Linux Server 
+   Copyright (C) 2011 Erik Lax <erik@datahack.se>
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <syslog.h>
+#include <time.h>
+#include <unistd.h>
+#include <string>
+
+#include "executor.hpp"
+
+/* within EXECUTOR_MAX_QUEUED, so that none is refused */
+#define BENCH_COMMANDS 48
+
+static double Elapsed(const struct timespec& start)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (double)(now.tv_sec - start.tv_sec) * 1e9 + (double)(now.tv_nsec - start.tv_nsec);
+}
+
+/*
+ * Runs BENCH_COMMANDS commands one at a time, then one that creates the
+ * marker; reports what Run() cost the caller, and how long until the
+ * last command was done.
+ */
+static void Queue(const char* name, const std::string& command, const std::string& marker)
+{
+	CommandExecutor executor(1, 0);
+	CommandLine line, done;
+	line.Parse(command);
+	done.Parse("touch " + marker);
+	unlink(marker.c_str());
+
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	double queued = 0.0;
+	for (int i = 0; i < BENCH_COMMANDS; i++) {
+		struct timespec call;
+		clock_gettime(CLOCK_MONOTONIC, &call);
+		executor.Run(line);
+		queued += Elapsed(call);
+	}
+	if (!executor.Run(done)) {
+		return;
+	}
+	while (access(marker.c_str(), F_OK) != 0) {
+		usleep(100);
+	}
+	double total = Elapsed(start);
+
+	printf("%-14s Run() %8.1f us   through the executor %8.1f us/command\n", name,
+			queued / BENCH_COMMANDS / 1e3, total / (BENCH_COMMANDS + 1) / 1e3);
+	fflush(stdout);
+	executor.GetStats().Log(name);
+	unlink(marker.c_str());
+}
+
+/*
+ * Reports how long a session was held by a hotkey command before, with
+ * system(), and now, with the executor; and the executor's spawn cost
+ * for a command split into argv and for one run through /bin/sh. The
+ * executor's own stage statistics go to stderr.
+ */
+int main()
+{
+	openlog("executor_bench", LOG_PERROR, LOG_USER);
+
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (int i = 0; i < BENCH_COMMANDS; i++) {
+		if (system("true") != 0) {
+			perror("system");
+		}
+	}
+	printf("%-14s        %8.1f us/command\n", "system()", Elapsed(start) / BENCH_COMMANDS / 1e3);
+
+	char marker[] = "/tmp/executor_bench.XXXXXX";
+	int fd = mkstemp(marker);
+	if (fd < 0) {
+		perror("mkstemp");
+		return 1;
+	}
+	close(fd);
+
+	Queue("argv", "true", marker);
+	Queue("/bin/sh", "true; true", marker);
+	return 0;
+}
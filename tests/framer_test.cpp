@@ -0,0 +1,153 @@
+/*
+   Mobile Mouse Linux Server 
+   Copyright (C) 2011 Erik Lax <erik@datahack.se>
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <algorithm>
+#include <string>
+#include <string_view>
+
+#include "framer.hpp"
+#include "check.hpp"
+
+static bool Send(int fd, const std::string& data)
+{
+	return write(fd, data.data(), data.size()) == (ssize_t)data.size();
+}
+
+static int64_t Nanoseconds(const struct timespec& t)
+{
+	return (int64_t)t.tv_sec * 1000000000LL + t.tv_nsec;
+}
+
+/* packets split over reads, and several in one read */
+static void TestSplit(int fds[2])
+{
+	PacketFramer framer;
+	std::string_view packet;
+	struct timespec received;
+
+	CHECK(Send(fds[0], "MOVE\x1e" "1"));
+	CHECK(framer.Fill(fds[1]) == 6);
+	CHECK(!framer.Next(packet, received));
+	CHECK(framer.Buffered() == 6);
+
+	CHECK(Send(fds[0], std::string("\x1e" "2\x04" "CLICK\x1e" "L\x04" "KEY", 14)));
+	CHECK(framer.Fill(fds[1]) == 14);
+	CHECK(framer.Next(packet, received));
+	CHECK(packet == "MOVE\x1e" "1\x1e" "2\x04");
+	int64_t first = Nanoseconds(received);
+	CHECK(framer.Next(packet, received));
+	CHECK(packet == "CLICK\x1e" "L\x04");
+	CHECK(Nanoseconds(received) >= first);
+	CHECK(!framer.Next(packet, received));
+	CHECK(framer.Buffered() == 3);
+	CHECK(!framer.Full());
+}
+
+/*
+ * Streams numbered packets through the ring several times over, in reads
+ * that end mid-packet, so that packets straddle the wrap point; each must
+ * come out whole and in order.
+ */
+static void TestWrap(int fds[2])
+{
+	PacketFramer framer;
+	std::string stream;
+	for (int i = 0; i < 12000; i++) {
+		char buf[64];
+		snprintf(buf, sizeof(buf), "MOVE\x1e%d\x1e-%d.25\x04", i, i % 97);
+		stream += buf;
+	}
+
+	size_t sent = 0;
+	int expected = 0;
+	int64_t last = 0;
+	while (sent < stream.size()) {
+		size_t len = std::min((size_t)4093, stream.size() - sent);
+		CHECK(Send(fds[0], stream.substr(sent, len)));
+		sent += len;
+		CHECK(framer.Fill(fds[1]) == (ssize_t)len);
+
+		std::string_view packet;
+		struct timespec received;
+		while (framer.Next(packet, received)) {
+			char buf[64];
+			snprintf(buf, sizeof(buf), "MOVE\x1e%d\x1e-%d.25\x04", expected, expected % 97);
+			CHECK(packet == buf);
+			CHECK(Nanoseconds(received) >= last);
+			last = Nanoseconds(received);
+			expected++;
+		}
+	}
+	CHECK(expected == 12000);
+	CHECK(framer.Buffered() == 0);
+}
+
+/* a packet that cannot fit is reported rather than read forever */
+static void TestFull(int fds[2])
+{
+	PacketFramer framer;
+	std::string chunk(4096, 'x');
+	while (framer.Buffered() < FRAMER_CAPACITY) {
+		CHECK(Send(fds[0], chunk));
+		CHECK(framer.Fill(fds[1]) == 4096);
+	}
+	CHECK(framer.Full());
+
+	CHECK(Send(fds[0], "\x04"));
+	errno = 0;
+	CHECK(framer.Fill(fds[1]) == -1 && errno == ENOBUFS);
+}
+
+static void TestEnd()
+{
+	int fds[2];
+	CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+	close(fds[0]);
+
+	PacketFramer framer;
+	CHECK(framer.Fill(fds[1]) == 0);
+	close(fds[1]);
+}
+
+int main()
+{
+	int fds[2];
+	CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+	TestSplit(fds);
+	close(fds[0]);
+	close(fds[1]);
+
+	CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+	TestWrap(fds);
+	close(fds[0]);
+	close(fds[1]);
+
+	CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+	TestFull(fds);
+	close(fds[0]);
+	close(fds[1]);
+
+	TestEnd();
+	return CheckResult();
+}
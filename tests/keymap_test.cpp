@@ -0,0 +1,92 @@
+/*
+   Mobile Mouse Linux Server 
+   Copyright (C) 2011 Erik Lax <erik@datahack.se>
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include <string.h>
+#include <X11/keysym.h>
+#include <xkbcommon/xkbcommon.h>
+
+#include "keymap.hpp"
+#include "check.hpp"
+
+/* the first binding of a keysym wins, and keeps its level */
+static void TestBind()
+{
+	KeymapCache keymap;
+	KeyCode keycode;
+	unsigned int level;
+
+	keymap.Bind(XK_e, 26, 0);
+	keymap.Bind(XK_E, 26, 1);
+	keymap.Bind(XK_EuroSign, 26, 2);
+	keymap.Bind(XK_e, 40, 2);
+
+	CHECK(keymap.Lookup(XK_e, keycode, level) && keycode == 26 && level == 0);
+	CHECK(keymap.Lookup(XK_E, keycode, level) && keycode == 26 && level == 1);
+	CHECK(keymap.Lookup(XK_EuroSign, keycode, level) && keycode == 26 && level == 2);
+
+	/* by its Unicode keysym as well */
+	CHECK(keymap.Lookup(0x010020ac, keycode, level) && keycode == 26 && level == 2);
+
+	keymap.Unbind(XK_EuroSign);
+	CHECK(!keymap.Lookup(XK_EuroSign, keycode, level));
+}
+
+static struct xkb_keymap* Compile(struct xkb_context* context, const char* layout)
+{
+	struct xkb_rule_names names;
+	memset(&names, 0, sizeof(names));
+	names.layout = layout;
+	return xkb_keymap_new_from_names(context, &names, XKB_KEYMAP_COMPILE_NO_FLAGS);
+}
+
+/* AltGr characters of a German layout are found on level 2 of their key */
+static void TestLevel3()
+{
+	struct xkb_context* context = xkb_context_new(XKB_CONTEXT_NO_FLAGS);
+	CHECK(context != NULL);
+	if (context == NULL) {
+		return;
+	}
+	struct xkb_keymap* xkb = Compile(context, "de");
+	if (xkb == NULL) {
+		fprintf(stderr, "no xkb data for \"de\"; level 3 lookups not checked\n");
+		xkb_context_unref(context);
+		return;
+	}
+
+	KeymapCache keymap;
+	keymap.Build(xkb, 9, 255);
+	xkb_keymap_unref(xkb);
+	xkb_context_unref(context);
+
+	KeyCode e, q, euro, at, altgr;
+	unsigned int level;
+	CHECK(keymap.Lookup(XK_ISO_Level3_Shift, altgr, level) && level == 0);
+	CHECK(keymap.Lookup(XK_e, e, level) && level == 0);
+	CHECK(keymap.Lookup(XK_q, q, level) && level == 0);
+	CHECK(keymap.Lookup(XK_EuroSign, euro, level) && level == 2 && euro == e);
+	CHECK(keymap.Lookup(XK_at, at, level) && level == 2 && at == q);
+}
+
+int main()
+{
+	TestBind();
+	TestLevel3();
+	return CheckResult();
+}
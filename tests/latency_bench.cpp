@@ -0,0 +1,220 @@
+/*
+   Mobile Mouse Linux Server 
+   Copyright (C) 2011 Erik Lax <erik@datahack.se>
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#include "framer.hpp"
+
+/* a phone sends a few packets per touch event, some tens of times a second */
+#define BENCH_BURSTS 400
+#define BENCH_BURST_PACKETS 3
+#define BENCH_BURST_USEC 5000
+
+/* what the server applies to its end; see MobileMouseSession::TuneSocket() */
+struct SocketMode
+{
+	const char* name;
+	bool latency;	/* server.latencyMode: TCP_NODELAY, TCP_QUICKACK after each read */
+	int busyPoll;	/* server.busyPoll, microseconds */
+	int dscp;	/* server.dscp, -1 to leave alone */
+	int priority;	/* server.socketPriority, -1 to leave alone */
+};
+
+static int64_t Now()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (int64_t)now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+/* the phone: default socket options, one write() per packet, each
+ * stamped with the time it was written */
+static void* Phone(void* arg)
+{
+	int fd = *(int*)arg;
+	for (int b = 0; b < BENCH_BURSTS; b++) {
+		for (int p = 0; p < BENCH_BURST_PACKETS; p++) {
+			char packet[64];
+			int len = snprintf(packet, sizeof(packet), "MOVE\x1e" "1\x1e-1\x1e" "1\x1e%lld\x04", (long long)Now());
+			if (write(fd, packet, (size_t)len) != len) {
+				perror("write");
+				return NULL;
+			}
+		}
+		usleep(BENCH_BURST_USEC);
+	}
+	shutdown(fd, SHUT_WR);
+	return NULL;
+}
+
+static void Tune(int fd, const SocketMode& mode)
+{
+	int on = 1;
+	if (mode.latency && setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on)) != 0) {
+		perror("TCP_NODELAY");
+	}
+	if (mode.busyPoll > 0 && setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &mode.busyPoll, sizeof(mode.busyPoll)) != 0) {
+		perror("SO_BUSY_POLL");
+	}
+	int tos = mode.dscp << 2;
+	if (mode.dscp >= 0 && setsockopt(fd, IPPROTO_IP, IP_TOS, &tos, sizeof(tos)) != 0) {
+		perror("IP_TOS");
+	}
+	if (mode.priority >= 0 && setsockopt(fd, SOL_SOCKET, SO_PRIORITY, &mode.priority, sizeof(mode.priority)) != 0) {
+		perror("SO_PRIORITY");
+	}
+}
+
+/* a connected pair over loopback TCP: phone end first, server end second */
+static bool ConnectTcp(int fds[2])
+{
+	int listener = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	socklen_t len = sizeof(addr);
+	if (listener < 0 || bind(listener, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(listener, 1) < 0 ||
+			getsockname(listener, (struct sockaddr*)&addr, &len) < 0) {
+		perror("listen");
+		return false;
+	}
+	fds[0] = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fds[0] < 0 || connect(fds[0], (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+		perror("connect");
+		close(listener);
+		return false;
+	}
+	fds[1] = accept4(listener, NULL, NULL, SOCK_CLOEXEC);
+	close(listener);
+	return fds[1] >= 0;
+}
+
+/* a connected Unix stream pair, as a local forwarder has with a
+ * server.listen unix: or abstract: endpoint */
+static bool ConnectUnix(int fds[2])
+{
+	if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) < 0) {
+		perror("socketpair");
+		return false;
+	}
+	return true;
+}
+
+/*
+ * Reads the phone's packets as the session does, through a PacketFramer,
+ * and returns how long each took from write() to being framed.
+ */
+static std::vector<int64_t> Run(int fds[2], const SocketMode& mode, bool tcp)
+{
+	std::unique_ptr<PacketFramer> framer(new PacketFramer());	/* too large for the stack */
+	std::vector<int64_t> latencies;
+	latencies.reserve(BENCH_BURSTS * BENCH_BURST_PACKETS);
+
+	if (tcp) {
+		Tune(fds[1], mode);
+	}
+	pthread_t phone;
+	if (pthread_create(&phone, NULL, Phone, &fds[0]) != 0) {
+		perror("pthread_create");
+		return latencies;
+	}
+
+	int on = 1;
+	while (framer->Fill(fds[1]) > 0) {
+		if (tcp && mode.latency && setsockopt(fds[1], IPPROTO_TCP, TCP_QUICKACK, &on, sizeof(on)) != 0) {
+			perror("TCP_QUICKACK");
+		}
+		std::string_view packet;
+		struct timespec received;
+		while (framer->Next(packet, received)) {
+			int64_t now = Now();
+			size_t stamp = packet.rfind('\x1e');
+			if (stamp != std::string_view::npos) {
+				latencies.push_back(now - strtoll(packet.data() + stamp + 1, NULL, 10));
+			}
+		}
+	}
+	pthread_join(phone, NULL);
+	return latencies;
+}
+
+static void Report(const char* name, std::vector<int64_t>& latencies)
+{
+	if (latencies.empty()) {
+		printf("%-24s no packets\n", name);
+		return;
+	}
+	std::sort(latencies.begin(), latencies.end());
+	printf("%-24s p50 %8.1f us  p99 %8.1f us  max %8.1f us\n", name,
+			(double)latencies[latencies.size() / 2] / 1e3,
+			(double)latencies[latencies.size() * 99 / 100] / 1e3,
+			(double)latencies.back() / 1e3);
+}
+
+/*
+ * Reports p50/p99 arrival latency of small packets over loopback TCP,
+ * with the server's latency options off and on, and over a Unix socket.
+ * DSCP and priority only matter on a congested link; over loopback they
+ * should change nothing.
+ */
+int main()
+{
+	static const SocketMode modes[] = {
+		{ "default", false, 0, -1, -1 },
+		{ "latencyMode", true, 0, -1, -1 },
+		{ "latencyMode+busyPoll", true, 50, -1, -1 },
+		{ "latencyMode+dscp", true, 0, 46, 6 },
+	};
+
+	for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); m++) {
+		int fds[2];
+		if (!ConnectTcp(fds)) {
+			return 1;
+		}
+		std::vector<int64_t> latencies = Run(fds, modes[m], true);
+		close(fds[0]);
+		close(fds[1]);
+		Report(modes[m].name, latencies);
+	}
+
+	int fds[2];
+	if (!ConnectUnix(fds)) {
+		return 1;
+	}
+	std::vector<int64_t> latencies = Run(fds, modes[0], false);
+	close(fds[0]);
+	close(fds[1]);
+	Report("unix", latencies);
+	return 0;
+}
@@ -0,0 +1,178 @@
+/*
+   Mobile Mouse Linux Server 
+   Copyright (C) 2011 Erik Lax <erik@datahack.se>
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <new>
+#include <string>
+#include <string_view>
+
+#ifdef HAVE_PCRECPP
+#include <pcrecpp.h>
+#else
+#include <regex>
+#endif
+
+#include "protocol.hpp"
+
+#define BENCH_ITERATIONS 1000000
+#define BENCH_REGEX_ITERATIONS 20000
+
+/* every allocation made by the program; ParsePacket() must add none */
+static unsigned long g_allocations;
+
+void* operator new(size_t size)
+{
+	g_allocations++;
+	void* p = malloc(size ? size : 1);
+	if (p == NULL) {
+		throw std::bad_alloc();
+	}
+	return p;
+}
+
+void operator delete(void* p) noexcept
+{
+	free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+	free(p);
+}
+
+static double Elapsed(const struct timespec& start)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (double)(now.tv_sec - start.tv_sec) * 1e9 + (double)(now.tv_nsec - start.tv_nsec);
+}
+
+/* a sum the compiler cannot discard */
+static volatile size_t g_sink;
+
+/* what a phone sends while the pointer is in use: mostly motion */
+static const char* const g_packets[] = {
+	"MOVE\x1e-3.5\x1e" "2\x1e" "1\x04",
+	"MOVE\x1e" "12\x1e-0.75\x1e" "0\x04",
+	"MOVE\x1e" "0.25\x1e" "4\x1e" "1\x1e\x04",
+	"SCROLL\x1e" "0.0\x1e-12.5\x1e" "0\x04",
+	"CLICK\x1eL\x1e" "D\x1e\x04",
+	"CLICK\x1eL\x1eU\x1e\x04",
+	"KEY\x1e" "a\x1e" "a\x1e\x04",
+	"SETOPTION\x1e" "CLIPBOARDSYNC\x1eYES\x04",
+};
+#define BENCH_PACKETS (sizeof(g_packets) / sizeof(g_packets[0]))
+
+/* the session before ParsePacket(): each expression compiled where it was
+ * tried, in the order it was tried, captures copied out as strings */
+#ifdef HAVE_PCRECPP
+#define REGEX_NAME "pcrecpp"
+static size_t MatchOld(const std::string& packet)
+{
+	std::string a, b, c;
+	if (pcrecpp::RE("SETOPTION\x1e(.*?)\x1e(.*?)\x04").FullMatch(packet, &a, &b))
+		return a.size() + b.size();
+	if (pcrecpp::RE("CLICK\x1e([LR])\x1e([DU])\x1e(.*?)\x04").FullMatch(packet, &a, &b, &c))
+		return a.size() + b.size() + c.size();
+	if (pcrecpp::RE("MOVE\x1e(-?[\\d\x2e]+)\x1e(-?[\\d\x2e]+)\x1e[10]\x1e?\x04").FullMatch(packet, &a, &b))
+		return (size_t)(strtod(a.c_str(), NULL) + strtod(b.c_str(), NULL));
+	if (pcrecpp::RE("SCROLL\x1e(-?\\d+.?\\d+)\x1e(-?\\d+.?\\d+)\x1e(.*?)\x04").FullMatch(packet, &a, &b, &c))
+		return (size_t)(strtod(a.c_str(), NULL) + strtod(b.c_str(), NULL));
+	if (pcrecpp::RE("KEY\x1e(.*?)\x1e(.*?)\x1e(.*?)\x04").FullMatch(packet, &a, &b, &c))
+		return a.size() + b.size() + c.size();
+	return 0;
+}
+#else
+/* without libpcrecpp, std::regex stands in with the same expressions */
+#define REGEX_NAME "std::regex"
+static size_t MatchOld(const std::string& packet)
+{
+	std::smatch m;
+	if (std::regex_match(packet, m, std::regex("SETOPTION\x1e(.*?)\x1e(.*?)\x04")))
+		return m.str(1).size() + m.str(2).size();
+	if (std::regex_match(packet, m, std::regex("CLICK\x1e([LR])\x1e([DU])\x1e(.*?)\x04")))
+		return m.str(1).size() + m.str(2).size() + m.str(3).size();
+	if (std::regex_match(packet, m, std::regex("MOVE\x1e(-?[\\d\x2e]+)\x1e(-?[\\d\x2e]+)\x1e[10]\x1e?\x04")))
+		return (size_t)(strtod(m.str(1).c_str(), NULL) + strtod(m.str(2).c_str(), NULL));
+	if (std::regex_match(packet, m, std::regex("SCROLL\x1e(-?\\d+.?\\d+)\x1e(-?\\d+.?\\d+)\x1e(.*?)\x04")))
+		return (size_t)(strtod(m.str(1).c_str(), NULL) + strtod(m.str(2).c_str(), NULL));
+	if (std::regex_match(packet, m, std::regex("KEY\x1e(.*?)\x1e(.*?)\x1e(.*?)\x04")))
+		return m.str(1).size() + m.str(2).size() + m.str(3).size();
+	return 0;
+}
+#endif
+
+/* the session now: one pass, views into the read buffer, fixed-point fields */
+static size_t MatchNew(std::string_view raw)
+{
+	Packet packet;
+	if (!ParsePacket(raw, packet))
+		return 0;
+	if (packet.command == PC_MOVE || packet.command == PC_SCROLL) {
+		MotionFixed x, y;
+		if (packet.count >= 2 && ParseFixed(packet.fields[0], x) && ParseFixed(packet.fields[1], y))
+			return (size_t)(x + y);
+		return 0;
+	}
+	return packet.count + packet.body.size();
+}
+
+/*
+ * Reports the cost of tokenizing a packet with ParsePacket() and with the
+ * regular expressions it replaced, in nanoseconds per packet. Fails if
+ * ParsePacket() allocated.
+ */
+int main()
+{
+	std::string_view views[BENCH_PACKETS];
+	std::string strings[BENCH_PACKETS];
+	for (size_t p = 0; p < BENCH_PACKETS; p++) {
+		views[p] = g_packets[p];
+		strings[p] = g_packets[p];
+	}
+
+	struct timespec start;
+	unsigned long allocations = g_allocations;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	size_t sum = 0;
+	for (int i = 0; i < BENCH_ITERATIONS; i++) {
+		sum += MatchNew(views[i % BENCH_PACKETS]);
+	}
+	g_sink = sum;
+	double parsed = Elapsed(start) / BENCH_ITERATIONS;
+	allocations = g_allocations - allocations;
+	printf("ParsePacket():     %10.2f ns, %lu allocations\n", parsed, allocations);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	sum = 0;
+	for (int i = 0; i < BENCH_REGEX_ITERATIONS; i++) {
+		sum += MatchOld(strings[i % BENCH_PACKETS]);
+	}
+	g_sink = sum;
+	double matched = Elapsed(start) / BENCH_REGEX_ITERATIONS;
+	printf("%-18s %10.2f ns (%.0fx)\n", REGEX_NAME ":", matched, matched / parsed);
+
+	if (allocations != 0) {
+		fprintf(stderr, "FAIL: ParsePacket() allocated %lu times\n", allocations);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,121 @@
+/*
+   Mobile Mouse Linux Server 
+   Copyright (C) 2011 Erik Lax <erik@datahack.se>
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either version 2
+   of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include <string_view>
+
+#include "protocol.hpp"
+#include "check.hpp"
+
+using namespace std::literals;
+
+static void TestLookup()
+{
+	CHECK(LookupCommand("CONNECT") == PC_CONNECT);
+	CHECK(LookupCommand("SETOPTION") == PC_SETOPTION);
+	CHECK(LookupCommand("CLICK") == PC_CLICK);
+	CHECK(LookupCommand("MOVE") == PC_MOVE);
+	CHECK(LookupCommand("SCROLL") == PC_SCROLL);
+	CHECK(LookupCommand("ZOOM") == PC_ZOOM);
+	CHECK(LookupCommand("KEY") == PC_KEY);
+	CHECK(LookupCommand("KEYSTRING") == PC_KEYSTRING);
+	CHECK(LookupCommand("GESTURE") == PC_GESTURE);
+	CHECK(LookupCommand("HOTKEY") == PC_HOTKEY);
+	CHECK(LookupCommand("SWITCHMODE") == PC_SWITCHMODE);
+	CHECK(LookupCommand("PROGRAMKEY") == PC_PROGRAMKEY);
+	CHECK(LookupCommand("OPENLINK") == PC_OPENLINK);
+
+	/* same hash slot, different word */
+	CHECK(LookupCommand("MAVE") == PC_UNKNOWN);
+	CHECK(LookupCommand("move") == PC_UNKNOWN);
+	CHECK(LookupCommand("") == PC_UNKNOWN);
+	CHECK(LookupCommand("X") == PC_UNKNOWN);
+}
+
+static void TestParse()
+{
+	Packet packet;
+
+	CHECK(ParsePacket("MOVE\x1e-3.5\x1e" "2\x1e" "1\x04"sv, packet));
+	CHECK(packet.command == PC_MOVE);
+	CHECK(packet.name == "MOVE");
+	CHECK(packet.count == 3);
+	CHECK(packet.fields[0] == "-3.5");
+	CHECK(packet.fields[1] == "2");
+	CHECK(packet.fields[2] == "1");
+	CHECK(packet.body == "-3.5\x1e" "2\x1e" "1");
+
+	/* empty fields are kept, a trailing separator gives one more */
+	CHECK(ParsePacket("KEY\x1e\x1e" "a\x1e\x04"sv, packet));
+	CHECK(packet.command == PC_KEY);
+	CHECK(packet.count == 3);
+	CHECK(packet.fields[0].empty());
+	CHECK(packet.fields[1] == "a");
+	CHECK(packet.fields[2].empty());
+
+	/* a command word alone */
+	CHECK(ParsePacket("SWITCHMODE\x04"sv, packet));
+	CHECK(packet.command == PC_SWITCHMODE);
+	CHECK(packet.count == 0);
+	CHECK(packet.body.empty());
+
+	/* unknown commands still parse */
+	CHECK(ParsePacket("PING\x1e" "1\x04"sv, packet));
+	CHECK(packet.command == PC_UNKNOWN);
+	CHECK(packet.name == "PING");
+	CHECK(packet.count == 1);
+
+	/* unterminated input is refused */
+	CHECK(!ParsePacket(""sv, packet));
+	CHECK(!ParsePacket("MOVE\x1e" "1\x1e" "1"sv, packet));
+}
+
+/* the last field takes whatever is left beyond PROTOCOL_MAX_FIELDS */
+static void TestFieldLimit()
+{
+	Packet packet;
+	CHECK(ParsePacket("KEYSTRING\x1e" "1\x1e" "2\x1e" "3\x1e" "4\x1e" "5\x1e" "6\x1e" "7\x1e" "8\x1e" "9\x1e" "10\x04"sv, packet));
+	CHECK(packet.count == PROTOCOL_MAX_FIELDS);
+	CHECK(packet.fields[PROTOCOL_MAX_FIELDS - 2] == "7");
+	CHECK(packet.fields[PROTOCOL_MAX_FIELDS - 1] == "8\x1e" "9\x1e" "10");
+}
+
+/* ParseInt truncates like strtol() did */
+static void TestParseInt()
+{
+	int v;
+	CHECK(ParseInt("42", v) && v == 42);
+	CHECK(ParseInt("-7", v) && v == -7);
+	CHECK(ParseInt("+3", v) && v == 3);
+	CHECK(ParseInt("-3.75", v) && v == -3);
+	CHECK(ParseInt(".5", v) && v == 0);
+	CHECK(ParseInt("-.5", v) && v == 0);
+	CHECK(ParseInt("12abc", v) && v == 12);
+	CHECK(!ParseInt("", v));
+	CHECK(!ParseInt("abc", v));
+	CHECK(!ParseInt("-", v));
+}
+
+int main()
+{
+	TestLookup();
+	TestParse();
+	TestFieldLimit();
+	TestParseInt();
+	return CheckResult();
+}